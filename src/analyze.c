@@ -0,0 +1,185 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "analyze.h"
+#include "hash.h"
+#include "opcodes.h"
+#include "util.h"
+
+#define CODEMAP_MAGIC "NCM\x1A"
+#define CODEMAP_HEADER_LEN 12 /* magic, then the ROM hash as uint64 LE */
+#define CODEMAP_PATH_MAX 4096
+
+typedef enum Flow{
+    FLOW_NEXT, /* falls through */
+    FLOW_BRANCH, /* falls through or goes to the relative target */
+    FLOW_JUMP, /* JMP absolute */
+    FLOW_CALL, /* JSR, assumed to return */
+    FLOW_END /* RTS, RTI, BRK, JMP indirect, JAM: nowhere we can know */
+} Flow;
+
+#define OPERAND_BYTES(code, mnemonic, handler, mode, cyc, official) [code] = BYTES_##mode,
+static const uint8_t operand_bytes[256] = { OPCODE_TABLE(OPERAND_BYTES) };
+#undef OPERAND_BYTES
+
+static Flow flow(uint8_t);
+static uint8_t prg_read(const Memory*, uint16_t);
+static uint16_t prg_read16(const Memory*, uint16_t);
+static void count(CodeMap*);
+
+uint64_t prg_hash(const Memory* mem){
+    uint8_t prg[CODEMAP_SIZE];
+    for (int i = 0; i < CODEMAP_SIZE; ++i)
+        prg[i] = prg_read(mem, CODEMAP_START + i);
+    return hash64(prg, CODEMAP_SIZE, 0);
+}
+
+CodeMap* analyze_prg(const Memory* mem){
+    /* recursive descent: a stack of block starts, each followed until
+       control flow goes somewhere unknown or reaches decoded code */
+    CodeMap* map = xalloc(1, sizeof(CodeMap), calloc);
+    map->rom_hash = prg_hash(mem);
+    uint8_t* flags = map->flags;
+
+    uint16_t stack[CODEMAP_SIZE];
+    int top = 0;
+    for (uint16_t vector = 0xFFFA; vector != 0; vector += 2)
+        stack[top++] = prg_read16(mem, vector);
+
+    while (top > 0){
+        uint16_t pc = stack[--top];
+        if (pc < CODEMAP_START)
+            continue; /* code in RAM */
+        flags[pc - CODEMAP_START] |= CODE_BLOCK;
+        for (;;){
+            if (pc < CODEMAP_START || (flags[pc - CODEMAP_START] & CODE_OPCODE))
+                break;
+            uint8_t op = prg_read(mem, pc);
+            uint8_t n = operand_bytes[op];
+            if (pc + n > 0xFFFF)
+                break; /* runs off the end of the address space */
+            flags[pc - CODEMAP_START] |= CODE_OPCODE;
+            for (int i = 1; i <= n; ++i)
+                flags[pc + i - CODEMAP_START] |= CODE_OPERAND;
+            uint16_t next = pc + 1 + n;
+            Flow f = flow(op);
+            if (f == FLOW_BRANCH){
+                stack[top++] = next + (int8_t) prg_read(mem, pc + 1);
+                if (next >= CODEMAP_START)
+                    flags[next - CODEMAP_START] |= CODE_BLOCK;
+            }
+            else if (f == FLOW_JUMP || f == FLOW_CALL){
+                stack[top++] = prg_read16(mem, pc + 1);
+                if (f == FLOW_JUMP)
+                    break;
+                if (next >= CODEMAP_START)
+                    flags[next - CODEMAP_START] |= CODE_BLOCK; /* return point */
+            }
+            else if (f == FLOW_END){
+                if (op == 0x6C){
+                    /* the pointer itself is data */
+                    uint16_t ptr = prg_read16(mem, pc + 1);
+                    for (int i = 0; i < 2; ++i)
+                        if ((uint16_t)(ptr + i) >= CODEMAP_START)
+                            flags[(uint16_t)(ptr + i) - CODEMAP_START] |= CODE_DATA;
+                }
+                break;
+            }
+            else if (n == 2){
+                /* absolute operands point at data */
+                uint16_t target = prg_read16(mem, pc + 1);
+                if (target >= CODEMAP_START)
+                    flags[target - CODEMAP_START] |= CODE_DATA;
+            }
+            pc = next;
+            if (top >= CODEMAP_SIZE - 2)
+                err_exit("Analyze: work stack overflow");
+        }
+    }
+    count(map);
+    return map;
+}
+
+bool codemap_load(CodeMap* map, const char* path, uint64_t rom_hash){
+    /* false if the file is missing, damaged or for another ROM */
+    FILE* f = fopen(path, "rb");
+    if (f == NULL)
+        return false;
+    uint8_t header[CODEMAP_HEADER_LEN];
+    bool ok = fread(header, 1, CODEMAP_HEADER_LEN, f) == CODEMAP_HEADER_LEN
+           && memcmp(header, CODEMAP_MAGIC, 4) == 0
+           && fread(map->flags, 1, CODEMAP_SIZE, f) == CODEMAP_SIZE;
+    fclose(f);
+    uint64_t hash = 0;
+    for (int i = 0; i < 8; ++i)
+        hash |= (uint64_t) header[4 + i] << (8 * i);
+    if (!ok || hash != rom_hash)
+        return false;
+    map->rom_hash = hash;
+    count(map);
+    return true;
+}
+
+void codemap_save(const CodeMap* map, const char* path){
+    /* magic, ROM hash (uint64 LE), CODEMAP_SIZE flag bytes */
+    FILE* f = fopen(path, "wb");
+    if (f == NULL)
+        err_exit("Analyze: Couldn't open %s for writing", path);
+    uint8_t header[CODEMAP_HEADER_LEN];
+    memcpy(header, CODEMAP_MAGIC, 4);
+    for (int i = 0; i < 8; ++i)
+        header[4 + i] = map->rom_hash >> (8 * i);
+    if (fwrite(header, 1, CODEMAP_HEADER_LEN, f) != CODEMAP_HEADER_LEN
+        || fwrite(map->flags, 1, CODEMAP_SIZE, f) != CODEMAP_SIZE)
+        err_exit("Analyze: Couldn't write %s", path);
+    fclose(f);
+}
+
+CodeMap* cached_codemap(const Memory* mem, const char* dir, bool* cached){
+    /* dir/<PRG hash>.cdm if it's there, otherwise analyse and save it */
+    uint64_t hash = prg_hash(mem);
+    char path[CODEMAP_PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%016lx.cdm", dir, hash);
+    CodeMap* map = xalloc(1, sizeof(CodeMap), calloc);
+    *cached = codemap_load(map, path, hash);
+    if (*cached)
+        return map;
+    free(map);
+    map = analyze_prg(mem);
+    codemap_save(map, path);
+    return map;
+}
+
+static Flow flow(uint8_t op){
+    switch (op){
+        case 0x4C: return FLOW_JUMP;
+        case 0x20: return FLOW_CALL;
+        case 0x00: case 0x40: case 0x60: case 0x6C: return FLOW_END;
+    }
+    if ((op & 0x1F) == 0x10) /* BPL BMI BVC BVS BCC BCS BNE BEQ */
+        return FLOW_BRANCH;
+    if ((op & 0x0F) == 0x02 && (op & 0x9F) != 0x82) /* JAM, $82 $A2 $C2 $E2 are NOPs and LDX */
+        return FLOW_END;
+    return FLOW_NEXT;
+}
+
+static uint8_t prg_read(const Memory* mem, uint16_t addr){
+    /* straight from the map, no I/O: PRG has no side effects */
+    return *(mem->map[addr]);
+}
+
+static uint16_t prg_read16(const Memory* mem, uint16_t addr){
+    return prg_read(mem, addr) | (prg_read(mem, addr + 1) << 8);
+}
+
+static void count(CodeMap* map){
+    map->instructions = map->operand_bytes = map->data_bytes = map->blocks = 0;
+    for (int i = 0; i < CODEMAP_SIZE; ++i){
+        map->instructions += (map->flags[i] & CODE_OPCODE) != 0;
+        map->operand_bytes += (map->flags[i] & CODE_OPERAND) != 0;
+        map->data_bytes += (map->flags[i] & CODE_DATA) != 0;
+        map->blocks += (map->flags[i] & CODE_BLOCK) != 0;
+    }
+}
@@ -0,0 +1,34 @@
+#ifndef ANALYZE_H
+#define ANALYZE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "mem.h"
+
+/* Static code/data map of PRG ($8000-$FFFF as mapped), found by following
+   control flow from the NMI, reset and IRQ vectors. Indirect jumps and
+   jump tables can't be followed, what they reach stays unknown. Meant for
+   warming a decoded instruction cache before the code first runs */
+
+#define CODEMAP_START 0x8000
+#define CODEMAP_SIZE 0x8000
+
+#define CODE_OPCODE 0x01 /* first byte of an instruction */
+#define CODE_OPERAND 0x02
+#define CODE_DATA 0x04 /* read or pointed at by an absolute operand */
+#define CODE_BLOCK 0x08 /* an instruction that starts a basic block */
+
+typedef struct CodeMap{
+    uint64_t rom_hash; /* hash64 of the PRG bytes the map describes */
+    uint8_t flags[CODEMAP_SIZE]; /* CODE_* per address from CODEMAP_START */
+    uint32_t instructions, operand_bytes, data_bytes, blocks;
+} CodeMap;
+
+uint64_t prg_hash(const Memory*);
+CodeMap* analyze_prg(const Memory*);
+bool codemap_load(CodeMap*, const char*, uint64_t);
+void codemap_save(const CodeMap*, const char*);
+CodeMap* cached_codemap(const Memory*, const char*, bool*);
+
+#endif
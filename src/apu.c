@@ -0,0 +1,606 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "apu.h"
+#include "mem.h"
+
+/* Channels aren't stepped per CPU cycle. apu_run catches the APU up to a
+   given cycle whenever the CPU touches an APU register and at frame end,
+   and within that span each channel jumps straight from one timer expiry
+   to the next. Output changes are recorded as band-limited steps at their
+   exact cycle, so the sample rate never has to divide the CPU clock */
+
+#define QUARTER 1
+#define HALF 2
+#define FRAME_IRQ 4
+#define WRAP 8
+
+/* CPU cycles a DMC sample fetch halts the CPU for. 4 is the usual case,
+   it's 3 next to a CPU write and 2 during OAM DMA */
+#define DMC_STALL 4
+
+typedef struct SeqStep{
+    uint32_t cycle; /* CPU cycles after the sequence start */
+    uint8_t events;
+} SeqStep;
+
+/* NTSC frame sequencer, $4017 bit 7 selects the 5-step table */
+static const SeqStep four_step[] = {
+    { 7457, QUARTER }, { 14913, QUARTER | HALF }, { 22371, QUARTER },
+    { 29829, QUARTER | HALF | FRAME_IRQ }, { 29830, WRAP }
+};
+static const SeqStep five_step[] = {
+    { 7457, QUARTER }, { 14913, QUARTER | HALF }, { 22371, QUARTER },
+    { 37281, QUARTER | HALF }, { 37282, WRAP }
+};
+
+static const uint8_t length_table[32] = {
+    10, 254, 20, 2, 40, 4, 80, 6, 160, 8, 60, 10, 14, 12, 26, 14,
+    12, 16, 24, 18, 48, 20, 96, 22, 192, 24, 72, 26, 16, 28, 32, 30
+};
+
+static const uint8_t duty_table[4][8] = {
+    { 0, 1, 0, 0, 0, 0, 0, 0 },
+    { 0, 1, 1, 0, 0, 0, 0, 0 },
+    { 0, 1, 1, 1, 1, 0, 0, 0 },
+    { 1, 0, 0, 1, 1, 1, 1, 1 }
+};
+
+static const uint8_t triangle_table[32] = {
+    15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15
+};
+
+/* NTSC periods in CPU cycles */
+static const uint16_t noise_periods[16] = {
+    4, 8, 16, 32, 64, 96, 128, 160, 202, 254, 380, 508, 762, 1016, 2034, 4068
+};
+static const uint16_t dmc_periods[16] = {
+    428, 380, 340, 320, 286, 254, 226, 214, 190, 160, 142, 128, 106, 84, 72, 54
+};
+
+/* Linear approximation of the 2A03 mixer, per output level. The real
+   mixer is nonlinear across channels, but linear weights let every
+   channel emit its own steps independently */
+enum { CH_PULSE1, CH_PULSE2, CH_TRIANGLE, CH_NOISE, CH_DMC };
+static const float channel_weight[5] = { 0.00752f, 0.00752f, 0.00851f, 0.00494f, 0.00335f };
+
+#define PI 3.14159265358979323846
+
+/* band-limited impulse for every fractional sample phase. Read only once
+   built, so all instances share it */
+static float kernel[BLIP_PHASES][BLIP_KERNEL_WIDTH];
+static pthread_once_t kernel_once = PTHREAD_ONCE_INIT;
+
+static void build_kernel(void);
+static void blip_add(Blip*, uint64_t, float);
+static void blip_flush(APU*, uint64_t);
+
+static void run_channels(APU*, uint64_t, uint64_t);
+static void run_pulse(APU*, int, uint64_t, uint64_t);
+static void run_triangle(APU*, uint64_t, uint64_t);
+static void run_noise(APU*, uint64_t, uint64_t);
+static void run_dmc(APU*, uint64_t, uint64_t);
+static void dmc_fetch(APU*);
+static void clock_sequencer(APU*, uint8_t);
+static void reset_sequencer(APU*);
+static void clock_envelope(Envelope*);
+static void clock_sweep(Pulse*);
+static uint16_t sweep_target(const Pulse*);
+static bool pulse_muted(const Pulse*);
+static uint8_t envelope_volume(const Envelope*);
+static uint8_t pulse_output(const Pulse*);
+static uint8_t triangle_output(const Triangle*);
+static uint8_t noise_output(const Noise*);
+static void update_output(APU*, int, uint8_t, uint64_t);
+static void update_outputs(APU*, uint64_t);
+static const SeqStep* sequence(const APU*);
+
+APU make_apu(Memory* mem, unsigned sample_rate){
+    pthread_once(&kernel_once, build_kernel);
+
+    APU apu;
+    memset(&apu, 0, sizeof(APU));
+    apu.mem = mem;
+    apu.synth = true;
+    apu.pulse[0].ones_complement = true;
+    apu.noise.shift = 1;
+    apu.noise.period = noise_periods[0];
+    apu.dmc.period = dmc_periods[0];
+    apu.dmc.bits = 8;
+    apu.dmc.silence = true;
+    apu.cycles = 0;
+    apu.seq_start = 0;
+    apu.seq_reset = UINT64_MAX;
+    apu.blip.factor = (double) sample_rate / CPU_CLOCK_NTSC;
+    apu.blip.t0 = 0;
+    return apu;
+}
+
+static void build_kernel(void){
+    /* Blackman windowed sinc, cut off a bit under Nyquist, one row per
+       sub-sample phase and each row normalized to unit gain */
+    const double cutoff = 0.45;
+    for (int p = 0; p < BLIP_PHASES; ++p){
+        double sum = 0;
+        for (int k = 0; k < BLIP_KERNEL_WIDTH; ++k){
+            double x = k - BLIP_KERNEL_WIDTH / 2 + 1 - (double) p / BLIP_PHASES;
+            double w = (x + BLIP_KERNEL_WIDTH / 2) / BLIP_KERNEL_WIDTH;
+            double window = 0.42 - 0.5 * cos(2 * PI * w) + 0.08 * cos(4 * PI * w);
+            double sinc = x == 0 ? 2 * cutoff : sin(2 * PI * cutoff * x) / (PI * x);
+            kernel[p][k] = sinc * window;
+            sum += kernel[p][k];
+        }
+        for (int k = 0; k < BLIP_KERNEL_WIDTH; ++k)
+            kernel[p][k] /= sum;
+    }
+}
+
+static void blip_add(Blip* blip, uint64_t t, float delta){
+    /* spread a step of delta at CPU cycle t over the kernel. The buffer
+       holds differences, blip_flush integrates them back into levels */
+    double pos = (t - blip->t0) * blip->factor;
+    int i = (int) pos;
+    if (i < 0 || i + BLIP_KERNEL_WIDTH > BLIP_SIZE + BLIP_KERNEL_WIDTH)
+        return;
+    const float* k = kernel[(int)((pos - i) * BLIP_PHASES)];
+    float* out = blip->buf + i;
+    for (int j = 0; j < BLIP_KERNEL_WIDTH; ++j)
+        out[j] += delta * k[j];
+}
+
+static void blip_flush(APU* apu, uint64_t t){
+    /* turn everything before cycle t into samples */
+    Blip* blip = &apu->blip;
+    int n = (int)((t - blip->t0) * blip->factor);
+    if (n <= 0)
+        return;
+    if (n > BLIP_SIZE)
+        n = BLIP_SIZE;
+    if (apu->frame_done){
+        apu->nsamples = 0;
+        apu->frame_done = false;
+    }
+    for (int i = 0; i < n; ++i){
+        blip->integrator += blip->buf[i];
+        /* one pole high pass, the NES output is DC offset */
+        float out = blip->integrator - blip->hp_in + 0.999f * blip->hp_out;
+        blip->hp_in = blip->integrator;
+        blip->hp_out = out;
+        if (apu->nsamples < APU_SAMPLE_CAP){
+            float s = out * 32767.0f;
+            s = s > 32767.0f ? 32767.0f : (s < -32768.0f ? -32768.0f : s);
+            apu->samples[apu->nsamples++] = (int16_t) s;
+        }
+        else
+            apu->dropped++;
+    }
+    memmove(blip->buf, blip->buf + n, (BLIP_SIZE + BLIP_KERNEL_WIDTH - n) * sizeof(float));
+    memset(blip->buf + BLIP_SIZE + BLIP_KERNEL_WIDTH - n, 0, n * sizeof(float));
+    blip->t0 += n / blip->factor;
+}
+
+void apu_run(APU* apu, uint64_t until){
+    /* catch up to CPU cycle until, one frame sequencer step at a time */
+    while (apu->cycles < until){
+        uint64_t next = apu->seq_start + sequence(apu)[apu->step].cycle;
+        uint64_t reset = apu->seq_reset;
+        uint64_t end = next < until ? next : until;
+        end = reset < end ? reset : end;
+        run_channels(apu, apu->cycles, end);
+        apu->cycles = end;
+        if (end == next)
+            clock_sequencer(apu, sequence(apu)[apu->step].events);
+        if (end == reset)
+            reset_sequencer(apu);
+    }
+    /* keep the delta buffer from overflowing when frames are long or
+       the host steps without ending frames */
+    if (apu->synth && (apu->cycles - apu->blip.t0) * apu->blip.factor > BLIP_SIZE / 2)
+        blip_flush(apu, apu->cycles);
+}
+
+void apu_end_frame(APU* apu, uint64_t cycle){
+    /* samples stay readable until the next frame starts producing */
+    apu_run(apu, cycle);
+    if (apu->synth)
+        blip_flush(apu, cycle);
+    else {
+        apu->nsamples = 0;
+        apu->blip.t0 = cycle;
+    }
+    apu->frame_done = true;
+}
+
+bool apu_irq(const APU* apu){
+    return apu->frame_irq || apu->dmc_irq;
+}
+
+uint64_t apu_next_frame_irq(const APU* apu){
+    /* CPU cycle the frame IRQ flag will next be raised, UINT64_MAX if it
+       can't be without another register write */
+    if (apu->irq_inhibit)
+        return UINT64_MAX;
+    uint64_t irq = UINT64_MAX;
+    if (!apu->five_step){
+        uint64_t start = apu->seq_start;
+        if (apu->step > 3) /* past the IRQ, only the wrap is left */
+            start += four_step[4].cycle;
+        irq = start + four_step[3].cycle;
+    }
+    /* a pending restart cuts the current sequence short */
+    if (apu->seq_reset == UINT64_MAX || irq <= apu->seq_reset)
+        return irq;
+    return apu->seq_reset_five_step ? UINT64_MAX : apu->seq_reset + four_step[3].cycle;
+}
+
+uint64_t apu_next_dmc_fetch(const APU* apu){
+    /* CPU cycle of the next sample fetch (where the DMC IRQ is raised), the
+       buffer is refilled when the shift register takes its byte */
+    const DMC* d = &apu->dmc;
+    if (!d->buffer_full || d->remaining == 0)
+        return UINT64_MAX;
+    return apu->cycles + d->timer + (uint64_t)(d->bits - 1) * d->period;
+}
+
+uint32_t apu_take_stall(APU* apu){
+    /* CPU cycles the DMC's fetches have taken since the last call */
+    uint32_t stall = apu->dmc.stall;
+    apu->dmc.stall = 0;
+    return stall;
+}
+
+static const SeqStep* sequence(const APU* apu){
+    return apu->five_step ? five_step : four_step;
+}
+
+static void run_channels(APU* apu, uint64_t from, uint64_t to){
+    if (apu->synth){
+        run_pulse(apu, 0, from, to);
+        run_pulse(apu, 1, from, to);
+        run_triangle(apu, from, to);
+        run_noise(apu, from, to);
+    }
+    run_dmc(apu, from, to);
+}
+
+static void run_pulse(APU* apu, int ch, uint64_t t, uint64_t end){
+    Pulse* p = &apu->pulse[ch];
+    uint32_t period = (p->period + 1) * 2;
+    while (t + p->timer <= end){
+        t += p->timer;
+        p->timer = period;
+        p->duty_pos = (p->duty_pos + 1) & 7;
+        update_output(apu, CH_PULSE1 + ch, pulse_output(p), t);
+    }
+    p->timer -= end - t;
+}
+
+static void run_triangle(APU* apu, uint64_t t, uint64_t end){
+    Triangle* tri = &apu->triangle;
+    uint32_t period = tri->period + 1;
+    /* ultrasonic periods just pop on real hardware, hold the level instead */
+    bool stepping = tri->length > 0 && tri->linear > 0 && tri->period >= 2;
+    if (!stepping){
+        /* nothing to output, just keep the timer's phase */
+        if (t + tri->timer <= end)
+            tri->timer = period - (end - t - tri->timer) % period;
+        else
+            tri->timer -= end - t;
+        return;
+    }
+    while (t + tri->timer <= end){
+        t += tri->timer;
+        tri->timer = period;
+        tri->step = (tri->step + 1) & 31;
+        update_output(apu, CH_TRIANGLE, triangle_output(tri), t);
+    }
+    tri->timer -= end - t;
+}
+
+static void run_noise(APU* apu, uint64_t t, uint64_t end){
+    Noise* n = &apu->noise;
+    while (t + n->timer <= end){
+        t += n->timer;
+        n->timer = n->period;
+        uint16_t feedback = (n->shift ^ (n->shift >> (n->mode ? 6 : 1))) & 1;
+        n->shift = (n->shift >> 1) | (feedback << 14);
+        update_output(apu, CH_NOISE, noise_output(n), t);
+    }
+    n->timer -= end - t;
+}
+
+static void run_dmc(APU* apu, uint64_t t, uint64_t end){
+    DMC* d = &apu->dmc;
+    while (t + d->timer <= end){
+        t += d->timer;
+        d->timer = d->period;
+        if (!d->silence){
+            if (d->shift & 1){
+                if (d->level <= 125) d->level += 2;
+            }
+            else if (d->level >= 2)
+                d->level -= 2;
+            if (apu->synth)
+                update_output(apu, CH_DMC, d->level, t);
+        }
+        d->shift >>= 1;
+        if (--d->bits == 0){
+            d->bits = 8;
+            d->silence = !d->buffer_full;
+            if (d->buffer_full){
+                d->shift = d->buffer;
+                d->buffer_full = false;
+                dmc_fetch(apu);
+            }
+        }
+    }
+    d->timer -= end - t;
+}
+
+static void dmc_fetch(APU* apu){
+    /* the memory reader refills the sample buffer as soon as it empties,
+       halting the CPU while it does */
+    DMC* d = &apu->dmc;
+    if (d->buffer_full || d->remaining == 0)
+        return;
+    CDL_MARK(apu->mem->cdl, d->addr, CDL_PCM);
+    d->buffer = *(apu->mem->map[d->addr]);
+    d->buffer_full = true;
+    d->stall += DMC_STALL;
+    d->addr = d->addr == 0xFFFF ? 0x8000 : d->addr + 1;
+    if (--d->remaining == 0){
+        if (d->loop){
+            d->addr = d->sample_addr;
+            d->remaining = d->sample_len;
+        }
+        else if (d->irq_enable)
+            apu->dmc_irq = true;
+    }
+}
+
+static void clock_sequencer(APU* apu, uint8_t events){
+    if (events & QUARTER){
+        if (apu->synth){
+            clock_envelope(&apu->pulse[0].env);
+            clock_envelope(&apu->pulse[1].env);
+            clock_envelope(&apu->noise.env);
+            Triangle* tri = &apu->triangle;
+            if (tri->linear_reload)
+                tri->linear = tri->linear_reload_val;
+            else if (tri->linear > 0)
+                tri->linear--;
+            if (!tri->control)
+                tri->linear_reload = false;
+        }
+    }
+    if (events & HALF){
+        /* length counters are visible through $4015 so they always run */
+        if (!apu->pulse[0].env.loop && apu->pulse[0].length > 0) apu->pulse[0].length--;
+        if (!apu->pulse[1].env.loop && apu->pulse[1].length > 0) apu->pulse[1].length--;
+        if (!apu->triangle.control && apu->triangle.length > 0) apu->triangle.length--;
+        if (!apu->noise.env.loop && apu->noise.length > 0) apu->noise.length--;
+        if (apu->synth){
+            clock_sweep(&apu->pulse[0]);
+            clock_sweep(&apu->pulse[1]);
+        }
+    }
+    if ((events & FRAME_IRQ) && !apu->irq_inhibit)
+        apu->frame_irq = true;
+    if (events & WRAP){
+        apu->seq_start += sequence(apu)[apu->step].cycle;
+        apu->step = 0;
+    }
+    else
+        apu->step++;
+    if (apu->synth && (events & (QUARTER | HALF)))
+        update_outputs(apu, apu->cycles);
+}
+
+static void reset_sequencer(APU* apu){
+    /* a $4017 write landing. The 5-step mode clocks its first step at once */
+    apu->five_step = apu->seq_reset_five_step;
+    apu->seq_start = apu->seq_reset;
+    apu->seq_reset = UINT64_MAX;
+    apu->step = 0;
+    if (apu->five_step)
+        clock_sequencer(apu, QUARTER | HALF);
+    apu->step = 0;
+}
+
+static void clock_envelope(Envelope* env){
+    if (env->start){
+        env->start = false;
+        env->decay = 15;
+        env->divider = env->period;
+    }
+    else if (env->divider == 0){
+        env->divider = env->period;
+        if (env->decay > 0)
+            env->decay--;
+        else if (env->loop)
+            env->decay = 15;
+    }
+    else
+        env->divider--;
+}
+
+static uint16_t sweep_target(const Pulse* p){
+    uint16_t change = p->period >> p->sweep_shift;
+    if (!p->sweep_negate)
+        return p->period + change;
+    /* pulse 1 subtracts change + 1 */
+    change += p->ones_complement;
+    return change > p->period ? 0 : p->period - change;
+}
+
+static bool pulse_muted(const Pulse* p){
+    return p->period < 8 || sweep_target(p) > 0x7FF;
+}
+
+static void clock_sweep(Pulse* p){
+    if (p->sweep_divider == 0 && p->sweep_enabled && p->sweep_shift > 0 && !pulse_muted(p))
+        p->period = sweep_target(p);
+    if (p->sweep_divider == 0 || p->sweep_reload){
+        p->sweep_divider = p->sweep_period;
+        p->sweep_reload = false;
+    }
+    else
+        p->sweep_divider--;
+}
+
+static uint8_t envelope_volume(const Envelope* env){
+    return env->constant ? env->period : env->decay;
+}
+
+static uint8_t pulse_output(const Pulse* p){
+    if (p->length == 0 || pulse_muted(p) || !duty_table[p->duty][p->duty_pos])
+        return 0;
+    return envelope_volume(&p->env);
+}
+
+static uint8_t triangle_output(const Triangle* tri){
+    return triangle_table[tri->step];
+}
+
+static uint8_t noise_output(const Noise* n){
+    if (n->length == 0 || (n->shift & 1))
+        return 0;
+    return envelope_volume(&n->env);
+}
+
+static void update_output(APU* apu, int ch, uint8_t level, uint64_t t){
+    float amp = level * channel_weight[ch];
+    if (amp != apu->amp[ch]){
+        blip_add(&apu->blip, t, amp - apu->amp[ch]);
+        apu->amp[ch] = amp;
+    }
+}
+
+static void update_outputs(APU* apu, uint64_t t){
+    update_output(apu, CH_PULSE1, pulse_output(&apu->pulse[0]), t);
+    update_output(apu, CH_PULSE2, pulse_output(&apu->pulse[1]), t);
+    update_output(apu, CH_TRIANGLE, triangle_output(&apu->triangle), t);
+    update_output(apu, CH_NOISE, noise_output(&apu->noise), t);
+    update_output(apu, CH_DMC, apu->dmc.level, t);
+}
+
+void apu_write(APU* apu, uint16_t addr, uint8_t val, uint64_t cycle){
+    apu_run(apu, cycle);
+
+    Pulse* p = &apu->pulse[(addr >> 2) & 1];
+    switch (addr){
+        case 0x4000: case 0x4004:
+            p->duty = val >> 6;
+            p->env.loop = val & 0x20;
+            p->env.constant = val & 0x10;
+            p->env.period = val & 0x0F;
+            break;
+        case 0x4001: case 0x4005:
+            p->sweep_enabled = val & 0x80;
+            p->sweep_period = (val >> 4) & 7;
+            p->sweep_negate = val & 0x08;
+            p->sweep_shift = val & 7;
+            p->sweep_reload = true;
+            break;
+        case 0x4002: case 0x4006:
+            p->period = (p->period & 0x700) | val;
+            break;
+        case 0x4003: case 0x4007:
+            p->period = (p->period & 0xFF) | ((val & 7) << 8);
+            if (apu->enabled & (1 << ((addr >> 2) & 1)))
+                p->length = length_table[val >> 3];
+            p->env.start = true;
+            p->duty_pos = 0;
+            break;
+        case 0x4008:
+            apu->triangle.control = val & 0x80;
+            apu->triangle.linear_reload_val = val & 0x7F;
+            break;
+        case 0x400A:
+            apu->triangle.period = (apu->triangle.period & 0x700) | val;
+            break;
+        case 0x400B:
+            apu->triangle.period = (apu->triangle.period & 0xFF) | ((val & 7) << 8);
+            if (apu->enabled & 0x04)
+                apu->triangle.length = length_table[val >> 3];
+            apu->triangle.linear_reload = true;
+            break;
+        case 0x400C:
+            apu->noise.env.loop = val & 0x20;
+            apu->noise.env.constant = val & 0x10;
+            apu->noise.env.period = val & 0x0F;
+            break;
+        case 0x400E:
+            apu->noise.mode = val & 0x80;
+            apu->noise.period = noise_periods[val & 0x0F];
+            break;
+        case 0x400F:
+            if (apu->enabled & 0x08)
+                apu->noise.length = length_table[val >> 3];
+            apu->noise.env.start = true;
+            break;
+        case 0x4010:
+            apu->dmc.irq_enable = val & 0x80;
+            apu->dmc.loop = val & 0x40;
+            apu->dmc.period = dmc_periods[val & 0x0F];
+            if (!apu->dmc.irq_enable)
+                apu->dmc_irq = false;
+            break;
+        case 0x4011:
+            apu->dmc.level = val & 0x7F;
+            break;
+        case 0x4012:
+            apu->dmc.sample_addr = 0xC000 | (val << 6);
+            break;
+        case 0x4013:
+            apu->dmc.sample_len = (val << 4) | 1;
+            break;
+        case 0x4015:
+            apu->enabled = val;
+            if (!(val & 0x01)) apu->pulse[0].length = 0;
+            if (!(val & 0x02)) apu->pulse[1].length = 0;
+            if (!(val & 0x04)) apu->triangle.length = 0;
+            if (!(val & 0x08)) apu->noise.length = 0;
+            if (!(val & 0x10))
+                apu->dmc.remaining = 0;
+            else if (apu->dmc.remaining == 0){
+                apu->dmc.addr = apu->dmc.sample_addr;
+                apu->dmc.remaining = apu->dmc.sample_len;
+                dmc_fetch(apu);
+            }
+            apu->dmc_irq = false;
+            break;
+        case 0x4017:
+            /* the inhibit flag acts at once, the sequence restarts 3 CPU
+               cycles after a write on an APU cycle (even) and 4 after one
+               between them. Until then the old sequence runs on */
+            apu->irq_inhibit = val & 0x40;
+            if (apu->irq_inhibit)
+                apu->frame_irq = false;
+            apu->seq_reset = cycle + (cycle & 1 ? 4 : 3);
+            apu->seq_reset_five_step = val & 0x80;
+            break;
+        default: ;
+    }
+    if (apu->synth)
+        update_outputs(apu, cycle);
+}
+
+uint8_t apu_read_status(APU* apu, uint64_t cycle){
+    apu_run(apu, cycle);
+    uint8_t status = (apu->pulse[0].length > 0)
+                   | (apu->pulse[1].length > 0) << 1
+                   | (apu->triangle.length > 0) << 2
+                   | (apu->noise.length > 0) << 3
+                   | (apu->dmc.remaining > 0) << 4
+                   | apu->frame_irq << 6
+                   | apu->dmc_irq << 7;
+    apu->frame_irq = false;
+    return status;
+}
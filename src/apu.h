@@ -0,0 +1,134 @@
+#ifndef APU_H
+#define APU_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "mem.h"
+
+#define CPU_CLOCK_NTSC 1789773
+#define APU_SAMPLE_RATE 44100
+#define APU_SAMPLE_CAP 4096 /* samples held between frames, a frame is ~735 */
+
+/* band-limited step synthesis buffer (see apu.c) */
+#define BLIP_KERNEL_WIDTH 16
+#define BLIP_PHASES 32
+#define BLIP_SIZE 4096
+
+typedef struct Envelope{
+    bool start;
+    bool loop; /* doubles as the length counter halt flag */
+    bool constant;
+    uint8_t period; /* also the constant volume */
+    uint8_t divider;
+    uint8_t decay;
+} Envelope;
+
+typedef struct Pulse{
+    uint8_t duty;
+    uint8_t duty_pos;
+    uint16_t period; /* 11-bit timer reload */
+    uint32_t timer; /* CPU cycles until the next sequencer step */
+    uint8_t length;
+    Envelope env;
+    bool sweep_enabled;
+    bool sweep_negate;
+    bool sweep_reload;
+    uint8_t sweep_period;
+    uint8_t sweep_shift;
+    uint8_t sweep_divider;
+    bool ones_complement; /* pulse 1 negates with ones' complement */
+} Pulse;
+
+typedef struct Triangle{
+    bool control; /* length counter halt + linear counter control */
+    bool linear_reload;
+    uint8_t linear_reload_val;
+    uint8_t linear;
+    uint16_t period;
+    uint32_t timer;
+    uint8_t step;
+    uint8_t length;
+} Triangle;
+
+typedef struct Noise{
+    bool mode;
+    uint16_t period; /* in CPU cycles */
+    uint32_t timer;
+    uint16_t shift; /* 15-bit LFSR */
+    uint8_t length;
+    Envelope env;
+} Noise;
+
+typedef struct DMC{
+    bool irq_enable;
+    bool loop;
+    uint16_t period; /* in CPU cycles */
+    uint32_t timer;
+    uint8_t level; /* 7-bit output */
+    uint16_t sample_addr;
+    uint16_t sample_len;
+    uint16_t addr;
+    uint16_t remaining; /* bytes left to fetch */
+    uint8_t buffer;
+    bool buffer_full;
+    uint8_t shift;
+    uint8_t bits;
+    bool silence;
+    uint32_t stall; /* CPU cycles taken by fetches, for the CPU to add */
+} DMC;
+
+typedef struct Blip{
+    double factor; /* output samples per CPU cycle */
+    double t0; /* CPU cycle of buf[0] */
+    float buf[BLIP_SIZE + BLIP_KERNEL_WIDTH];
+    float integrator;
+    float hp_in, hp_out; /* DC blocking filter state */
+} Blip;
+
+typedef struct APU{
+    Pulse pulse[2];
+    Triangle triangle;
+    Noise noise;
+    DMC dmc;
+
+    /* frame sequencer */
+    bool five_step;
+    bool irq_inhibit;
+    bool frame_irq;
+    bool dmc_irq;
+    uint8_t enabled; /* $4015 channel enable bits */
+    uint8_t step; /* index into the current mode's step table */
+    uint64_t seq_start; /* CPU cycle the current sequence started */
+    uint64_t seq_reset; /* CPU cycle a $4017 write restarts it, UINT64_MAX when none is due */
+    bool seq_reset_five_step; /* the mode it restarts in */
+
+    uint64_t cycles; /* CPU cycle the APU has caught up to */
+
+    /* false: "audio off", only length counters, the frame sequencer and
+       the DMC (whose IRQ and $4015 bit are visible to the CPU) are run */
+    bool synth;
+    Blip blip;
+    float amp[5]; /* last amplitude emitted per channel */
+
+    /* samples produced at the last frame end */
+    int16_t samples[APU_SAMPLE_CAP];
+    uint32_t nsamples;
+    bool frame_done; /* samples belong to a finished frame, clear before adding */
+    uint64_t dropped; /* samples lost because samples was full */
+
+    Memory* mem; /* DMC sample fetches */
+
+} APU;
+
+APU make_apu(Memory*, unsigned);
+void apu_run(APU*, uint64_t);
+void apu_write(APU*, uint16_t, uint8_t, uint64_t);
+uint8_t apu_read_status(APU*, uint64_t);
+void apu_end_frame(APU*, uint64_t);
+bool apu_irq(const APU*);
+uint64_t apu_next_frame_irq(const APU*);
+uint64_t apu_next_dmc_fetch(const APU*);
+uint32_t apu_take_stall(APU*);
+
+#endif
@@ -0,0 +1,240 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "batch.h"
+#include "util.h"
+
+/* Each worker owns a contiguous slice of the instances. The owner takes from
+   the head, idle workers steal from the tail of someone else's slice. Head and
+   tail are packed into one word so both ends are claimed with a single CAS */
+typedef struct WorkQueue{
+    _Alignas(CACHE_LINE) _Atomic uint64_t span; /* head low 32 bits, tail high 32 bits */
+} WorkQueue;
+
+typedef struct BatchJob{
+    void (*fn)(void*, size_t);
+    void* ctx;
+} BatchJob;
+
+typedef struct StepJob{
+    NES** instances;
+    const uint8_t* inputs;
+    unsigned n_frames;
+    uint8_t* ram_out;
+    uint8_t* frame_out;
+} StepJob;
+
+typedef struct Worker{
+    BatchPool* pool;
+    int id;
+} Worker;
+
+struct BatchPool{
+    int nworkers; /* worker 0 is the thread calling nes_batch_step */
+    pthread_t* threads;
+    Worker* workers;
+    WorkQueue* queues;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t idle;
+    uint64_t generation; /* bumped once per job */
+    int busy; /* helper threads still working on the current job */
+    bool quit;
+
+    BatchJob job;
+};
+
+static void* worker_main(void*);
+static void run_queues(BatchPool*, int);
+static bool take_head(WorkQueue*, uint32_t*);
+static bool take_tail(WorkQueue*, uint32_t*);
+static void step_instance(void*, size_t);
+
+static uint64_t pack(uint32_t head, uint32_t tail){
+    return ((uint64_t) tail << 32) | head;
+}
+
+BatchPool* batch_pool_create(int nworkers){
+    if (nworkers <= 0)
+        nworkers = sysconf(_SC_NPROCESSORS_ONLN);
+    if (nworkers <= 0)
+        nworkers = 1;
+
+    BatchPool* pool = xalloc(1, sizeof(BatchPool), calloc);
+    pool->nworkers = nworkers;
+    pool->threads = xalloc(nworkers, sizeof(pthread_t), calloc);
+    pool->workers = xalloc(nworkers, sizeof(Worker), calloc);
+    pool->queues = aligned_alloc(CACHE_LINE, nworkers * sizeof(WorkQueue));
+    if (pool->queues == NULL)
+        err_exit("Batch: Failed to allocate %d work queues", nworkers);
+    for (int i = 0; i < nworkers; ++i)
+        atomic_init(&pool->queues[i].span, 0);
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    pthread_cond_init(&pool->idle, NULL);
+
+    for (int i = 0; i < nworkers; ++i){
+        pool->workers[i].pool = pool;
+        pool->workers[i].id = i;
+    }
+    for (int i = 1; i < nworkers; ++i){
+        if (pthread_create(&pool->threads[i], NULL, worker_main, &pool->workers[i]) != 0)
+            err_exit("Batch: Couldn't start worker thread %d", i);
+    }
+    return pool;
+}
+
+void batch_pool_destroy(BatchPool* pool){
+    pthread_mutex_lock(&pool->lock);
+    pool->quit = true;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+    for (int i = 1; i < pool->nworkers; ++i)
+        pthread_join(pool->threads[i], NULL);
+
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->wake);
+    pthread_cond_destroy(&pool->idle);
+    free(pool->queues);
+    free(pool->workers);
+    free(pool->threads);
+    free(pool);
+}
+
+void batch_pool_run(BatchPool* pool, size_t n, void (*fn)(void*, size_t), void* ctx){
+    if (n > UINT32_MAX)
+        err_exit("Batch: %lu jobs is more than a batch can index", n);
+
+    BatchJob job = { fn, ctx };
+    int nworkers = pool->nworkers;
+    for (int i = 0; i < nworkers; ++i){
+        uint32_t head = n * i / nworkers;
+        uint32_t tail = n * (i + 1) / nworkers;
+        atomic_store(&pool->queues[i].span, pack(head, tail));
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->job = job;
+    pool->busy = nworkers - 1;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    run_queues(pool, 0);
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->busy > 0)
+        pthread_cond_wait(&pool->idle, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void nes_batch_step(BatchPool* pool, NES** instances, const uint8_t* inputs, size_t n,
+                    unsigned n_frames, uint8_t* ram_out, uint8_t* frame_out){
+    StepJob job = { instances, inputs, n_frames, ram_out, frame_out };
+    batch_pool_run(pool, n, step_instance, &job);
+}
+
+static void* worker_main(void* arg){
+    Worker* worker = arg;
+    BatchPool* pool = worker->pool;
+    uint64_t seen = 0;
+
+    for (;;){
+        pthread_mutex_lock(&pool->lock);
+        while (pool->generation == seen && !pool->quit)
+            pthread_cond_wait(&pool->wake, &pool->lock);
+        if (pool->quit){
+            pthread_mutex_unlock(&pool->lock);
+            return NULL;
+        }
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        run_queues(pool, worker->id);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->busy == 0)
+            pthread_cond_signal(&pool->idle);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+static void run_queues(BatchPool* pool, int id){
+    /* drain our own slice, then steal until every slice is empty. No work is
+       added mid-job, so one empty pass over the victims means we're done */
+    const BatchJob* job = &pool->job;
+    uint32_t idx;
+    while (take_head(&pool->queues[id], &idx))
+        job->fn(job->ctx, idx);
+    for (int k = 1; k < pool->nworkers; ++k){
+        WorkQueue* victim = &pool->queues[(id + k) % pool->nworkers];
+        while (take_tail(victim, &idx))
+            job->fn(job->ctx, idx);
+    }
+}
+
+static bool take_head(WorkQueue* q, uint32_t* idx){
+    uint64_t span = atomic_load(&q->span);
+    for (;;){
+        uint32_t head = span, tail = span >> 32;
+        if (head >= tail)
+            return false;
+        if (atomic_compare_exchange_weak(&q->span, &span, pack(head + 1, tail))){
+            *idx = head;
+            return true;
+        }
+    }
+}
+
+static bool take_tail(WorkQueue* q, uint32_t* idx){
+    uint64_t span = atomic_load(&q->span);
+    for (;;){
+        uint32_t head = span, tail = span >> 32;
+        if (head >= tail)
+            return false;
+        if (atomic_compare_exchange_weak(&q->span, &span, pack(head, tail - 1))){
+            *idx = tail - 1;
+            return true;
+        }
+    }
+}
+
+static void step_instance(void* ctx, size_t i){
+    const StepJob* job = ctx;
+    NES* nes = job->instances[i];
+    if (job->inputs != NULL)
+        memcpy(nes->input, job->inputs + (size_t) i * CONTROLLER_PORTS, CONTROLLER_PORTS);
+
+    uint8_t* slot = job->frame_out != NULL ? job->frame_out + (size_t) i * FRAME_SIZE : NULL;
+    /* a frame that's asked for has to be drawn, and be the one just run */
+    if (slot != NULL && (nes->renderer == NULL || nes->renderer->threaded))
+        set_render_mode(nes, RENDER_INLINE);
+    for (unsigned f = 0; f < job->n_frames; ++f){
+        if (slot == NULL || f != job->n_frames - 1){
+            run_frame(nes);
+            continue;
+        }
+        /* only the last frame is observed, render it in place. With
+           video_out attached the frame end publishes the buffer and moves
+           on to the next, so it's drawn there and copied out instead */
+        uint8_t* own = nes->ppu.framebuffer;
+        if (nes->video_out == NULL)
+            nes->ppu.framebuffer = slot;
+        run_frame(nes);
+        if (nes->video_out == NULL)
+            nes->ppu.framebuffer = own;
+        else
+            memcpy(slot, own, FRAME_SIZE);
+    }
+
+    if (job->ram_out != NULL)
+        memcpy(job->ram_out + (size_t) i * RAM_SIZE, nes_ram(nes), RAM_SIZE);
+}
@@ -0,0 +1,25 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "nes.h"
+
+typedef struct BatchPool BatchPool;
+
+BatchPool* batch_pool_create(int); /* worker count, <= 0 for one per online core */
+void batch_pool_destroy(BatchPool*);
+
+/* Call fn(ctx, i) for every i in [0, n) across the pool, returns when all are done */
+void batch_pool_run(BatchPool*, size_t, void (*)(void*, size_t), void*);
+
+/* Step n independent instances n_frames frames each across the pool.
+   inputs: CONTROLLER_PORTS bytes per instance, applied before stepping (may be NULL)
+   ram_out: n * RAM_SIZE bytes, final RAM of each instance (may be NULL)
+   frame_out: n * FRAME_SIZE bytes, the last frame is rendered straight into
+   the instance's slot (may be NULL). Instances that don't render inline are
+   switched to RENDER_INLINE and stay that way */
+void nes_batch_step(BatchPool*, NES**, const uint8_t*, size_t, unsigned, uint8_t*, uint8_t*);
+
+#endif
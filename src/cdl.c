@@ -0,0 +1,99 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "cdl.h"
+#include "util.h"
+
+/* FCEUX .cdl bits, one byte per PRG ROM byte followed by one per CHR ROM byte */
+#define FCEUX_CODE 0x01
+#define FCEUX_DATA 0x02
+#define FCEUX_BANK_SHIFT 2 /* bits 2-3: which 8K of $8000-$FFFF the byte was seen at */
+#define FCEUX_PCM 0x40
+#define FCEUX_RENDERED 0x01
+#define FCEUX_READ 0x02
+
+#define PATTERN_SIZE 0x2000
+#define HEATMAP_COLUMNS 64 /* characters per page, 4 bytes each */
+
+static void heatmap_bus(FILE*, const char*, const uint8_t*, const uint8_t*, int);
+static char heat(const uint8_t*, const uint8_t*, int, int);
+
+void cdl_write(const AccessMap* log, const Memory* mem, const PPUMemory* ppumem, const char* filename){
+    /* PRG offsets come from where $8000-$FFFF point into the ROM, so
+       mirrored banks fold onto the bytes behind them */
+    FILE* f = fopen(filename, "wb");
+    if (f == NULL)
+        err_exit("CDL: Couldn't open %s for writing", filename);
+    uint8_t* prg = xalloc(mem->prg_size, sizeof(uint8_t), calloc);
+    for (int addr = 0x8000; addr < CPU_MEM_SIZE; ++addr){
+        uint8_t bits = log->cpu[addr], out = 0;
+        if (bits & (CDL_EXEC | CDL_OPERAND)) out |= FCEUX_CODE;
+        if (bits & CDL_READ) out |= FCEUX_DATA;
+        if (bits & CDL_PCM) out |= FCEUX_PCM | FCEUX_DATA;
+        if (out == 0)
+            continue;
+        out |= ((addr >> 13) & 3) << FCEUX_BANK_SHIFT;
+        prg[(mem->map[addr] - mem->map[0x8000]) % mem->prg_size] |= out;
+    }
+    if (fwrite(prg, 1, mem->prg_size, f) != mem->prg_size)
+        err_exit("CDL: Short write to %s", filename);
+    free(prg);
+    /* FCEUX leaves CHR RAM out */
+    if (!ppumem->chr_ram){
+        uint8_t chr[PATTERN_SIZE] = {0};
+        for (int addr = 0; addr < PATTERN_SIZE; ++addr){
+            uint8_t bits = log->ppu[addr] | log->drawn[addr];
+            chr[addr] = (bits & CDL_TILE ? FCEUX_RENDERED : 0) | (bits & CDL_READ ? FCEUX_READ : 0);
+        }
+        if (fwrite(chr, 1, PATTERN_SIZE, f) != PATTERN_SIZE)
+            err_exit("CDL: Short write to %s", filename);
+    }
+    fclose(f);
+}
+
+void heatmap_write(const AccessMap* log, const char* filename){
+    /* a line per touched 256 byte page: byte counts per kind of access,
+       then one character per 4 bytes, the hottest kind found there */
+    FILE* f = fopen(filename, "w");
+    if (f == NULL)
+        err_exit("CDL: Couldn't open %s for writing", filename);
+    fprintf(f, "X executed  o operand  W written  R read  T drawn  P DMC sample  . untouched\n");
+    heatmap_bus(f, "CPU", log->cpu, NULL, CPU_MEM_SIZE);
+    heatmap_bus(f, "PPU", log->ppu, log->drawn, PPU_MEM_SIZE);
+    fclose(f);
+}
+
+static void heatmap_bus(FILE* f, const char* name, const uint8_t* a, const uint8_t* b, int size){
+    /* b, when there is one, is ORed into a */
+    fprintf(f, "\n%s bus     exec  oper  read write  draw   pcm\n", name);
+    for (int page = 0; page < size; page += 0x100){
+        int counts[6] = {0};
+        for (int i = page; i < page + 0x100; ++i){
+            uint8_t bits = a[i] | (b != NULL ? b[i] : 0);
+            for (int k = 0; k < 6; ++k)
+                counts[k] += (bits >> k) & 1;
+        }
+        if (counts[0] + counts[1] + counts[2] + counts[3] + counts[4] + counts[5] == 0)
+            continue;
+        char row[HEATMAP_COLUMNS + 1];
+        for (int c = 0; c < HEATMAP_COLUMNS; ++c)
+            row[c] = heat(a, b, page + c * 4, 4);
+        row[HEATMAP_COLUMNS] = '\0';
+        fprintf(f, "$%04X   %5d %5d %5d %5d %5d %5d  %s\n", page, counts[0], counts[1], counts[2],
+                counts[3], counts[4], counts[5], row);
+    }
+}
+
+static char heat(const uint8_t* a, const uint8_t* b, int start, int n){
+    uint8_t bits = 0;
+    for (int i = start; i < start + n; ++i)
+        bits |= a[i] | (b != NULL ? b[i] : 0);
+    if (bits & CDL_EXEC) return 'X';
+    if (bits & CDL_OPERAND) return 'o';
+    if (bits & CDL_WRITE) return 'W';
+    if (bits & CDL_READ) return 'R';
+    if (bits & CDL_TILE) return 'T';
+    if (bits & CDL_PCM) return 'P';
+    return '.';
+}
@@ -0,0 +1,21 @@
+#ifndef CDL_H
+#define CDL_H
+
+#include <stdint.h>
+
+#include "mem.h"
+
+/* Code/data logger: which addresses on the CPU and PPU buses were run,
+   read, written or drawn, as CDL_* bits ORed in by the bus accessors
+   (mem.h). Only allocated and filled when built with -DCDL */
+
+typedef struct AccessMap{
+    uint8_t cpu[CPU_MEM_SIZE];
+    uint8_t ppu[PPU_MEM_SIZE]; /* $2007 accesses, from the emulation thread */
+    uint8_t drawn[PPU_MEM_SIZE]; /* the renderer's PPU, which can be on its own thread */
+} AccessMap;
+
+void cdl_write(const AccessMap*, const Memory*, const PPUMemory*, const char*);
+void heatmap_write(const AccessMap*, const char*);
+
+#endif
@@ -5,260 +5,322 @@
 
 #include "cpu.h"
 #include "mem.h"
+#include "opcodes.h"
 #include "util.h"
 
-static uint8_t memread(CPU*, uint16_t);
-static void memwrite(CPU*, uint16_t, uint8_t);
-
-static void stack_push(CPU*, uint8_t);
-static uint8_t stack_pull(CPU*);
+/* the dispatch switch in FDE is one huge function, GCC won't inline the
+   per-opcode code into it on its own */
+#define FORCE_INLINE inline __attribute__((always_inline))
+
+static FORCE_INLINE uint8_t memread(CPU*, uint16_t);
+static FORCE_INLINE uint8_t bus_read(CPU*, uint16_t);
+static uint8_t hooked_read(CPU*, uint16_t, bool);
+static bool hooked_fetch(CPU*, uint8_t*);
+static FORCE_INLINE void memwrite(CPU*, uint16_t, uint8_t);
+static FORCE_INLINE uint8_t read_direct(CPU*, uint16_t);
+static FORCE_INLINE void write_direct(CPU*, uint16_t, uint8_t);
+static FORCE_INLINE uint8_t read_ram(CPU*, uint16_t);
+static FORCE_INLINE void write_ram(CPU*, uint16_t, uint8_t);
+
+/* handlers are written once and specialised per addressing mode by the
+   bus access they're given, see READ_ and WRITE_ below */
+typedef uint8_t (*ReadFn)(CPU*, uint16_t);
+typedef void (*WriteFn)(CPU*, uint16_t, uint8_t);
+
+static FORCE_INLINE void stack_push(CPU*, uint8_t);
+static FORCE_INLINE uint8_t stack_pull(CPU*);
+static void enter_interrupt(CPU*, uint16_t, bool);
+static void poll_irq(CPU*, uint8_t);
 
 typedef enum flags{C = 0, I = 2, D = 3, V = 6} flags; 
-static void set_flag(flags, CPU*, bool);
-static void update_Z(CPU*, uint8_t);
-static void update_N(CPU*, int8_t);
-
-static void check_pagecross(CPU*, uint16_t, uint16_t);
-
-static void branch(bool, CPU*, uint16_t);
-static void compare(CPU*, uint8_t, uint16_t);
-static void load(CPU*, uint8_t*, uint16_t);
-static void xbc(CPU*, uint16_t, bool);
-
-static void STA(CPU*, uint16_t);
-static void STX(CPU*, uint16_t);
-static void STY(CPU*, uint16_t);
-static void LDA(CPU*, uint16_t);
-static void LDX(CPU*, uint16_t);
-static void LDY(CPU*, uint16_t);
-static void CPX(CPU*, uint16_t);
-static void CPY(CPU*, uint16_t);
-static void CMP(CPU*, uint16_t);
-static void TAX(CPU*, uint16_t);
-static void TAY(CPU*, uint16_t);
-static void TSX(CPU*, uint16_t);
-static void TXA(CPU*, uint16_t);
-static void TXS(CPU*, uint16_t);
-static void TYA(CPU*, uint16_t);
-static void DEC(CPU*, uint16_t);
-static void INC(CPU*, uint16_t);
-static void INX(CPU*, uint16_t);
-static void INY(CPU*, uint16_t);
-static void DEX(CPU*, uint16_t);
-static void BRK(CPU*, uint16_t);
-static void BPL(CPU*, uint16_t);
-static void BIT(CPU*, uint16_t);
-static void BMI(CPU*, uint16_t);
-static void BCC(CPU*, uint16_t);
-static void BCS(CPU*, uint16_t);
-static void BVC(CPU*, uint16_t);
-static void BVS(CPU*, uint16_t);
-static void BEQ(CPU*, uint16_t);
-static void BNE(CPU*, uint16_t);
-static void ORA(CPU*, uint16_t);
-static void DEY(CPU*, uint16_t);
-static void PLA(CPU*, uint16_t);
-static void PHA(CPU*, uint16_t);
-static void PHP(CPU*, uint16_t);
-static void PLP(CPU*, uint16_t);
-static void CLC(CPU*, uint16_t);
-static void CLD(CPU*, uint16_t);
-static void CLI(CPU*, uint16_t);
-static void CLV(CPU*, uint16_t);
-static void JMP(CPU*, uint16_t);
-static void JSR(CPU*, uint16_t);
-static void RTS(CPU*, uint16_t);
-static void RTI(CPU*, uint16_t);
-static void SEC(CPU*, uint16_t);
-static void SEI(CPU*, uint16_t);
-static void AND(CPU*, uint16_t);
-static void EOR(CPU*, uint16_t);
-static void ADC(CPU*, uint16_t);
-static void SBC(CPU*, uint16_t);
-static void SED(CPU*, uint16_t);
-static void NOP(CPU*, uint16_t);
-static void ASL(CPU*, uint16_t);
-static void LSR(CPU*, uint16_t);
-static void ROL(CPU*, uint16_t);
-static void ROR(CPU*, uint16_t);
-static void ASL_A(CPU*, uint16_t);
-static void LSR_A(CPU*, uint16_t);
-static void ROL_A(CPU*, uint16_t);
-static void ROR_A(CPU*, uint16_t);
+static FORCE_INLINE void set_flag(flags, CPU*, bool);
+static FORCE_INLINE void update_Z(CPU*, uint8_t);
+static FORCE_INLINE void update_N(CPU*, int8_t);
+
+static FORCE_INLINE void check_pagecross(CPU*, uint16_t, uint16_t);
+
+static FORCE_INLINE void branch(bool, CPU*, uint16_t);
+static FORCE_INLINE void compare(CPU*, uint8_t, uint8_t);
+static FORCE_INLINE void load(CPU*, uint8_t*, uint8_t);
+static FORCE_INLINE void xbc(CPU*, uint8_t, bool);
+static void unstable_store(CPU*, uint16_t, uint8_t, uint8_t);
+
+static FORCE_INLINE void STA(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void STX(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void STY(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void LDA(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void LDX(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void LDY(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void CPX(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void CPY(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void CMP(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void TAX(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void TAY(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void TSX(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void TXA(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void TXS(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void TYA(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void DEC(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void INC(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void INX(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void INY(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void DEX(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void BRK(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void BPL(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void BIT(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void BMI(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void BCC(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void BCS(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void BVC(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void BVS(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void BEQ(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void BNE(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void ORA(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void DEY(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void PLA(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void PHA(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void PHP(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void PLP(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void CLC(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void CLD(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void CLI(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void CLV(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void JMP(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void JSR(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void RTS(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void RTI(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void SEC(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void SEI(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void AND(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void EOR(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void ADC(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void SBC(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void SED(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void NOP(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void ASL(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void LSR(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void ROL(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void ROR(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void ASL_A(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void LSR_A(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void ROL_A(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void ROR_A(CPU*, uint16_t, ReadFn, WriteFn);
+
+/* unofficial */
+static FORCE_INLINE void SLO(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void RLA(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void SRE(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void RRA(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void DCP(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void ISB(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void LAX(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void SAX(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void ANC(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void ALR(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void ARR(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void AXS(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void XAA(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void LXA(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void SHY(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void SHX(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void SHA(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void TAS(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void LAS(CPU*, uint16_t, ReadFn, WriteFn);
+static FORCE_INLINE void JAM(CPU*, uint16_t, ReadFn, WriteFn);
 
 /* addressing modes. Get operand based on register values and memory pointer */
-static uint16_t addr_Accumulator(CPU*);
-static uint16_t addr_Absolute(CPU*);
-static uint16_t addr_AbsoluteX(CPU*);
-static uint16_t addr_AbsoluteX_NoPageCheck(CPU*);
-static uint16_t addr_AbsoluteY(CPU*);
-static uint16_t addr_AbsoluteY_NoPageCheck(CPU*);
-static uint16_t addr_Immediate(CPU*);
-static uint16_t addr_Implied(CPU*);
-static uint16_t addr_Indirect(CPU*);
-static uint16_t addr_IndirectX(CPU*);
-static uint16_t addr_IndirectY(CPU*);
-static uint16_t addr_IndirectY_NoPageCheck(CPU*);
-static uint16_t addr_Relative(CPU*);
-static uint16_t addr_ZeroPage(CPU*);
-static uint16_t addr_ZeroPageX(CPU*);
-static uint16_t addr_ZeroPageY(CPU*);
-
-/* array of function pointers to opcode routines, indexed by opcode number */
-static const void (*opcodes[256])(CPU*, uint16_t) =
-{
-    BRK, ORA, NULL, NULL, NULL, ORA, ASL, NULL, PHP, ORA, ASL_A, NULL, NULL, ORA, ASL, NULL, /* 00-OF */
-    BPL, ORA, NULL, NULL, NULL, ORA, ASL, NULL, CLC, ORA, NULL, NULL, NULL, ORA, ASL, NULL, /* 10-1F */
-    JSR, AND, NULL, NULL, BIT, AND, ROL, NULL, PLP, AND, ROL_A, NULL, BIT, AND, ROL, NULL, /* 20-2F */
-    BMI, AND, NULL, NULL, NULL, AND, ROL, NULL, SEC, AND, NULL, NULL, NULL, AND, ROL, NULL, /* 30-3F */
-    RTI, EOR, NULL, NULL, NULL, EOR, LSR, NULL, PHA, EOR, LSR_A, NULL, JMP, EOR, LSR, NULL, /* 40-4F */
-    BVC, EOR, NULL, NULL, NULL, EOR, LSR, NULL, CLI, EOR, NULL, NULL, NULL, EOR, LSR, NULL, /* 50-5F */
-    RTS, ADC, NULL, NULL, NULL, ADC, ROR, NULL, PLA, ADC, ROR_A, NULL, JMP, ADC, ROR, NULL, /* 60-6F */
-    BVS, ADC, NULL, NULL, NULL, ADC, ROR, NULL, SEI, ADC, NULL, NULL, NULL, ADC, ROR, NULL, /* 70-7F */
-    NULL, STA, NULL, NULL, STY, STA, STX, NULL, DEY, NULL, TXA, NULL, STY, STA, STX, NULL, /* 80-8F */
-    BCC, STA, NULL, NULL, STY, STA, STX, NULL, TYA, STA, TXS, NULL, NULL, STA, NULL, NULL, /* 90-9F */
-    LDY, LDA, LDX, NULL, LDY, LDA, LDX, NULL, TAY, LDA, TAX, NULL, LDY, LDA, LDX, NULL, /* A0-AF */
-    BCS, LDA, NULL, NULL, LDY, LDA, LDX, NULL, CLV, LDA, TSX, NULL, LDY, LDA, LDX, NULL, /* B0-BF */
-    CPY, CMP, NULL, NULL, CPY, CMP, DEC, NULL, INY, CMP, DEX, NULL, CPY, CMP, DEC, NULL, /* C0-CF */
-    BNE, CMP, NULL, NULL, NULL, CMP, DEC, NULL, CLD, CMP, NULL, NULL, NULL, CMP, DEC, NULL, /* D0-DF */
-    CPX, SBC, NULL, NULL, CPX, SBC, INC, NULL, INX, SBC, NOP, NULL, CPX, SBC, INC, NULL, /* E0-EF */
-    BEQ, SBC, NULL, NULL, NULL, SBC, INC, NULL, SED, SBC, NULL, NULL, NULL, SBC, INC, NULL /* F0-FF */
-};
+static FORCE_INLINE uint16_t addr_Accumulator(CPU*);
+static FORCE_INLINE uint16_t addr_Absolute(CPU*);
+static FORCE_INLINE uint16_t addr_AbsoluteX(CPU*);
+static FORCE_INLINE uint16_t addr_AbsoluteX_NoPageCheck(CPU*);
+static FORCE_INLINE uint16_t addr_AbsoluteY(CPU*);
+static FORCE_INLINE uint16_t addr_AbsoluteY_NoPageCheck(CPU*);
+static FORCE_INLINE uint16_t addr_Immediate(CPU*);
+static FORCE_INLINE uint16_t addr_Implied(CPU*);
+static FORCE_INLINE uint16_t addr_Indirect(CPU*);
+static FORCE_INLINE uint16_t addr_IndirectX(CPU*);
+static FORCE_INLINE uint16_t addr_IndirectY(CPU*);
+static FORCE_INLINE uint16_t addr_IndirectY_NoPageCheck(CPU*);
+static FORCE_INLINE uint16_t addr_Relative(CPU*);
+static FORCE_INLINE uint16_t addr_ZeroPage(CPU*);
+static FORCE_INLINE uint16_t addr_ZeroPageX(CPU*);
+static FORCE_INLINE uint16_t addr_ZeroPageY(CPU*);
+
+/* bus access used for the operand of each addressing mode. Code is never
+   run from I/O pages so immediates skip the check memread/memwrite
+   make, and zero page operands go straight to internal RAM */
+#define READ_Accumulator memread
+#define READ_Absolute memread
+#define READ_AbsoluteX memread
+#define READ_AbsoluteX_NoPageCheck memread
+#define READ_AbsoluteY memread
+#define READ_AbsoluteY_NoPageCheck memread
+#define READ_Immediate read_direct
+#define READ_Implied memread
+#define READ_Indirect memread
+#define READ_IndirectX memread
+#define READ_IndirectY memread
+#define READ_IndirectY_NoPageCheck memread
+#define READ_Relative memread
+#define READ_ZeroPage read_ram
+#define READ_ZeroPageX read_ram
+#define READ_ZeroPageY read_ram
+
+#define WRITE_Accumulator memwrite
+#define WRITE_Absolute memwrite
+#define WRITE_AbsoluteX memwrite
+#define WRITE_AbsoluteX_NoPageCheck memwrite
+#define WRITE_AbsoluteY memwrite
+#define WRITE_AbsoluteY_NoPageCheck memwrite
+#define WRITE_Immediate memwrite
+#define WRITE_Implied memwrite
+#define WRITE_Indirect memwrite
+#define WRITE_IndirectX memwrite
+#define WRITE_IndirectY memwrite
+#define WRITE_IndirectY_NoPageCheck memwrite
+#define WRITE_Relative memwrite
+#define WRITE_ZeroPage write_ram
+#define WRITE_ZeroPageX write_ram
+#define WRITE_ZeroPageY write_ram
 
 /* base number of cycles per instruction (can be +1 or +2 depending on whether page boundaries are 
-   crossed, and, in the case of branch instructions, whether or not the branch was taken) 
-   6502 Illegal opcodes are just 0 to keep things simple. We die if we see one for now, anyway */
-static const uint8_t cycles[256] =
-{
-    7, 6, 0, 0, 0, 3, 5, 0, 3, 2, 2, 0, 0, 4, 6, 0, /* 00-OF */
-    2, 5, 0, 0, 0, 4, 6, 0, 2, 4, 0, 0, 0, 4, 7, 0, /* 10-1F */
-    6, 6, 0, 0, 3, 3, 5, 0, 4, 2, 2, 0, 4, 4, 6, 0, /* 20-2F */
-    2, 5, 0, 0, 0, 4, 6, 0, 2, 4, 0, 0, 0, 4, 7, 0, /* 30-3F */
-    6, 6, 0, 0, 0, 3, 5, 0, 3, 2, 2, 0, 3, 4, 6, 0, /* 40-4F */
-    2, 5, 0, 0, 0, 4, 6, 0, 2, 4, 0, 0, 0, 4, 7, 0, /* 50-5F */
-    6, 6, 0, 0, 0, 3, 5, 0, 4, 2, 2, 0, 5, 4, 6, 0, /* 60-6F */
-    2, 5, 0, 0, 0, 4, 6, 0, 2, 4, 0, 0, 0, 4, 7, 0, /* 70-7F */
-    0, 6, 0, 0, 3, 3, 3, 0, 2, 0, 2, 0, 4, 4, 4, 0, /* 80-8F */
-    2, 6, 0, 0, 4, 4, 4, 0, 2, 5, 2, 0, 0, 5, 0, 0, /* 90-9F */
-    2, 6, 2, 0, 3, 3, 3, 0, 2, 2, 2, 0, 4, 4, 4, 0, /* A0-AF */
-    2, 5, 0, 0, 4, 4, 4, 0, 2, 4, 2, 0, 4, 4, 4, 0, /* B0-BF */
-    2, 6, 0, 0, 3, 3, 5, 0, 2, 2, 2, 0, 4, 4, 6, 0, /* C0-CF */
-    2, 5, 0, 0, 0, 4, 6, 0, 2, 4, 0, 0, 0, 4, 7, 0, /* D0-DF */
-    2, 6, 0, 0, 3, 3, 5, 0, 2, 2, 2, 0, 4, 4, 6, 0, /* E0-EF */
-    2, 5, 0, 0, 0, 4, 6, 0, 2, 4, 0, 0, 0, 4, 7, 0 /* F0-FF */
-};
-
-/* array of function pointers to addressing modes indexed by opcode number */
-static const uint16_t (*addrmodes[256])(CPU*) =
-{
-    addr_Implied, addr_IndirectX, NULL, NULL, NULL, addr_ZeroPage, addr_ZeroPage, NULL, addr_Implied, addr_Immediate, addr_Accumulator, NULL, NULL, addr_Absolute, addr_Absolute, NULL, /* 00-OF */
-    addr_Relative, addr_IndirectY, NULL, NULL, NULL, addr_ZeroPageX, addr_ZeroPageX, NULL, addr_Implied, addr_AbsoluteY, NULL, NULL, NULL, addr_AbsoluteX, addr_AbsoluteX, NULL, /* 10-1F */
-    addr_Absolute, addr_IndirectX, NULL, NULL, addr_ZeroPage, addr_ZeroPage, addr_ZeroPage, NULL, addr_Implied, addr_Immediate, addr_Accumulator, NULL, addr_Absolute, addr_Absolute, addr_Absolute, NULL, /* 20-2F */
-    addr_Relative, addr_IndirectY, NULL, NULL, NULL, addr_ZeroPageX, addr_ZeroPageX, NULL, addr_Implied, addr_AbsoluteY, NULL, NULL, NULL, addr_AbsoluteX, addr_AbsoluteX, NULL, /* 30-3F */
-    addr_Implied, addr_IndirectX, NULL, NULL, NULL, addr_ZeroPage, addr_ZeroPage, NULL, addr_Implied, addr_Immediate, addr_Accumulator, NULL, addr_Absolute, addr_Absolute, addr_Absolute, NULL, /* 40-4F */
-    addr_Relative, addr_IndirectY, NULL, NULL, NULL, addr_ZeroPageX, addr_ZeroPageX, NULL, addr_Implied, addr_AbsoluteY, NULL, NULL, NULL, addr_AbsoluteX, addr_AbsoluteX, NULL, /* 50-5F */
-    addr_Implied, addr_IndirectX, NULL, NULL, NULL, addr_ZeroPage, addr_ZeroPage, NULL, addr_Implied, addr_Immediate, addr_Accumulator, NULL, addr_Indirect, addr_Absolute, addr_Absolute, NULL, /* 60-6F */
-    addr_Relative, addr_IndirectY, NULL, NULL, NULL, addr_ZeroPageX, addr_ZeroPageX, NULL, addr_Implied, addr_AbsoluteY, NULL, NULL, NULL, addr_AbsoluteX, addr_AbsoluteX, NULL, /* 70-7F */
-    NULL, addr_IndirectX, NULL, NULL, addr_ZeroPage, addr_ZeroPage, addr_ZeroPage, NULL, addr_Implied, NULL, addr_Implied, NULL, addr_Absolute, addr_Absolute, addr_Absolute, NULL, /* 80-8F */
-    addr_Relative, addr_IndirectY_NoPageCheck, NULL, NULL, addr_ZeroPageX, addr_ZeroPageX, addr_ZeroPageY, NULL, addr_Implied, addr_AbsoluteY_NoPageCheck, addr_Implied, NULL, NULL, addr_AbsoluteX_NoPageCheck, NULL, NULL, /* 90-9F */
-    addr_Immediate, addr_IndirectX, addr_Immediate, NULL, addr_ZeroPage, addr_ZeroPage, addr_ZeroPage, NULL, addr_Implied, addr_Immediate, addr_Implied, NULL, addr_Absolute, addr_Absolute, addr_Absolute, NULL, /* A0-AF */
-    addr_Relative, addr_IndirectY, NULL, NULL, addr_ZeroPageX, addr_ZeroPageX, addr_ZeroPageY, NULL, addr_Implied, addr_AbsoluteY, addr_Implied, NULL, addr_AbsoluteX, addr_AbsoluteX, addr_AbsoluteY, NULL, /* B0-BF */
-    addr_Immediate, addr_IndirectX, NULL, NULL, addr_ZeroPage, addr_ZeroPage, addr_ZeroPage, NULL, addr_Implied, addr_Immediate, addr_Implied, NULL, addr_Absolute, addr_Absolute, addr_Absolute, NULL, /* C0-CF */
-    addr_Relative, addr_IndirectY, NULL, NULL, NULL, addr_ZeroPageX, addr_ZeroPageX, NULL, addr_Implied, addr_AbsoluteY, NULL, NULL, NULL, addr_AbsoluteX, addr_AbsoluteX, NULL, /* D0-DF */
-    addr_Immediate, addr_IndirectX, NULL, NULL, addr_ZeroPage, addr_ZeroPage, addr_ZeroPage, NULL, addr_Implied, addr_Immediate, addr_Implied, NULL, addr_Absolute, addr_Absolute, addr_Absolute, NULL, /* E0-EF */
-    addr_Relative, addr_IndirectY, NULL, NULL, NULL, addr_ZeroPageX, addr_ZeroPageX, NULL, addr_Implied, addr_AbsoluteY, NULL, NULL, NULL, addr_AbsoluteX, addr_AbsoluteX, NULL /* F0-FF */
-};
+   crossed, and, in the case of branch instructions, whether or not the branch was taken) */
+#define CYCLES(code, mnemonic, handler, mode, cyc, official) [code] = cyc,
+static const uint8_t cycles[256] = { OPCODE_TABLE(CYCLES) };
+#undef CYCLES
+
+/* the table has to cover every opcode. Duplicates are caught by the switch in FDE */
+#define COUNT(...) + 1
+_Static_assert(0 OPCODE_TABLE(COUNT) == 256, "OPCODE_TABLE must have 256 entries");
+#undef COUNT
 
 #ifdef DEBUG
-static const char* mnemonic_str[256] =
-{
-    "BRK", "ORA", NULL, NULL, NULL, "ORA", "ASL", NULL, "PHP", "ORA", "ASL", NULL, NULL, "ORA", "ASL", NULL, /* 00-OF */
-    "BPL", "ORA", NULL, NULL, NULL, "ORA", "ASL", NULL, "CLC", "ORA", NULL, NULL, NULL, "ORA", "ASL", NULL, /* 10-1F */
-    "JSR", "AND", NULL, NULL, "BIT", "AND", "ROL", NULL, "PLP", "AND", "ROL", NULL, "BIT", "AND", "ROL", NULL, /* 20-2F */
-    "BMI", "AND", NULL, NULL, NULL, "AND", "ROL", NULL, "SEC", "AND", NULL, NULL, NULL, "AND", "ROL", NULL, /* 30-3F */
-    "RTI", "EOR", NULL, NULL, NULL, "EOR", "LSR", NULL, "PHA", "EOR", "LSR", NULL, "JMP", "EOR", "LSR", NULL, /* 40-4F */
-    "BVC", "EOR", NULL, NULL, NULL, "EOR", "LSR", NULL, "CLI", "EOR", NULL, NULL, NULL, "EOR", "LSR", NULL, /* 50-5F */
-    "RTS", "ADC", NULL, NULL, NULL, "ADC", "ROR", NULL, "PLA", "ADC", "ROR", NULL, "JMP", "ADC", "ROR", NULL, /* 60-6F */
-    "BVS", "ADC", NULL, NULL, NULL, "ADC", "ROR", NULL, "SEI", "ADC", NULL, NULL, NULL, "ADC", "ROR", NULL, /* 70-7F */
-    NULL, "STA", NULL, NULL, "STY", "STA", "STX", NULL, "DEY", NULL, "TXA", NULL, "STY", "STA", "STX", NULL, /* 80-8F */
-    "BCC", "STA", NULL, NULL, "STY", "STA", "STX", NULL, "TYA", "STA", "TXS", NULL, NULL, "STA", NULL, NULL, /* 90-9F */
-    "LDY", "LDA", "LDX", NULL, "LDY", "LDA", "LDX", NULL, "TAY", "LDA", "TAX", NULL, "LDY", "LDA", "LDX", NULL, /* A0-AF */
-    "BCS", "LDA", NULL, NULL, "LDY", "LDA", "LDX", NULL, "CLV", "LDA", "TSX", NULL, "LDY", "LDA", "LDX", NULL, /* B0-BF */
-    "CPY", "CMP", NULL, NULL, "CPY", "CMP", "DEC", NULL, "INY", "CMP", "DEX", NULL, "CPY", "CMP", "DEC", NULL, /* C0-CF */
-    "BNE", "CMP", NULL, NULL, NULL, "CMP", "DEC", NULL, "CLD", "CMP", NULL, NULL, NULL, "CMP", "DEC", NULL, /* D0-DF */
-    "CPX", "SBC", NULL, NULL, "CPX", "SBC", "INC", NULL, "INX", "SBC", "NOP", NULL, "CPX", "SBC", "INC", NULL, /* E0-EF */
-    "BEQ", "SBC", NULL, NULL, NULL, "SBC", "INC", NULL, "SED", "SBC", NULL, NULL, NULL, "SBC", "INC", NULL /* F0-FF */
-};
-
-static const char* addr_string[256] = 
-{
-    "Implied", "IndirectX", NULL, NULL, NULL, "ZeroPage", "ZeroPage", NULL, "Implied", "Immediate", "Accumulator", NULL, NULL, "Absolute", "Absolute", NULL, /* 00-OF */
-    "Relative", "IndirectY", NULL, NULL, NULL, "ZeroPageX", "ZeroPageX", NULL, "Implied", "AbsoluteY", NULL, NULL, NULL, "AbsoluteX", "AbsoluteX", NULL, /* 10-1F */
-    "Absolute", "IndirectX", NULL, NULL, "ZeroPage", "ZeroPage", "ZeroPage", NULL, "Implied", "Immediate", "Accumulator", NULL, "Absolute", "Absolute", "Absolute", NULL, /* 20-2F */
-    "Relative", "IndirectY", NULL, NULL, NULL, "ZeroPageX", "ZeroPageX", NULL, "Implied", "AbsoluteY", NULL, NULL, NULL, "AbsoluteX", "AbsoluteX", NULL, /* 30-3F */
-    "Implied", "IndirectX", NULL, NULL, NULL, "ZeroPage", "ZeroPage", NULL, "Implied", "Immediate", "Accumulator", NULL, "Absolute", "Absolute", "Absolute", NULL, /* 40-4F */
-    "Relative", "IndirectY", NULL, NULL, NULL, "ZeroPageX", "ZeroPageX", NULL, "Implied", "AbsoluteY", NULL, NULL, NULL, "AbsoluteX", "AbsoluteX", NULL, /* 50-5F */
-    "Implied", "IndirectX", NULL, NULL, NULL, "ZeroPage", "ZeroPage", NULL, "Implied", "Immediate", "Accumulator", NULL, "Indirect", "Absolute", "Absolute", NULL, /* 60-6F */
-    "Relative", "IndirectY", NULL, NULL, NULL, "ZeroPageX", "ZeroPageX", NULL, "Implied", "AbsoluteY", NULL, NULL, NULL, "AbsoluteX", "AbsoluteX", NULL, /* 70-7F */
-    NULL, "IndirectX", NULL, NULL, "ZeroPage", "ZeroPage", "ZeroPage", NULL, "Implied", NULL, "Implied", NULL, "Absolute", "Absolute", "Absolute", NULL, /* 80-8F */
-    "Relative", "IndirectY", NULL, NULL, "ZeroPageX", "ZeroPageX", "ZeroPageY", NULL, "Implied", "AbsoluteY", "Implied", NULL, NULL, "AbsoluteX", NULL, NULL, /* 90-9F */
-    "Immediate", "IndirectX", "Immediate", NULL, "ZeroPage", "ZeroPage", "ZeroPage", NULL, "Implied", "Immediate", "Implied", NULL, "Absolute", "Absolute", "Absolute", NULL, /* A0-AF */
-    "Relative", "IndirectY", NULL, NULL, "ZeroPageX", "ZeroPageX", "ZeroPageY", NULL, "Implied", "AbsoluteY", "Implied", NULL, "AbsoluteX", "AbsoluteX", "AbsoluteY", NULL, /* B0-BF */
-    "Immediate", "IndirectX", NULL, NULL, "ZeroPage", "ZeroPage", "ZeroPage", NULL, "Implied", "Immediate", "Implied", NULL, "Absolute", "Absolute", "Absolute", NULL, /* C0-CF */
-    "Relative", "IndirectY", NULL, NULL, NULL, "ZeroPageX", "ZeroPageX", NULL, "Implied", "AbsoluteY", NULL, NULL, NULL, "AbsoluteX", "AbsoluteX", NULL, /* D0-DF */
-    "Immediate", "IndirectX", NULL, NULL, "ZeroPage", "ZeroPage", "ZeroPage", NULL, "Implied", "Immediate", "Implied", NULL, "Absolute", "Absolute", "Absolute", NULL, /* E0-EF */
-    "Relative", "IndirectY", NULL, NULL, NULL, "ZeroPageX", "ZeroPageX", NULL, "Implied", "AbsoluteY", NULL, NULL, NULL, "AbsoluteX", "AbsoluteX", NULL /* F0-FF */
-};
+/* unofficial mnemonics are starred like in the nestest log */
+#define MNEMONIC(code, mnemonic, handler, mode, cyc, official) [code] = official ? #mnemonic : "*" #mnemonic,
+static const char* mnemonic_str[256] = { OPCODE_TABLE(MNEMONIC) };
+#undef MNEMONIC
+
+/* operand bytes following the opcode */
+#define OPERAND_BYTES(code, mnemonic, handler, mode, cyc, official) [code] = BYTES_##mode,
+static const uint8_t operand_bytes[256] = { OPCODE_TABLE(OPERAND_BYTES) };
+#undef OPERAND_BYTES
 #endif
 
 
-CPU make_cpu(Memory* mem){
+CPU make_cpu(Memory* mem, Scheduler* sched){
     uint8_t A = 0, X = 0, Y = 0;
     uint8_t P = STATUS_INIT;
     uint8_t SP = SP_INIT;
     uint16_t PC = 0;
     uint64_t cycles = STARTUP_CYCLES;
-    CPU cpu = { cycles,A,X,Y,P,SP,PC,mem };
+    uint64_t opno = 0;
+    CPU cpu = { cycles,opno,A,X,Y,P,SP,PC,mem,mem->map[0],false,0,sched };
 
     return cpu;
 }
 
-static uint8_t memread(CPU* cpu, uint16_t addr){
+static FORCE_INLINE uint8_t memread(CPU* cpu, uint16_t addr){
+    /* the write policy table also marks the pages with read side effects */
+    Memory* mem = cpu->mem;
+    CDL_MARK(mem->cdl, addr, CDL_READ);
+    if (mem->write_policy[addr >> PAGE_SHIFT] >= PAGE_IO)
+        return hooked_read(cpu, addr, true);
+    return *(mem->map[addr]);
+}
+
+static FORCE_INLINE uint8_t bus_read(CPU* cpu, uint16_t addr){
+    /* memread for instruction bytes, which aren't data reads */
+    Memory* mem = cpu->mem;
+    if (mem->write_policy[addr >> PAGE_SHIFT] >= PAGE_IO)
+        return hooked_read(cpu, addr, false);
+    return *(mem->map[addr]);
+}
+
+static uint8_t hooked_read(CPU* cpu, uint16_t addr, bool data){
+    /* registers, and pages with breakpoints or watchpoints */
+    Memory* mem = cpu->mem;
+    if (mem->write_policy[addr >> PAGE_SHIFT] == PAGE_IO)
+        return mem->io_read(mem->io, addr);
+    return mem->watch_read(mem->watch, addr, data);
+}
+
+static bool hooked_fetch(CPU* cpu, uint8_t* opcode){
+    /* opcode fetch off the fast path. False when a breakpoint stops the
+       CPU before the instruction */
+    Memory* mem = cpu->mem;
+    if (mem->write_policy[cpu->PC >> PAGE_SHIFT] == PAGE_WATCH && !mem->watch_exec(mem->watch, cpu->PC))
+        return false;
+    *opcode = hooked_read(cpu, cpu->PC, false);
+    return true;
+}
+
+static FORCE_INLINE void memwrite(CPU* cpu, uint16_t addr, uint8_t val){
+    Memory* mem = cpu->mem;
+    CDL_MARK(mem->cdl, addr, CDL_WRITE);
+    switch (mem->write_policy[addr >> PAGE_SHIFT]){
+        case PAGE_RAM: *(mem->map[addr]) = val; break;
+        case PAGE_ROM: break;
+        case PAGE_MAPPER: mem->mapper_write(mem->mapper, addr, val); break;
+        case PAGE_IO: mem->io_write(mem->io, addr, val); break;
+        case PAGE_WATCH: mem->watch_write(mem->watch, addr, val); break;
+    }
+}
+
+static FORCE_INLINE uint8_t read_direct(CPU* cpu, uint16_t addr){
     return *(cpu->mem->map[addr]);
 }
 
-static void memwrite(CPU* cpu, uint16_t addr, uint8_t val){
-    /* TODO Guard writable range on map (can't write rom...) */
+static FORCE_INLINE void write_direct(CPU* cpu, uint16_t addr, uint8_t val){
     *(cpu->mem->map[addr]) = val;
 }
 
-static void stack_push(CPU* cpu, uint8_t val){
-    memwrite(cpu, STACK_BOTTOM + cpu->SP--, val);
+static FORCE_INLINE uint8_t read_ram(CPU* cpu, uint16_t addr){
+    /* only for $0000-$01FF, which is never mirrored or remapped. Through
+       the map while it has watchpoints */
+    uint8_t* ram = cpu->ram;
+    if (ram == NULL)
+        return memread(cpu, addr);
+    CDL_MARK(cpu->mem->cdl, addr, CDL_READ);
+    return ram[addr];
 }
 
-static uint8_t stack_pull(CPU* cpu){
-    return memread(cpu, STACK_BOTTOM + ++cpu->SP);
+static FORCE_INLINE void write_ram(CPU* cpu, uint16_t addr, uint8_t val){
+    uint8_t* ram = cpu->ram;
+    if (ram == NULL){
+        memwrite(cpu, addr, val);
+        return;
+    }
+    CDL_MARK(cpu->mem->cdl, addr, CDL_WRITE);
+    ram[addr] = val;
 }
 
-static uint8_t memreadPC(CPU* cpu){
-    /* convenience wrapper to do a read at PC and then increment PC */
+static FORCE_INLINE void stack_push(CPU* cpu, uint8_t val){
+    write_ram(cpu, STACK_BOTTOM + cpu->SP--, val);
+}
+
+static FORCE_INLINE uint8_t stack_pull(CPU* cpu){
+    return read_ram(cpu, STACK_BOTTOM + ++cpu->SP);
+}
+
+static FORCE_INLINE uint8_t memreadPC(CPU* cpu){
+    /* convenience wrapper to do an operand read at PC and then increment PC */
     uint16_t addr = cpu->PC;
-    uint8_t read = memread(cpu, addr);
+    CDL_MARK(cpu->mem->cdl, addr, CDL_OPERAND);
+    uint8_t read = bus_read(cpu, addr);
     cpu->PC++;
     return read;
 }
 
 void reset(CPU* cpu){
     /* set PC to address in reset vector */
-    cpu->PC = RESET;
     cpu->cycles = STARTUP_CYCLES;
-    uint16_t low = memreadPC(cpu);
-    uint16_t high = memreadPC(cpu);
+    uint16_t low = memread(cpu, RESET);
+    uint16_t high = memread(cpu, RESET + 1);
 
     cpu->PC = (high << 8) | low; /* jump */
-    /* #ifdef NESTEST */
+    #ifdef NESTEST
     cpu->PC = 0xC000; /* nestest first instruction */
-    /* #endif */
+    #endif
 }
 
 void FDE(CPU* cpu){
@@ -270,62 +332,98 @@ void FDE(CPU* cpu){
     uint8_t _y  = cpu->Y;
     uint8_t _p  = cpu->P;
     uint8_t _sp  = cpu->SP;
-    uint8_t _oper_low = memread(cpu, _pc+1);
-    uint8_t _oper_high = memread(cpu, _pc+2);
+    uint8_t _oper_low = bus_read(cpu, _pc+1);
+    uint8_t _oper_high = bus_read(cpu, _pc+2);
     #endif
 
-    uint8_t opcode = memreadPC(cpu); 
-    if (addrmodes[opcode] == NULL)
-        err_exit("CPU: Illegal opcode %02x at location %04X", opcode, cpu->PC-1);
+    uint8_t opcode;
+    if (cpu->mem->write_policy[cpu->PC >> PAGE_SHIFT] < PAGE_IO)
+        opcode = *(cpu->mem->map[cpu->PC]);
+    else if (!hooked_fetch(cpu, &opcode))
+        return; /* stopped at a breakpoint */
+    CDL_MARK(cpu->mem->cdl, cpu->PC, CDL_EXEC);
+    cpu->PC++;
 
     #ifdef DEBUG
     /* TODO write to a log file or stdout */
-    static uint64_t opno = 0;
-    ++opno;
+    uint64_t opno = ++cpu->opno;
     const char* mnemonic = mnemonic_str[opcode];
-    const char* addrstring = addr_string[opcode];
-    uint8_t n_oper;
-
-    if (strncmp(addrstring, "Implied", 3) == 0) n_oper = 0;
-    else if (strncmp(addrstring, "Accumulator", 2) == 0) n_oper = 0;
-    else if (strcmp(addrstring, "AbsoluteX") == 0) n_oper = 2;
-    else if (strcmp(addrstring, "AbsoluteY") == 0) n_oper = 2;
-    else if (strncmp(addrstring, "Absolute", 2) == 0) n_oper = 2;
-    else if (strcmp(addrstring, "Indirect") == 0) n_oper = 2;
-    else n_oper = 1;
+    uint8_t n_oper = operand_bytes[opcode];
 
     printf("%ld\t", opno);
 
     switch(n_oper){
         case 0:
-            fprintf(stdout, "%04X  %02X        %s                             A:%02X X:%02X Y:%02X P:%02X SP:%02X CYC:%lu\n", 
+            fprintf(stdout, "%04X  %02X       %4s                             A:%02X X:%02X Y:%02X P:%02X SP:%02X CYC:%lu\n", 
                     _pc, opcode, mnemonic, _a, _x, _y, _p, _sp, cpu->cycles);
             break;
         case 1:
-            fprintf(stdout, "%04X  %02X %02X     %s #$%02X                        A:%02X X:%02X Y:%02X P:%02X SP:%02X CYC:%lu\n", 
+            fprintf(stdout, "%04X  %02X %02X    %4s #$%02X                        A:%02X X:%02X Y:%02X P:%02X SP:%02X CYC:%lu\n", 
                     _pc, opcode, _oper_low, mnemonic, _oper_low, _a, _x, _y, _p, _sp, cpu->cycles);
             break;
         case 2:
-            fprintf(stdout, "%04X  %02X %02X %02X  %s $%02X%02X                       A:%02X X:%02X Y:%02X P:%02X SP:%02X CYC:%lu\n", 
+            fprintf(stdout, "%04X  %02X %02X %02X %4s $%02X%02X                       A:%02X X:%02X Y:%02X P:%02X SP:%02X CYC:%lu\n", 
                     _pc, opcode, _oper_low, _oper_high, mnemonic, _oper_high, _oper_low, _a, _x, _y, _p, _sp, cpu->cycles);
     }
     #endif
 
-    uint16_t op;
-    op = addrmodes[opcode](cpu);
-    opcodes[opcode](cpu, op);
+    /* every case inlines its addressing mode and handler, with the
+       handler's memory accesses bound to the mode's READ_/WRITE_ */
+    switch (opcode){
+        #define DISPATCH(code, mnemonic, handler, mode, cyc, official) \
+            case code: \
+                handler(cpu, addr_##mode(cpu), READ_##mode, WRITE_##mode); \
+                cpu->cycles += cyc; \
+                break;
+        OPCODE_TABLE(DISPATCH)
+        #undef DISPATCH
+    }
+
+}
 
-    cpu->cycles = cpu->cycles + cycles[opcode];
+bool cpu_interrupt(CPU* cpu){
+    /* take a latched NMI, or the IRQ if the line is up and I is clear.
+       Called between instructions when the scheduler says to look */
+    uint16_t vector;
+    if (cpu->nmi){
+        cpu->nmi = false;
+        vector = NMI;
+    }
+    else if (cpu->irq && !(cpu->P & (1 << I)))
+        vector = IRQ;
+    else
+        return false;
+    enter_interrupt(cpu, vector, false);
+    cpu->cycles += INTERRUPT_CYCLES;
+    return true;
+}
+
+static void enter_interrupt(CPU* cpu, uint16_t vector, bool brk){
+    /* push PC and P (B set only for BRK, bit 5 always) and jump through
+       the vector with further IRQs masked */
+    stack_push(cpu, cpu->PC >> 8);
+    stack_push(cpu, cpu->PC & 0xFF);
+    stack_push(cpu, (cpu->P & ~(1 << 4)) | (brk << 4) | (1 << 5));
+    set_flag(I, cpu, true);
+    uint16_t low = memread(cpu, vector);
+    uint16_t high = memread(cpu, vector + 1);
+    cpu->PC = (high << 8) | low;
+}
 
+static void poll_irq(CPU* cpu, uint8_t delay){
+    /* I was just cleared. With the line already up, the IRQ is taken once
+       the loop gets delay cycles past the start of this instruction */
+    if (cpu->irq && !(cpu->P & (1 << I)))
+        sched_set(cpu->sched, EVENT_INTERRUPT, cpu->cycles + delay);
 }
 
-static void check_pagecross(CPU* cpu, uint16_t initial, uint16_t adjusted){
+static FORCE_INLINE void check_pagecross(CPU* cpu, uint16_t initial, uint16_t adjusted){
     /* if high byte different */
     if ((adjusted & 0xFF00) != (initial & 0xFF00))
         cpu->cycles++;
 }
 
-static void set_flag(flags bitpos, CPU* cpu, bool set){
+static FORCE_INLINE void set_flag(flags bitpos, CPU* cpu, bool set){
     /* set bitpos of cpu's status register to bool set */
     if (set)
         cpu->P = (1 << bitpos) | cpu->P;
@@ -333,7 +431,7 @@ static void set_flag(flags bitpos, CPU* cpu, bool set){
         cpu->P = ~(1 << bitpos) & cpu->P;
 }
 
-static void update_Z(CPU* cpu, uint8_t res){
+static FORCE_INLINE void update_Z(CPU* cpu, uint8_t res){
     /* set Z if res is 0, clear otherwise */
     if (res == 0)
         cpu->P = (1 << 1) | cpu->P;
@@ -341,7 +439,7 @@ static void update_Z(CPU* cpu, uint8_t res){
         cpu->P = ~(1 << 1) & cpu->P;
 }
 
-static void update_N(CPU* cpu, int8_t res){
+static FORCE_INLINE void update_N(CPU* cpu, int8_t res){
     /* set N if res is negative, clear otherwise */
     if (res < 0)
         cpu->P = (1 << 7) | cpu->P;
@@ -349,60 +447,61 @@ static void update_N(CPU* cpu, int8_t res){
         cpu->P = ~(1 << 7) & cpu->P;
 }
 
-static uint16_t addr_Accumulator(CPU* cpu){
+static FORCE_INLINE uint16_t addr_Accumulator(CPU* cpu){
     /* nop */
     return 0;
 }
 
-static uint16_t addr_Absolute(CPU* cpu){
+static FORCE_INLINE uint16_t addr_Absolute(CPU* cpu){
     uint16_t low = memreadPC(cpu);
     uint16_t high = memreadPC(cpu);
     uint16_t addr = (high << 8) | low;
     return addr;
 }
 
-static uint16_t addr_AbsoluteX(CPU* cpu){
+static FORCE_INLINE uint16_t addr_AbsoluteX(CPU* cpu){
     uint16_t pre = addr_Absolute(cpu);
     uint16_t addr = pre + cpu->X;
     check_pagecross(cpu, pre, addr);
     return addr;
 }
 
-static uint16_t addr_AbsoluteX_NoPageCheck(CPU* cpu){
-    /* For STA (0x9D) only. Store instructions always have the oops cycle
+static FORCE_INLINE uint16_t addr_AbsoluteX_NoPageCheck(CPU* cpu){
+    /* Stores and read-modify-writes always have the oops cycle
        so we skip the check to see if we crossed a page boundary */
     uint16_t addr = addr_Absolute(cpu);
     return addr + cpu->X;
 }
 
-static uint16_t addr_AbsoluteY(CPU* cpu){
+static FORCE_INLINE uint16_t addr_AbsoluteY(CPU* cpu){
     uint16_t pre = addr_Absolute(cpu);
     uint16_t addr = pre + cpu->Y;
     check_pagecross(cpu, pre, addr);
     return addr;
 }
 
-static uint16_t addr_AbsoluteY_NoPageCheck(CPU* cpu){
-    /* For STA (0x99) only. Store instructions always have the oops cycle
+static FORCE_INLINE uint16_t addr_AbsoluteY_NoPageCheck(CPU* cpu){
+    /* Stores and read-modify-writes always have the oops cycle
        so we skip the check to see if we crossed a page boundary */
     uint16_t addr = addr_Absolute(cpu);
     return addr + cpu->Y;
 }
 
-static uint16_t addr_Immediate(CPU* cpu){
+static FORCE_INLINE uint16_t addr_Immediate(CPU* cpu){
     /* simply return the PRGROM address in the PC, which is the
      * address of the immediate byte (incremented after opcode
      * byte is read). We expect the instruction function to treat 
      * as an address and "dereference" the actual immediate value */
+    CDL_MARK(cpu->mem->cdl, cpu->PC, CDL_OPERAND);
     return cpu->PC++;
 }
 
-static uint16_t addr_Implied(CPU* cpu){
+static FORCE_INLINE uint16_t addr_Implied(CPU* cpu){
     /* nop */
     return 0;
 }
 
-static uint16_t addr_Indirect(CPU* cpu){
+static FORCE_INLINE uint16_t addr_Indirect(CPU* cpu){
     uint16_t indlow = memreadPC(cpu);
     uint16_t indhigh = memreadPC(cpu);
     uint16_t indirect = (indhigh << 8) | indlow;
@@ -413,69 +512,69 @@ static uint16_t addr_Indirect(CPU* cpu){
     return addr;
 }
 
-static uint16_t addr_IndirectX(CPU* cpu){
+static FORCE_INLINE uint16_t addr_IndirectX(CPU* cpu){
     /* overflow wraps zero page as intended */
     uint8_t indirect = memreadPC(cpu) + cpu->X;
-    uint16_t low = memread(cpu, indirect);
-    /* we need to cast this addiiton expression before we pass since memread
+    uint16_t low = read_ram(cpu, indirect);
+    /* we need to cast this addiiton expression before we pass since read_ram
        will widen to uint16_t, but we want this to overflow and wrap the 
        zero page */
-    uint16_t high = memread(cpu, (uint8_t)(indirect + 1));
+    uint16_t high = read_ram(cpu, (uint8_t)(indirect + 1));
     uint16_t addr = (high << 8) | low;
     return addr;
 }
 
-static uint16_t addr_IndirectY(CPU* cpu){
+static FORCE_INLINE uint16_t addr_IndirectY(CPU* cpu){
     uint8_t indirect = memreadPC(cpu);
-    uint16_t low = memread(cpu, indirect);
-    /* we need to cast this addiiton expression before we pass since memread
+    uint16_t low = read_ram(cpu, indirect);
+    /* we need to cast this addiiton expression before we pass since read_ram
        will widen to uint16_t, but we want this to overflow and wrap the 
        zero page */
-    uint16_t high = memread(cpu, (uint8_t)(indirect + 1));
+    uint16_t high = read_ram(cpu, (uint8_t)(indirect + 1));
     uint16_t pre = (high << 8) | low;
     uint16_t addr = (pre + cpu->Y);
     check_pagecross(cpu, pre, addr);
     return addr;
 }
 
-static uint16_t addr_IndirectY_NoPageCheck(CPU* cpu){
-    /* For STA (0x91) only. Store instructions always have the oops cycle
+static FORCE_INLINE uint16_t addr_IndirectY_NoPageCheck(CPU* cpu){
+    /* Stores and read-modify-writes always have the oops cycle
        so we skip the check to see if we crossed a page boundary */
     uint8_t indirect = memreadPC(cpu);
-    uint16_t low = memread(cpu, indirect);
-    /* we need to cast this addiiton expression before we pass since memread
+    uint16_t low = read_ram(cpu, indirect);
+    /* we need to cast this addiiton expression before we pass since read_ram
        will widen to uint16_t, but we want this to overflow and wrap the 
        zero page */
-    uint16_t high = memread(cpu, (uint8_t)(indirect + 1));
+    uint16_t high = read_ram(cpu, (uint8_t)(indirect + 1));
     uint16_t addr = (high << 8) | low;
     return addr + cpu->Y;
 }
 
-static uint16_t addr_Relative(CPU* cpu){
+static FORCE_INLINE uint16_t addr_Relative(CPU* cpu){
     /* twos complement signed byte */
     int8_t rel = memreadPC(cpu);
     uint16_t addr = ((int16_t)cpu->PC) + rel;
     return addr;
 }
 
-static uint16_t addr_ZeroPage(CPU* cpu){
+static FORCE_INLINE uint16_t addr_ZeroPage(CPU* cpu){
     /* just read the low byte and use $00 as the high byte */
     return memreadPC(cpu);
 }
 
-static uint16_t addr_ZeroPageX(CPU* cpu){
+static FORCE_INLINE uint16_t addr_ZeroPageX(CPU* cpu){
     /* X-indexed addition may (intentionally) overflow and wrap on zero page */
     uint8_t addr = memreadPC(cpu) + cpu->X;
     return addr;
 }
 
-static uint16_t addr_ZeroPageY(CPU* cpu){
+static FORCE_INLINE uint16_t addr_ZeroPageY(CPU* cpu){
     /* Y-indexed addition may (intentionally) overflow and wrap on zero page */
     uint8_t addr = memreadPC(cpu) + cpu->Y;
     return addr;
 }
 
-static void branch(bool branch_taken, CPU* cpu, uint16_t op){
+static FORCE_INLINE void branch(bool branch_taken, CPU* cpu, uint16_t op){
     if (!branch_taken)
         return;
     /* +1 cycle if page crossed in branch */
@@ -485,20 +584,20 @@ static void branch(bool branch_taken, CPU* cpu, uint16_t op){
     cpu->cycles++;
 }
 
-static void load(CPU* cpu, uint8_t* reg, uint16_t op){
-    *reg = memread(cpu, op);
+static FORCE_INLINE void load(CPU* cpu, uint8_t* reg, uint8_t read){
+    *reg = read;
     update_Z(cpu, *reg);
     update_N(cpu, *reg);
 }
 
-static void compare(CPU* cpu, uint8_t other, uint16_t op){
-    uint8_t cmp = other - memread(cpu, op);
+static FORCE_INLINE void compare(CPU* cpu, uint8_t other, uint8_t read){
+    uint8_t cmp = other - read;
     update_N(cpu, cmp);
     update_Z(cpu, cmp);
     set_flag(C, cpu, cmp <= other);
 }
 
-static void xbc(CPU* cpu, uint16_t op, bool invert){
+static FORCE_INLINE void xbc(CPU* cpu, uint8_t read, bool invert){
     /* core logic for ADC and SBC. if invert is true, do SBC. else do ADC.
        these instructions perform addition or subtraction of the form
        Accumulator +- Operand +- Carry bit (bit 0 of the status register), where
@@ -514,7 +613,6 @@ static void xbc(CPU* cpu, uint16_t op, bool invert){
 
        In the case of subtraction, we can simply take the ones' complement
        (invert the bits) of the second op and do addition for the same effect */
-    uint8_t read = memread(cpu, op);
     uint8_t carry_in = cpu->P & 1;
     if (invert) read = ~read;
     uint8_t res = carry_in + read + cpu->A;
@@ -530,202 +628,205 @@ static void xbc(CPU* cpu, uint16_t op, bool invert){
     update_N(cpu, cpu->A);
 }
 
-static void STA(CPU* cpu, uint16_t op){
-    memwrite(cpu, op, cpu->A);
+static FORCE_INLINE void STA(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
+    wr(cpu, op, cpu->A);
 }
 
-static void STX(CPU* cpu, uint16_t op){
-    memwrite(cpu, op, cpu->X);
+static FORCE_INLINE void STX(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
+    wr(cpu, op, cpu->X);
 }
 
-static void STY(CPU* cpu, uint16_t op){
-    memwrite(cpu, op, cpu->Y);
+static FORCE_INLINE void STY(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
+    wr(cpu, op, cpu->Y);
 }
 
-static void LDA(CPU* cpu, uint16_t op){
-    load(cpu, &cpu->A, op);
+static FORCE_INLINE void LDA(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
+    load(cpu, &cpu->A, rd(cpu, op));
 }
 
-static void LDX(CPU* cpu, uint16_t op){
-    load(cpu, &cpu->X, op);
+static FORCE_INLINE void LDX(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
+    load(cpu, &cpu->X, rd(cpu, op));
 }
 
-static void LDY(CPU* cpu, uint16_t op){
-    load(cpu, &cpu->Y, op);
+static FORCE_INLINE void LDY(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
+    load(cpu, &cpu->Y, rd(cpu, op));
 }
 
-static void CMP(CPU* cpu, uint16_t op){
-    compare(cpu, cpu->A, op);
+static FORCE_INLINE void CMP(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
+    compare(cpu, cpu->A, rd(cpu, op));
 }
 
-static void CPX(CPU* cpu, uint16_t op){
-    compare(cpu, cpu->X, op);
+static FORCE_INLINE void CPX(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
+    compare(cpu, cpu->X, rd(cpu, op));
 }
 
-static void CPY(CPU* cpu, uint16_t op){
-    compare(cpu, cpu->Y, op);
+static FORCE_INLINE void CPY(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
+    compare(cpu, cpu->Y, rd(cpu, op));
 }
 
-static void TSX(CPU* cpu, uint16_t op){
+static FORCE_INLINE void TSX(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
     cpu->X = cpu->SP;
     update_Z(cpu, cpu->X);
     update_N(cpu, cpu->X);
 }
 
-static void TXS(CPU* cpu, uint16_t op){
+static FORCE_INLINE void TXS(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
     cpu->SP = cpu->X;
 }
 
-static void TAX(CPU* cpu, uint16_t op){
+static FORCE_INLINE void TAX(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
     cpu->X = cpu->A;
     update_Z(cpu, cpu->X);
     update_N(cpu, cpu->X);
 }
 
-static void TAY(CPU* cpu, uint16_t op){
+static FORCE_INLINE void TAY(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
     cpu->Y = cpu->A;
     update_Z(cpu, cpu->Y);
     update_N(cpu, cpu->Y);
 }
 
-static void TXA(CPU* cpu, uint16_t op){
+static FORCE_INLINE void TXA(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
     cpu->A = cpu->X;
     update_Z(cpu, cpu->A);
     update_N(cpu, cpu->A);
 }
 
-static void TYA(CPU* cpu, uint16_t op){
+static FORCE_INLINE void TYA(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
     cpu->A = cpu->Y;
     update_Z(cpu, cpu->A);
     update_N(cpu, cpu->A);
 }
 
-static void INC(CPU* cpu, uint16_t op){
-    uint8_t read = memread(cpu, op);
+static FORCE_INLINE void INC(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
+    uint8_t read = rd(cpu, op);
     read++;
-    memwrite(cpu, op, read);
+    wr(cpu, op, read);
     update_Z(cpu, read);
     update_N(cpu, read);
 }
 
-static void INX(CPU* cpu, uint16_t op){
+static FORCE_INLINE void INX(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
     cpu->X++;
     update_Z(cpu, cpu->X);
     update_N(cpu, cpu->X);
 }
 
-static void INY(CPU* cpu, uint16_t op){
+static FORCE_INLINE void INY(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
     cpu->Y++;
     update_Z(cpu, cpu->Y);
     update_N(cpu, cpu->Y);
 }
 
-static void DEC(CPU* cpu, uint16_t op){
-    uint8_t read = memread(cpu, op);
+static FORCE_INLINE void DEC(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
+    uint8_t read = rd(cpu, op);
     read--;
-    memwrite(cpu, op, read);
+    wr(cpu, op, read);
     update_Z(cpu, read);
     update_N(cpu, read);
 }
 
-static void DEX(CPU* cpu, uint16_t op){
+static FORCE_INLINE void DEX(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
     cpu->X--;
     update_Z(cpu, cpu->X);
     update_N(cpu, cpu->X);
 }
 
-static void DEY(CPU* cpu, uint16_t op){
+static FORCE_INLINE void DEY(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
     cpu->Y--;
     update_Z(cpu, cpu->Y);
     update_N(cpu, cpu->Y);
 }
 
-static void BIT(CPU* cpu, uint16_t op){
-    uint8_t read = memread(cpu, op);
+static FORCE_INLINE void BIT(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
+    uint8_t read = rd(cpu, op);
     update_Z(cpu, read & cpu->A);
     update_N(cpu, read);
     set_flag(V, cpu, read & (1 << 6));
 }
 
-static void BPL(CPU* cpu, uint16_t op){
+static FORCE_INLINE void BPL(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
     branch(((1 << 7) & cpu->P) == 0, cpu, op);
 }
 
-static void BMI(CPU* cpu, uint16_t op){
+static FORCE_INLINE void BMI(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
     branch(((1 << 7) & cpu->P) != 0, cpu, op);
 }
 
-static void BCC(CPU* cpu, uint16_t op){
+static FORCE_INLINE void BCC(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
     branch((1 & cpu->P) == 0, cpu, op);
 }
 
-static void BCS(CPU* cpu, uint16_t op){
+static FORCE_INLINE void BCS(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
     branch((1 & cpu->P) != 0, cpu, op);
 }
 
-static void BVC(CPU* cpu, uint16_t op){
+static FORCE_INLINE void BVC(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
     branch(((1 << 6) & cpu->P) == 0, cpu, op);
 }
 
-static void BVS(CPU* cpu, uint16_t op){
+static FORCE_INLINE void BVS(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
     branch(((1 << 6) & cpu->P) != 0, cpu, op);
 }
 
-static void BEQ(CPU* cpu, uint16_t op){
+static FORCE_INLINE void BEQ(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
     branch(((1 << 1) & cpu->P) != 0, cpu, op);
 }
 
-static void BNE(CPU* cpu, uint16_t op){
+static FORCE_INLINE void BNE(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
     branch(((1 << 1) & cpu->P) == 0, cpu, op);
 }
 
-static void PLA(CPU* cpu, uint16_t op){
+static FORCE_INLINE void PLA(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
     cpu->A = stack_pull(cpu);
     update_Z(cpu, cpu->A);
     update_N(cpu, cpu->A);
 }
 
-static void PHA(CPU* cpu, uint16_t op){
+static FORCE_INLINE void PHA(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
     stack_push(cpu, cpu->A);
 }
 
-static void PHP(CPU* cpu, uint16_t op){
+static FORCE_INLINE void PHP(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
     /* status register value is pushed to stack with bits 4 and 5 set
        Note that bit 5 should always be set for convenience in our case
        since it doesn't exist in real hardware */
     stack_push(cpu, cpu->P | (3 << 4));
 }
 
-static void PLP(CPU* cpu, uint16_t op){
+static FORCE_INLINE void PLP(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
     /* status register value is pulled from stack with
        bit 4 clear. Note that bit 5 should always be set for
        convenience in our case since it doesn't exist in real hardware */
     cpu->P = stack_pull(cpu) & ~(1 << 4);
     cpu->P |= (1 << 5);
-
+    /* delayed like CLI */
+    poll_irq(cpu, cycles[0x28] + 1);
 }
 
-static void CLC(CPU* cpu, uint16_t op){
+static FORCE_INLINE void CLC(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
     set_flag(C, cpu, false);
 }
 
-static void CLD(CPU* cpu, uint16_t op){
+static FORCE_INLINE void CLD(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
     set_flag(D, cpu, false);
 }
 
-static void CLI(CPU* cpu, uint16_t op){
+static FORCE_INLINE void CLI(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
     set_flag(I, cpu, false);
+    /* the change is seen after the next instruction */
+    poll_irq(cpu, cycles[0x58] + 1);
 }
 
-static void CLV(CPU* cpu, uint16_t op){
+static FORCE_INLINE void CLV(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
     set_flag(V, cpu, false);
 }
 
-static void JMP(CPU* cpu, uint16_t op){
+static FORCE_INLINE void JMP(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
     cpu->PC = op;
 }
 
-static void JSR(CPU* cpu, uint16_t op){
+static FORCE_INLINE void JSR(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
     uint8_t low = 0x00FF & cpu->PC;
     uint8_t high = cpu->PC >> 8;
     /* adjust off-by-one which usually won't matter
@@ -738,7 +839,7 @@ static void JSR(CPU* cpu, uint16_t op){
     cpu->PC = op;
 }
 
-static void RTS(CPU* cpu, uint16_t op){
+static FORCE_INLINE void RTS(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
     uint8_t low = stack_pull(cpu);
     uint8_t high = stack_pull(cpu);
     cpu->PC = ((uint16_t) high << 8) | low;
@@ -747,7 +848,7 @@ static void RTS(CPU* cpu, uint16_t op){
     cpu->PC++;
 }
 
-static void RTI(CPU* cpu, uint16_t op){
+static FORCE_INLINE void RTI(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
     /* equivalent to PLP */
     cpu->P = stack_pull(cpu) & ~(1 << 4);
     cpu->P |= (1 << 5);
@@ -757,70 +858,72 @@ static void RTI(CPU* cpu, uint16_t op){
     uint8_t low = stack_pull(cpu);
     uint8_t high = stack_pull(cpu);
     cpu->PC = ((uint16_t) high << 8) | low;
+    /* no delay, unlike CLI and PLP */
+    poll_irq(cpu, 0);
 }
 
-static void SEC(CPU* cpu, uint16_t op){
+static FORCE_INLINE void SEC(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
     set_flag(C, cpu, true);
 }
 
-static void SEI(CPU* cpu, uint16_t op){
+static FORCE_INLINE void SEI(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
     set_flag(I, cpu, true);
 }
 
-static void AND(CPU* cpu, uint16_t op){
-    cpu->A &= memread(cpu, op);
+static FORCE_INLINE void AND(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
+    cpu->A &= rd(cpu, op);
     update_Z(cpu, cpu->A);
     update_N(cpu, cpu->A);
 }
 
-static void EOR(CPU* cpu, uint16_t op){
-    cpu->A ^= memread(cpu, op);
+static FORCE_INLINE void EOR(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
+    cpu->A ^= rd(cpu, op);
     update_Z(cpu, cpu->A);
     update_N(cpu, cpu->A);
 }
 
-static void ORA(CPU* cpu, uint16_t op){
-    cpu->A |= memread(cpu, op);
+static FORCE_INLINE void ORA(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
+    cpu->A |= rd(cpu, op);
     update_Z(cpu, cpu->A);
     update_N(cpu, cpu->A);
 }
 
-static void ADC(CPU* cpu, uint16_t op){
-    xbc(cpu, op, false);
+static FORCE_INLINE void ADC(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
+    xbc(cpu, rd(cpu, op), false);
 }
 
-static void SBC(CPU* cpu, uint16_t op){
-    xbc(cpu, op, true);
+static FORCE_INLINE void SBC(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
+    xbc(cpu, rd(cpu, op), true);
 }
 
-static void SED(CPU* cpu, uint16_t op){
+static FORCE_INLINE void SED(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
     set_flag(D, cpu, true);
 }
 
-static void ASL(CPU* cpu, uint16_t op){
-    uint8_t read = memread(cpu, op);
+static FORCE_INLINE void ASL(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
+    uint8_t read = rd(cpu, op);
     set_flag(C, cpu, read & 0x80);
     read <<= 1; /* not flip bind lol */
-    memwrite(cpu, op, read);
+    wr(cpu, op, read);
     update_Z(cpu, read);
     update_N(cpu, read);
 }
 
-static void LSR(CPU* cpu, uint16_t op){
-    uint8_t read = memread(cpu, op);
+static FORCE_INLINE void LSR(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
+    uint8_t read = rd(cpu, op);
     set_flag(C, cpu, read & 1);
     read >>= 1; /* not bind lol */
-    memwrite(cpu, op, read);
+    wr(cpu, op, read);
     update_Z(cpu, read);
     update_N(cpu, read);
 }
 
-static void ROL(CPU* cpu, uint16_t op){
+static FORCE_INLINE void ROL(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
     /* left "rotate", except (post-rotation) bit 0 becomes the old
      * carry and the new carry becomes the bit that was rotated out
      * (pre-rotation bit 7). in other words, the operand is not actually
      * rotated about itself. very misleading use of the term "rotate"... */
-    uint8_t read = memread(cpu, op);
+    uint8_t read = rd(cpu, op);
     bool save_carry = cpu->P & 1;
     set_flag(C, cpu, read & 0x80);
     read <<= 1;
@@ -828,17 +931,17 @@ static void ROL(CPU* cpu, uint16_t op){
         read |= 1;
     else
         read &= ~1;
-    memwrite(cpu, op, read);
+    wr(cpu, op, read);
     update_Z(cpu, read);
     update_N(cpu, read);
 }
 
-static void ROR(CPU* cpu, uint16_t op){
+static FORCE_INLINE void ROR(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
     /* right "rotate", except (post-rotation) bit 7 becomes the old
      * carry and the new carry becomes the bit that was rotated out
      * (pre-rotation bit 0). in other words, the operand is not actually
      * rotated about itself. very misleading use of the term "rotate"... */
-    uint8_t read = memread(cpu, op);
+    uint8_t read = rd(cpu, op);
     bool save_carry = cpu->P & 1;
     set_flag(C, cpu, read & 1);
     read >>= 1;
@@ -846,26 +949,26 @@ static void ROR(CPU* cpu, uint16_t op){
         read |= 0x80;
     else
         read &= ~0x80;
-    memwrite(cpu, op, read);
+    wr(cpu, op, read);
     update_Z(cpu, read);
     update_N(cpu, read);
 }
 
-static void ASL_A(CPU* cpu, uint16_t op){
+static FORCE_INLINE void ASL_A(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
     set_flag(C, cpu, cpu->A & 0x80);
     cpu->A <<= 1; /* not flip bind lol */
     update_Z(cpu, cpu->A);
     update_N(cpu, cpu->A);
 }
 
-static void LSR_A(CPU* cpu, uint16_t op){
+static FORCE_INLINE void LSR_A(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
     set_flag(C, cpu, cpu->A & 1);
     cpu->A >>= 1;
     update_Z(cpu, cpu->A);
     update_N(cpu, cpu->A);
 }
 
-static void ROL_A(CPU* cpu, uint16_t op){
+static FORCE_INLINE void ROL_A(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
     bool save_carry = cpu->P & 1;
     set_flag(C, cpu, cpu->A & 0x80);
     cpu->A <<= 1;
@@ -877,7 +980,7 @@ static void ROL_A(CPU* cpu, uint16_t op){
     update_N(cpu, cpu->A);
 }
 
-static void ROR_A(CPU* cpu, uint16_t op){
+static FORCE_INLINE void ROR_A(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
     bool save_carry = cpu->P & 1;
     set_flag(C, cpu, cpu->A & 1);
     cpu->A >>= 1;
@@ -889,10 +992,168 @@ static void ROR_A(CPU* cpu, uint16_t op){
     update_N(cpu, cpu->A);
 }
 
-static void BRK(CPU* cpu, uint16_t op){
-    return;
+static FORCE_INLINE void BRK(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
+    /* the byte after BRK is skipped, the handler returns past it */
+    cpu->PC++;
+    enter_interrupt(cpu, IRQ, true);
 }
 
-static void NOP(CPU* cpu, uint16_t op){
+static FORCE_INLINE void NOP(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
     return;
 }
+
+/* Unofficial opcodes. Most are two official operations sharing one decode
+   and one memory access, so they're written out instead of calling both */
+
+static FORCE_INLINE void SLO(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
+    /* ASL then ORA */
+    uint8_t read = rd(cpu, op);
+    set_flag(C, cpu, read & 0x80);
+    read <<= 1;
+    wr(cpu, op, read);
+    cpu->A |= read;
+    update_Z(cpu, cpu->A);
+    update_N(cpu, cpu->A);
+}
+
+static FORCE_INLINE void RLA(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
+    /* ROL then AND */
+    uint8_t read = rd(cpu, op);
+    bool save_carry = cpu->P & 1;
+    set_flag(C, cpu, read & 0x80);
+    read = (read << 1) | save_carry;
+    wr(cpu, op, read);
+    cpu->A &= read;
+    update_Z(cpu, cpu->A);
+    update_N(cpu, cpu->A);
+}
+
+static FORCE_INLINE void SRE(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
+    /* LSR then EOR */
+    uint8_t read = rd(cpu, op);
+    set_flag(C, cpu, read & 1);
+    read >>= 1;
+    wr(cpu, op, read);
+    cpu->A ^= read;
+    update_Z(cpu, cpu->A);
+    update_N(cpu, cpu->A);
+}
+
+static FORCE_INLINE void RRA(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
+    /* ROR then ADC, which takes the carry ROR shifted out */
+    uint8_t read = rd(cpu, op);
+    bool save_carry = cpu->P & 1;
+    set_flag(C, cpu, read & 1);
+    read = (read >> 1) | (save_carry << 7);
+    wr(cpu, op, read);
+    xbc(cpu, read, false);
+}
+
+static FORCE_INLINE void DCP(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
+    /* DEC then CMP */
+    uint8_t read = rd(cpu, op) - 1;
+    wr(cpu, op, read);
+    compare(cpu, cpu->A, read);
+}
+
+static FORCE_INLINE void ISB(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
+    /* INC then SBC */
+    uint8_t read = rd(cpu, op) + 1;
+    wr(cpu, op, read);
+    xbc(cpu, read, true);
+}
+
+static FORCE_INLINE void LAX(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
+    load(cpu, &cpu->A, rd(cpu, op));
+    cpu->X = cpu->A;
+}
+
+static FORCE_INLINE void SAX(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
+    wr(cpu, op, cpu->A & cpu->X);
+}
+
+static FORCE_INLINE void ANC(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
+    /* AND, with N copied into C as if the result had been shifted */
+    AND(cpu, op, rd, wr);
+    set_flag(C, cpu, cpu->A & 0x80);
+}
+
+static FORCE_INLINE void ALR(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
+    cpu->A &= rd(cpu, op);
+    LSR_A(cpu, op, rd, wr);
+}
+
+static FORCE_INLINE void ARR(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
+    /* AND then ROR A, but C and V come out of the adder: C is bit 6 of the
+       result and V is bit 6 xor bit 5 */
+    cpu->A &= rd(cpu, op);
+    ROR_A(cpu, op, rd, wr);
+    set_flag(C, cpu, cpu->A & 0x40);
+    set_flag(V, cpu, ((cpu->A >> 6) ^ (cpu->A >> 5)) & 1);
+}
+
+static FORCE_INLINE void AXS(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
+    /* X = (A & X) - operand, flags set like CMP (no borrow in, V kept) */
+    uint8_t ax = cpu->A & cpu->X;
+    uint8_t read = rd(cpu, op);
+    cpu->X = ax - read;
+    set_flag(C, cpu, read <= ax);
+    update_Z(cpu, cpu->X);
+    update_N(cpu, cpu->X);
+}
+
+/* XAA and LXA OR A with a chip (and temperature) dependent constant first,
+   0xEE is what most 2A03s give */
+#define UNSTABLE_MAGIC 0xEE
+
+static FORCE_INLINE void XAA(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
+    cpu->A = (cpu->A | UNSTABLE_MAGIC) & cpu->X & rd(cpu, op);
+    update_Z(cpu, cpu->A);
+    update_N(cpu, cpu->A);
+}
+
+static FORCE_INLINE void LXA(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
+    cpu->A = cpu->X = (cpu->A | UNSTABLE_MAGIC) & rd(cpu, op);
+    update_Z(cpu, cpu->A);
+    update_N(cpu, cpu->A);
+}
+
+static void unstable_store(CPU* cpu, uint16_t op, uint8_t index, uint8_t val){
+    /* SHY/SHX/SHA/TAS store val & (high byte of the base address + 1).
+       When indexing crossed a page that value also replaces the high
+       byte of the address written */
+    uint16_t base = op - index;
+    val &= (base >> 8) + 1;
+    if ((base & 0xFF00) != (op & 0xFF00))
+        op = (val << 8) | (op & 0xFF);
+    memwrite(cpu, op, val);
+}
+
+static FORCE_INLINE void SHY(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
+    unstable_store(cpu, op, cpu->X, cpu->Y);
+}
+
+static FORCE_INLINE void SHX(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
+    unstable_store(cpu, op, cpu->Y, cpu->X);
+}
+
+static FORCE_INLINE void SHA(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
+    unstable_store(cpu, op, cpu->Y, cpu->A & cpu->X);
+}
+
+static FORCE_INLINE void TAS(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
+    cpu->SP = cpu->A & cpu->X;
+    unstable_store(cpu, op, cpu->Y, cpu->SP);
+}
+
+static FORCE_INLINE void LAS(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
+    cpu->A = cpu->X = cpu->SP = rd(cpu, op) & cpu->SP;
+    update_Z(cpu, cpu->A);
+    update_N(cpu, cpu->A);
+}
+
+static FORCE_INLINE void JAM(CPU* cpu, uint16_t op, ReadFn rd, WriteFn wr){
+    /* the CPU locks up until reset. It's modelled as refetching itself
+       so the rest of the machine (and the frame loop) keeps its clock */
+    cpu->PC--;
+}
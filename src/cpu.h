@@ -5,11 +5,16 @@
 #include <stdint.h>
 
 #include "mem.h"
+#include "sched.h"
 
 #define NMI 0xFFFA
 #define RESET 0xFFFC
 #define IRQ 0xFFFE 
 
+/* IRQ line sources */
+#define IRQ_APU 0x01
+#define IRQ_MAPPER 0x02
+
 /* the stack grows down from 0x1FF */
 #define STACK_BOTTOM 0x100
 
@@ -23,10 +28,14 @@
 /* 7 cycles to first instruction to match with nestest log */
 #define STARTUP_CYCLES 7 
 
+/* interrupt entry: 2 dummy reads, 3 pushes, 2 vector reads */
+#define INTERRUPT_CYCLES 7
+
 typedef struct CPU {
 
     /* internal state */
     uint64_t cycles;
+    uint64_t opno; /* instructions executed, numbers the debug trace */
 
     /* registers */
     uint8_t A, X, Y, P, SP;
@@ -34,11 +43,20 @@ typedef struct CPU {
 
     /* memory */
     Memory* mem;
+    uint8_t* ram; /* internal RAM, zero page and stack accesses skip the map. NULL
+                     while they can't, see debugger.h */
+
+    /* interrupt lines, driven from scheduler events. Nothing polls them
+       per instruction, whoever changes them schedules EVENT_INTERRUPT */
+    bool nmi; /* edge latched, waiting to be taken */
+    uint8_t irq; /* level, one bit per source */
+    Scheduler* sched;
     
 } CPU;
 
-CPU make_cpu(Memory*);
+CPU make_cpu(Memory*, Scheduler*);
 void reset(CPU*);
 void FDE(CPU*);
+bool cpu_interrupt(CPU*);
 
 #endif
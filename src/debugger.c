@@ -0,0 +1,106 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "debugger.h"
+#include "nes.h"
+#include "util.h"
+
+static bool watch_exec(void*, uint16_t);
+static uint8_t watch_read(void*, uint16_t, bool);
+static void watch_write(void*, uint16_t, uint8_t);
+static void stop(NES*, uint8_t, uint16_t, uint8_t);
+
+void set_breakpoint(NES* nes, uint16_t addr, uint8_t kinds){
+    /* kinds (BREAK_*) replace whatever addr had, 0 clears it. Mappers
+       that change write policies must go around watched pages */
+    Debugger* d = nes->debugger;
+    if (d == NULL){
+        d = nes->debugger = xalloc(1, sizeof(Debugger), calloc);
+        nes->mem.watch = nes;
+        nes->mem.watch_exec = watch_exec;
+        nes->mem.watch_read = watch_read;
+        nes->mem.watch_write = watch_write;
+    }
+    int page = addr >> PAGE_SHIFT;
+    bool had = d->points[addr] != 0;
+    d->points[addr] = kinds;
+    if (had == (kinds != 0))
+        return;
+    if (kinds != 0 && d->count[page]++ == 0){
+        d->policy[page] = nes->mem.write_policy[page];
+        nes->mem.write_policy[page] = PAGE_WATCH;
+    }
+    else if (kinds == 0 && --d->count[page] == 0)
+        nes->mem.write_policy[page] = d->policy[page];
+    if (page < 2)
+        nes->cpu.ram = d->count[0] || d->count[1] ? NULL : nes->mem.map[0];
+}
+
+void debug_dump(const NES* nes, FILE* f){
+    /* the stop, then CPU and PPU registers on one line each */
+    const CPU* cpu = &nes->cpu;
+    const PPU* ppu = &nes->ppu;
+    const DebugStop* s = &nes->debugger->stop;
+    const char* kind = s->kind == BREAK_EXEC ? "exec" : s->kind == BREAK_READ ? "read" : "write";
+    uint64_t dot = cpu->cycles * PPU_DOTS_PER_CPU_CYCLE - nes->frames * PPU_DOTS_PER_FRAME;
+    fprintf(f, "%s $%04X = $%02X, frame %lu scanline %lu dot %lu\n", kind, s->addr, s->val,
+            nes->frames, dot / PPU_DOTS_PER_LINE, dot % PPU_DOTS_PER_LINE);
+    fprintf(f, "  CPU PC:%04X A:%02X X:%02X Y:%02X P:%02X SP:%02X CYC:%lu NMI:%d IRQ:%02X\n",
+            cpu->PC, cpu->A, cpu->X, cpu->Y, cpu->P, cpu->SP, cpu->cycles, cpu->nmi, cpu->irq);
+    fprintf(f, "  PPU CTRL:%02X MASK:%02X STATUS:%02X OAMADDR:%02X v:%04X t:%04X x:%d w:%d\n",
+            ppu->ppuctrl, ppu->ppumask, ppu->ppustatus, ppu->oamaddr, ppu->v, ppu->t, ppu->x, ppu->w);
+}
+
+static bool watch_exec(void* ctx, uint16_t pc){
+    /* false stops before the instruction at pc. Once stopped there, it
+       runs when the CPU next gets to it without having moved */
+    NES* nes = ctx;
+    Debugger* d = nes->debugger;
+    if (!(d->points[pc] & BREAK_EXEC) || nes->hidden)
+        return true;
+    if (d->resume_pc == pc && d->resume_cycle == nes->cpu.cycles)
+        return true;
+    stop(nes, BREAK_EXEC, pc, *(nes->mem.map[pc]));
+    d->resume_pc = pc;
+    d->resume_cycle = nes->cpu.cycles;
+    return false;
+}
+
+static uint8_t watch_read(void* ctx, uint16_t addr, bool data){
+    /* any read from a watched page. data is false for instruction bytes */
+    NES* nes = ctx;
+    Debugger* d = nes->debugger;
+    Memory* mem = &nes->mem;
+    uint8_t val = d->policy[addr >> PAGE_SHIFT] == PAGE_IO ? mem->io_read(mem->io, addr) : *(mem->map[addr]);
+    if (data && (d->points[addr] & BREAK_READ))
+        stop(nes, BREAK_READ, addr, val);
+    return val;
+}
+
+static void watch_write(void* ctx, uint16_t addr, uint8_t val){
+    /* memwrite for the page's own policy */
+    NES* nes = ctx;
+    Debugger* d = nes->debugger;
+    Memory* mem = &nes->mem;
+    switch (d->policy[addr >> PAGE_SHIFT]){
+        case PAGE_RAM: *(mem->map[addr]) = val; break;
+        case PAGE_ROM: break;
+        case PAGE_MAPPER: mem->mapper_write(mem->mapper, addr, val); break;
+        case PAGE_IO: mem->io_write(mem->io, addr, val); break;
+    }
+    if (d->points[addr] & BREAK_WRITE)
+        stop(nes, BREAK_WRITE, addr, val);
+}
+
+static void stop(NES* nes, uint8_t kind, uint16_t addr, uint8_t val){
+    /* the run loop leaves at the next event check, which comes right
+       after the current instruction */
+    if (nes->hidden || nes->stopped)
+        return;
+    nes->stopped = true;
+    nes->debugger->stop = (DebugStop){ kind, addr, val, nes->cpu.cycles };
+    nes->debugger->stops++;
+    sched_set(&nes->sched, EVENT_BREAK, nes->cpu.cycles);
+}
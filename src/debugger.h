@@ -0,0 +1,42 @@
+#ifndef DEBUGGER_H
+#define DEBUGGER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "mem.h"
+
+/* Breakpoints and watchpoints. Pages holding one are PAGE_WATCH, so only
+   accesses to them leave the fast path, and $0000-$01FF is taken off the
+   CPU's internal RAM shortcut while it has any. Nothing is checked per
+   instruction. A hit stops run_frame after the instruction that made the
+   access, or before the instruction at a breakpoint. OAM DMA reads count
+   as reads. Hidden frames (run-ahead, rollback) never stop */
+
+#define BREAK_EXEC 0x01
+#define BREAK_READ 0x02
+#define BREAK_WRITE 0x04
+
+typedef struct DebugStop{
+    uint8_t kind; /* the BREAK_* that was hit */
+    uint16_t addr;
+    uint8_t val; /* read or written, the opcode for BREAK_EXEC */
+    uint64_t cycle;
+} DebugStop;
+
+typedef struct Debugger{
+    uint8_t points[CPU_MEM_SIZE]; /* BREAK_* per address */
+    uint16_t count[CPU_PAGES]; /* addresses with points in each page */
+    uint8_t policy[CPU_PAGES]; /* what each PAGE_WATCH page was before */
+    DebugStop stop; /* the first hit of the last stop */
+    uint64_t stops;
+    uint64_t resume_cycle; /* a breakpoint let through once, so a stopped run can go on */
+    uint16_t resume_pc;
+} Debugger;
+
+struct NES;
+void set_breakpoint(struct NES*, uint16_t, uint8_t);
+void debug_dump(const struct NES*, FILE*);
+
+#endif
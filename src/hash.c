@@ -0,0 +1,148 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hash.h"
+#include "util.h"
+
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+
+static uint64_t rotl(uint64_t x, int r){
+    return (x << r) | (x >> (64 - r));
+}
+
+static uint64_t read64(const uint8_t* p){
+    /* little-endian host assumed, memcpy compiles to a single load */
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint32_t read32(const uint8_t* p){
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint64_t round64(uint64_t acc, uint64_t input){
+    acc += input * PRIME64_2;
+    acc = rotl(acc, 31);
+    return acc * PRIME64_1;
+}
+
+static uint64_t merge64(uint64_t acc, uint64_t val){
+    acc ^= round64(0, val);
+    return acc * PRIME64_1 + PRIME64_4;
+}
+
+uint64_t hash64(const void* data, size_t len, uint64_t seed){
+    const uint8_t* p = data;
+    const uint8_t* end = p + len;
+    uint64_t h;
+
+    if (len >= 32){
+        /* four independent lanes over 32 byte stripes, no dependency between
+           lanes so they pipeline (and vectorize) well */
+        uint64_t v1 = seed + PRIME64_1 + PRIME64_2;
+        uint64_t v2 = seed + PRIME64_2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - PRIME64_1;
+        const uint8_t* limit = end - 32;
+        do {
+            v1 = round64(v1, read64(p));
+            v2 = round64(v2, read64(p + 8));
+            v3 = round64(v3, read64(p + 16));
+            v4 = round64(v4, read64(p + 24));
+            p += 32;
+        } while (p <= limit);
+        h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        h = merge64(h, v1);
+        h = merge64(h, v2);
+        h = merge64(h, v3);
+        h = merge64(h, v4);
+    }
+    else
+        h = seed + PRIME64_5;
+
+    h += len;
+
+    for (; p + 8 <= end; p += 8){
+        h ^= round64(0, read64(p));
+        h = rotl(h, 27) * PRIME64_1 + PRIME64_4;
+    }
+    if (p + 4 <= end){
+        h ^= (uint64_t) read32(p) * PRIME64_1;
+        h = rotl(h, 23) * PRIME64_2 + PRIME64_3;
+        p += 4;
+    }
+    for (; p < end; ++p){
+        h ^= (*p) * PRIME64_5;
+        h = rotl(h, 11) * PRIME64_1;
+    }
+
+    /* avalanche */
+    h ^= h >> 33;
+    h *= PRIME64_2;
+    h ^= h >> 29;
+    h *= PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+HashLog* make_hashlog(void){
+    HashLog* log = xalloc(1, sizeof(HashLog), calloc);
+    return log;
+}
+
+void free_hashlog(HashLog* log){
+    if (log == NULL) return;
+    free(log->hashes);
+    free(log);
+}
+
+void hashlog_append(HashLog* log, uint64_t h){
+    if (log->n == log->cap){
+        log->cap = log->cap ? log->cap * 2 : 4096;
+        log->hashes = realloc(log->hashes, log->cap * sizeof(uint64_t));
+        if (log->hashes == NULL)
+            err_exit("Hash: Failed to grow frame hash log to %lu entries", log->cap);
+    }
+    log->hashes[log->n++] = h;
+}
+
+void hashlog_write(const HashLog* log, const char* filename){
+    /* raw little-endian uint64 per frame, no header */
+    FILE* f = fopen(filename, "wb");
+    if (f == NULL)
+        err_exit("Hash: Couldn't open %s for writing", filename);
+    if (fwrite(log->hashes, sizeof(uint64_t), log->n, f) != log->n)
+        err_exit("Hash: Short write to %s", filename);
+    fclose(f);
+}
+
+HashLog* hashlog_read(const char* filename){
+    FILE* f = fopen(filename, "rb");
+    if (f == NULL)
+        err_exit("Hash: Couldn't open %s", filename);
+    HashLog* log = make_hashlog();
+    uint64_t h;
+    while (fread(&h, sizeof(h), 1, f) == 1)
+        hashlog_append(log, h);
+    fclose(f);
+    return log;
+}
+
+int64_t hashlog_diverge(const HashLog* a, const HashLog* b){
+    size_t n = a->n < b->n ? a->n : b->n;
+    for (size_t i = 0; i < n; ++i){
+        if (a->hashes[i] != b->hashes[i])
+            return i;
+    }
+    /* one log running longer is not a divergence */
+    return -1;
+}
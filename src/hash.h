@@ -0,0 +1,25 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* 64-bit non-cryptographic hash (XXH64 algorithm). Used to fingerprint
+   emulator state, equal inputs always give equal hashes on every build */
+uint64_t hash64(const void*, size_t, uint64_t);
+
+/* append-only log of one hash per frame, for comparing two runs */
+typedef struct HashLog{
+    uint64_t* hashes;
+    size_t n;
+    size_t cap;
+} HashLog;
+
+HashLog* make_hashlog(void);
+void free_hashlog(HashLog*);
+void hashlog_append(HashLog*, uint64_t);
+void hashlog_write(const HashLog*, const char*);
+HashLog* hashlog_read(const char*);
+int64_t hashlog_diverge(const HashLog*, const HashLog*); /* first differing frame, -1 if none */
+
+#endif
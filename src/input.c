@@ -0,0 +1,103 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "input.h"
+#include "util.h"
+
+/* bits 5-7 of a controller read are open bus, normally the high byte of
+   $4016/$4017 */
+#define OPEN_BUS 0x40
+
+Controller make_controller(const uint8_t* buttons){
+    Controller pad = { buttons, 0, false };
+    return pad;
+}
+
+void controller_write(Controller* pad, uint8_t val){
+    pad->strobe = val & 1;
+    /* the shift register reloads continuously while strobe is high, so the
+       falling edge latches whatever the buttons were */
+    if (pad->strobe)
+        pad->shift = *(pad->buttons);
+}
+
+uint8_t controller_read(Controller* pad){
+    if (pad->strobe)
+        return OPEN_BUS | (*(pad->buttons) & 1);
+    uint8_t bit = pad->shift & 1;
+    /* official controllers return 1 once all 8 buttons have been read */
+    pad->shift = (pad->shift >> 1) | 0x80;
+    return OPEN_BUS | bit;
+}
+
+Movie* make_movie(uint8_t ports){
+    Movie* movie = xalloc(1, sizeof(Movie), calloc);
+    movie->mode = MOVIE_RECORD;
+    movie->ports = ports;
+    return movie;
+}
+
+void free_movie(Movie* movie){
+    if (movie == NULL) return;
+    free(movie->input);
+    free(movie);
+}
+
+void movie_record(Movie* movie, const uint8_t* input){
+    if (movie->frames == movie->cap){
+        movie->cap = movie->cap ? movie->cap * 2 : 3600;
+        movie->input = realloc(movie->input, (size_t) movie->cap * movie->ports);
+        if (movie->input == NULL)
+            err_exit("Movie: Failed to grow movie to %u frames", movie->cap);
+    }
+    memcpy(movie->input + (size_t) movie->frames * movie->ports, input, movie->ports);
+    movie->frames++;
+}
+
+bool movie_play(Movie* movie, uint8_t* input){
+    if (movie_done(movie))
+        return false;
+    memcpy(input, movie->input + (size_t) movie->cursor * movie->ports, movie->ports);
+    movie->cursor++;
+    return true;
+}
+
+bool movie_done(const Movie* movie){
+    return movie->cursor >= movie->frames;
+}
+
+void movie_save(const Movie* movie, const char* filename){
+    FILE* f = fopen(filename, "wb");
+    if (f == NULL)
+        err_exit("Movie: Couldn't open %s for writing", filename);
+    uint8_t header[MOVIE_HEADER_LEN] = { 0 };
+    memcpy(header, MOVIE_MAGIC, 4);
+    header[4] = movie->ports;
+    for (int i = 0; i < 4; ++i)
+        header[8 + i] = movie->frames >> (8 * i);
+    size_t len = (size_t) movie->frames * movie->ports;
+    bool written = fwrite(header, 1, MOVIE_HEADER_LEN, f) == MOVIE_HEADER_LEN && fwrite(movie->input, 1, len, f) == len;
+    if (fclose(f) != 0 || !written)
+        err_exit("Movie: Short write to %s", filename);
+}
+
+Movie* movie_load(const char* filename){
+    FILE* f = fopen(filename, "rb");
+    if (f == NULL)
+        err_exit("Movie: Couldn't open %s", filename);
+    uint8_t header[MOVIE_HEADER_LEN];
+    if (fread(header, 1, MOVIE_HEADER_LEN, f) != MOVIE_HEADER_LEN || memcmp(header, MOVIE_MAGIC, 4) != 0)
+        err_exit("Movie: %s is not a movie file", filename);
+
+    Movie* movie = make_movie(header[4]);
+    movie->mode = MOVIE_PLAYBACK;
+    movie->frames = header[8] | (header[9] << 8) | (header[10] << 16) | ((uint32_t) header[11] << 24);
+    movie->cap = movie->frames;
+    size_t len = (size_t) movie->frames * movie->ports;
+    movie->input = xalloc(len ? len : 1, sizeof(uint8_t), twoarg_malloc);
+    if (fread(movie->input, 1, len, f) != len)
+        err_exit("Movie: %s is shorter than its %u frame header", filename, movie->frames);
+    fclose(f);
+    return movie;
+}
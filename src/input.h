@@ -0,0 +1,51 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* standard controller button bits, in the order they're shifted out */
+#define BUTTON_A 0x01
+#define BUTTON_B 0x02
+#define BUTTON_SELECT 0x04
+#define BUTTON_START 0x08
+#define BUTTON_UP 0x10
+#define BUTTON_DOWN 0x20
+#define BUTTON_LEFT 0x40
+#define BUTTON_RIGHT 0x80
+
+typedef struct Controller{
+    const uint8_t* buttons; /* live button state, owned by the host */
+    uint8_t shift; /* latched buttons, shifted out one bit per read */
+    bool strobe; /* while set, reads keep returning the live A button */
+} Controller;
+
+Controller make_controller(const uint8_t*);
+void controller_write(Controller*, uint8_t); /* $4016 write */
+uint8_t controller_read(Controller*); /* $4016/$4017 read */
+
+/* Input movie: 12 byte header ("NMV\x1A", port count, 3 reserved, frame
+   count as little-endian uint32) followed by one byte per port per frame */
+#define MOVIE_MAGIC "NMV\x1A"
+#define MOVIE_HEADER_LEN 12
+
+typedef enum MovieMode{ MOVIE_RECORD, MOVIE_PLAYBACK } MovieMode;
+
+typedef struct Movie{
+    MovieMode mode;
+    uint8_t ports;
+    uint32_t frames; /* frames held in input */
+    uint32_t cursor; /* next frame to play back */
+    uint32_t cap;
+    uint8_t* input; /* frames * ports bytes */
+} Movie;
+
+Movie* make_movie(uint8_t);
+void free_movie(Movie*);
+void movie_record(Movie*, const uint8_t*);
+bool movie_play(Movie*, uint8_t*);
+bool movie_done(const Movie*);
+void movie_save(const Movie*, const char*);
+Movie* movie_load(const char*);
+
+#endif
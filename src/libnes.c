@@ -0,0 +1,171 @@
+#include <setjmp.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "libnes.h"
+#include "analyze.h"
+#include "nes.h"
+#include "rom.h"
+#include "util.h"
+
+#define STATE_MAGIC "NST\x1A"
+
+_Static_assert(LIBNES_WIDTH == FRAME_WIDTH && LIBNES_HEIGHT == FRAME_HEIGHT, "frame size");
+_Static_assert(LIBNES_SAMPLE_RATE == APU_SAMPLE_RATE, "sample rate");
+_Static_assert(LIBNES_RAM_SIZE == RAM_SIZE && LIBNES_PORTS == CONTROLLER_PORTS, "RAM and ports");
+_Static_assert(LIBNES_A == BUTTON_A && LIBNES_RIGHT == BUTTON_RIGHT, "button bits");
+
+/* saved states: the magic, the PRG hash of the ROM, then the Snapshot */
+typedef struct State{
+    char magic[4];
+    uint32_t size; /* sizeof(State), differs between builds that differ */
+    uint64_t prg_hash;
+    Snapshot snapshot;
+} State;
+
+unsigned libnes_version(void){
+    return LIBNES_VERSION;
+}
+
+/* Every call that can fail inside the core traps err_exit, which would
+   otherwise end the host. A machine whose run failed half way is marked
+   and refuses to run or load again, it can still be destroyed */
+
+NES* libnes_create(const void* rom, size_t size, const char** error){
+    const char* problem = rom == NULL ? "no ROM" : probe_rom_image(rom, size);
+    if (error != NULL)
+        *error = problem;
+    if (problem != NULL)
+        return NULL;
+    NES* volatile nes = NULL;
+    jmp_buf trap;
+    if (setjmp(trap) != 0){
+        err_trap = NULL;
+        if (nes != NULL)
+            power_off(nes);
+        if (error != NULL)
+            *error = err_message;
+        return NULL;
+    }
+    err_trap = &trap;
+    nes = power_on_image(rom, size);
+    set_render_mode(nes, RENDER_INLINE); /* frames on time, drawn on the caller's thread */
+    err_trap = NULL;
+    return nes;
+}
+
+void libnes_destroy(NES* nes){
+    if (nes != NULL)
+        power_off(nes);
+}
+
+int libnes_run_frame(NES* nes){
+    if (nes == NULL || nes->failed)
+        return 0;
+    jmp_buf trap;
+    if (setjmp(trap) != 0){
+        err_trap = NULL;
+        nes->failed = true;
+        return 0;
+    }
+    err_trap = &trap;
+    run_frame(nes);
+    err_trap = NULL;
+    return 1;
+}
+
+int libnes_run_cycles(NES* nes, uint64_t cycles){
+    if (nes == NULL || nes->failed)
+        return 0;
+    jmp_buf trap;
+    if (setjmp(trap) != 0){
+        err_trap = NULL;
+        nes->failed = true;
+        return 0;
+    }
+    err_trap = &trap;
+    run_cycles(nes, cycles);
+    err_trap = NULL;
+    return 1;
+}
+
+uint64_t libnes_frame_count(const NES* nes){
+    return nes->frames;
+}
+
+uint64_t libnes_cycle_count(const NES* nes){
+    return nes->cpu.cycles;
+}
+
+void libnes_set_input(NES* nes, unsigned port, uint8_t buttons){
+    if (port < CONTROLLER_PORTS)
+        nes->input[port] = buttons;
+}
+
+const uint8_t* libnes_framebuffer(const NES* nes){
+    return nes->ppu.framebuffer;
+}
+
+const uint8_t* libnes_palette(void){
+    return PALETTE_RGB[0];
+}
+
+const int16_t* libnes_audio(const NES* nes, size_t* count){
+    *count = nes->apu.nsamples;
+    return nes->apu.samples;
+}
+
+uint8_t* libnes_ram(NES* nes){
+    return nes_ram(nes);
+}
+
+int libnes_record_movie(NES* nes){
+    if (nes == NULL || nes->failed)
+        return 0;
+    jmp_buf trap;
+    if (setjmp(trap) != 0){
+        err_trap = NULL;
+        return 0;
+    }
+    err_trap = &trap;
+    attach_movie(nes, make_movie(CONTROLLER_PORTS));
+    err_trap = NULL;
+    return 1;
+}
+
+int libnes_save_movie(const NES* nes, const char* filename){
+    if (nes == NULL || nes->movie == NULL || nes->movie->mode != MOVIE_RECORD)
+        return 0;
+    jmp_buf trap;
+    if (setjmp(trap) != 0){
+        err_trap = NULL;
+        return 0;
+    }
+    err_trap = &trap;
+    movie_save(nes->movie, filename);
+    err_trap = NULL;
+    return 1;
+}
+
+size_t libnes_state_size(void){
+    return sizeof(State);
+}
+
+void libnes_save_state(const NES* nes, void* buffer){
+    State* state = buffer;
+    memcpy(state->magic, STATE_MAGIC, 4);
+    state->size = sizeof(State);
+    state->prg_hash = prg_hash(&nes->mem);
+    save_state(nes, &state->snapshot);
+}
+
+int libnes_load_state(NES* nes, const void* buffer, size_t size){
+    const State* state = buffer;
+    if (nes->failed || size != sizeof(State) || memcmp(state->magic, STATE_MAGIC, 4) != 0
+        || state->size != sizeof(State) || state->prg_hash != prg_hash(&nes->mem))
+        return 0;
+    load_state(nes, &state->snapshot);
+    render_sync(nes->renderer, &nes->ppu);
+    return 1;
+}
@@ -0,0 +1,75 @@
+#ifndef LIBNES_H
+#define LIBNES_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Embedding API, the only header a program linking libnes.a or libnes.so
+   needs. Each NES is its own handle with nothing shared between them, so
+   any number can run at once, each used by one thread at a time. Calls
+   and their meaning stay the same while LIBNES_VERSION does */
+
+#define LIBNES_VERSION 1
+
+/* the library is built with everything else hidden */
+#define LIBNES_API __attribute__((visibility("default")))
+
+#define LIBNES_WIDTH 256
+#define LIBNES_HEIGHT 240
+#define LIBNES_SAMPLE_RATE 44100 /* mono signed 16 bit */
+#define LIBNES_RAM_SIZE 0x800
+#define LIBNES_PORTS 2
+
+/* controller buttons, ORed together per port */
+#define LIBNES_A 0x01
+#define LIBNES_B 0x02
+#define LIBNES_SELECT 0x04
+#define LIBNES_START 0x08
+#define LIBNES_UP 0x10
+#define LIBNES_DOWN 0x20
+#define LIBNES_LEFT 0x40
+#define LIBNES_RIGHT 0x80
+
+typedef struct NES NES;
+
+LIBNES_API unsigned libnes_version(void);
+
+/* an iNES image, copied. NULL when it can't be run or the machine
+   couldn't be made, *error (if error isn't NULL) then says why, valid
+   until the next failing call on this thread. No call ends the process */
+LIBNES_API NES* libnes_create(const void*, size_t, const char**);
+LIBNES_API void libnes_destroy(NES*);
+
+/* both return 1, or 0 for a bad argument or when the run failed (out of
+   memory). A failed NES won't run or load states again, only destroy it */
+LIBNES_API int libnes_run_frame(NES*);
+LIBNES_API int libnes_run_cycles(NES*, uint64_t); /* at least this many CPU cycles */
+LIBNES_API uint64_t libnes_frame_count(const NES*);
+LIBNES_API uint64_t libnes_cycle_count(const NES*);
+
+/* buttons held from now on */
+LIBNES_API void libnes_set_input(NES*, unsigned, uint8_t);
+
+/* owned by the NES, valid until the next run or destroy. The framebuffer
+   is a palette index (0-63) per pixel, libnes_palette has their RGB */
+LIBNES_API const uint8_t* libnes_framebuffer(const NES*);
+LIBNES_API const uint8_t* libnes_palette(void); /* 64 R, G, B triples */
+LIBNES_API const int16_t* libnes_audio(const NES*, size_t*); /* the last frame's samples */
+LIBNES_API uint8_t* libnes_ram(NES*); /* writable */
+
+/* input movies in the format nes.out -P plays back. Recording starts
+   over at every call and takes the input each later frame runs with.
+   Saving writes what's recorded so far. Both return 1, or 0 when that
+   fails, saving also when nothing is being recorded */
+LIBNES_API int libnes_record_movie(NES*);
+LIBNES_API int libnes_save_movie(const NES*, const char*);
+
+/* states are libnes_state_size bytes, in buffers aligned like malloc's,
+   and load into any NES running the same ROM from the same build of the
+   library. Loading returns 0 and changes nothing when the buffer isn't
+   such a state or the NES has failed */
+LIBNES_API size_t libnes_state_size(void);
+LIBNES_API void libnes_save_state(const NES*, void*);
+LIBNES_API int libnes_load_state(NES*, const void*, size_t);
+
+#endif
@@ -0,0 +1,293 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "libnes.h"
+
+/* Checks the libnes API from outside, linked against either library.
+   The ROM is built here: NROM-128, palette and nametable filled, NMI on
+   and rendering on, a busy loop over zero page, and an NMI handler that
+   reads pad 1 into $01, counts frames in $00 and scrolls by the pad */
+
+#define INES_SIZE (16 + 0x4000 + 0x2000)
+
+static const uint8_t PROGRAM[] = {
+    0x78,                   /* reset: SEI */
+    0xD8,                   /* CLD */
+    0xA2, 0xFF,             /* LDX #$FF */
+    0x9A,                   /* TXS */
+    0xAD, 0x02, 0x20,       /* LDA $2002 */
+    0xA9, 0x3F,             /* LDA #$3F */
+    0x8D, 0x06, 0x20,       /* STA $2006 */
+    0xA9, 0x00,             /* LDA #$00 */
+    0x8D, 0x06, 0x20,       /* STA $2006 */
+    0xA2, 0x00,             /* LDX #$00 */
+    0x8A,                   /* palette: TXA */
+    0x8D, 0x07, 0x20,       /* STA $2007 */
+    0xE8,                   /* INX */
+    0xE0, 0x20,             /* CPX #$20 */
+    0xD0, 0xF7,             /* BNE palette */
+    0xA9, 0x20,             /* LDA #$20 */
+    0x8D, 0x06, 0x20,       /* STA $2006 */
+    0xA9, 0x00,             /* LDA #$00 */
+    0x8D, 0x06, 0x20,       /* STA $2006 */
+    0xA0, 0x04,             /* LDY #$04 */
+    0x8A,                   /* tiles: TXA */
+    0x8D, 0x07, 0x20,       /* STA $2007 */
+    0xE8,                   /* INX */
+    0xD0, 0xF9,             /* BNE tiles */
+    0x88,                   /* DEY */
+    0xD0, 0xF6,             /* BNE tiles */
+    0x8D, 0x05, 0x20,       /* STA $2005 */
+    0x8D, 0x05, 0x20,       /* STA $2005 */
+    0xA9, 0x80,             /* LDA #$80 */
+    0x8D, 0x00, 0x20,       /* STA $2000 */
+    0xA9, 0x1E,             /* LDA #$1E */
+    0x8D, 0x01, 0x20,       /* STA $2001 */
+    0xE6, 0x10,             /* main: INC $10 */
+    0xA5, 0x10,             /* LDA $10 */
+    0x65, 0x11,             /* ADC $11 */
+    0x85, 0x11,             /* STA $11 */
+    0x4C, 0x43, 0xC0,       /* JMP main */
+    0xA9, 0x01,             /* nmi: LDA #$01 */
+    0x8D, 0x16, 0x40,       /* STA $4016 */
+    0xA9, 0x00,             /* LDA #$00 */
+    0x8D, 0x16, 0x40,       /* STA $4016 */
+    0xA2, 0x08,             /* LDX #$08 */
+    0xAD, 0x16, 0x40,       /* pad: LDA $4016 */
+    0x4A,                   /* LSR */
+    0x26, 0x01,             /* ROL $01 */
+    0xCA,                   /* DEX */
+    0xD0, 0xF7,             /* BNE pad */
+    0xE6, 0x00,             /* INC $00 */
+    0xA5, 0x01,             /* LDA $01 */
+    0x8D, 0x05, 0x20,       /* STA $2005 */
+    0x8D, 0x05, 0x20,       /* STA $2005 */
+    0x40,                   /* RTI */
+};
+#define NMI_HANDLER 0xC04E
+#define RESET_HANDLER 0xC000
+
+static int failures;
+
+#define CHECK(cond) check(cond, #cond, __LINE__)
+
+static void check(bool ok, const char* what, int line){
+    if (!ok){
+        fprintf(stderr, "libtest:%d: %s\n", line, what);
+        ++failures;
+    }
+}
+
+static uint8_t* make_rom(void){
+    uint8_t* rom = calloc(INES_SIZE, 1);
+    memcpy(rom, "NES\x1A", 4);
+    rom[4] = 1; /* 16K PRG */
+    rom[5] = 1; /* 8K CHR */
+    uint8_t* prg = rom + 16;
+    memcpy(prg, PROGRAM, sizeof(PROGRAM));
+    prg[0x3FFA] = NMI_HANDLER & 0xFF;
+    prg[0x3FFB] = NMI_HANDLER >> 8;
+    prg[0x3FFC] = prg[0x3FFE] = RESET_HANDLER & 0xFF;
+    prg[0x3FFD] = prg[0x3FFF] = RESET_HANDLER >> 8;
+    for (int i = 0; i < 0x2000; ++i)
+        prg[0x4000 + i] = i * 7 + (i >> 4); /* CHR */
+    return rom;
+}
+
+static uint8_t input(uint64_t frame){
+    return (frame / 5) * 37;
+}
+
+static void run_to(NES* nes, uint64_t frames){
+    while (libnes_frame_count(nes) < frames){
+        libnes_set_input(nes, 0, input(libnes_frame_count(nes)));
+        CHECK(libnes_run_frame(nes) == 1);
+    }
+}
+
+static bool same_machine(NES* a, NES* b){
+    return libnes_frame_count(a) == libnes_frame_count(b)
+        && libnes_cycle_count(a) == libnes_cycle_count(b)
+        && memcmp(libnes_ram(a), libnes_ram(b), LIBNES_RAM_SIZE) == 0
+        && memcmp(libnes_framebuffer(a), libnes_framebuffer(b), LIBNES_WIDTH * LIBNES_HEIGHT) == 0;
+}
+
+static void test_rejects(const uint8_t* rom){
+    const char* error = NULL;
+    CHECK(libnes_create(NULL, 0, &error) == NULL && error != NULL);
+    error = NULL;
+    CHECK(libnes_create(rom, 8, &error) == NULL && error != NULL);
+    error = NULL;
+    CHECK(libnes_create(rom, INES_SIZE - 1, &error) == NULL && error != NULL);
+    uint8_t* bad = malloc(INES_SIZE);
+    memcpy(bad, rom, INES_SIZE);
+    bad[0] = 'X';
+    error = NULL;
+    CHECK(libnes_create(bad, INES_SIZE, &error) == NULL && error != NULL);
+    memcpy(bad, rom, INES_SIZE);
+    bad[6] = 0x10; /* mapper 1 */
+    error = NULL;
+    CHECK(libnes_create(bad, INES_SIZE, &error) == NULL && error != NULL);
+    free(bad);
+    CHECK(libnes_run_frame(NULL) == 0);
+    CHECK(libnes_run_cycles(NULL, 100) == 0);
+}
+
+static void test_run(const uint8_t* rom){
+    const char* error = "unset";
+    NES* nes = libnes_create(rom, INES_SIZE, &error);
+    CHECK(nes != NULL && error == NULL);
+    if (nes == NULL)
+        return;
+    run_to(nes, 60);
+    CHECK(libnes_frame_count(nes) == 60);
+    uint8_t* ram = libnes_ram(nes);
+    CHECK(ram[0] > 50); /* NMIs counted */
+    CHECK(ram[0x10] != 0);
+
+    /* drawn, and not one colour */
+    const uint8_t* frame = libnes_framebuffer(nes);
+    bool varied = false;
+    for (int i = 1; i < LIBNES_WIDTH * LIBNES_HEIGHT; ++i)
+        varied |= frame[i] != frame[0];
+    CHECK(varied);
+    size_t samples = 0;
+    CHECK(libnes_audio(nes, &samples) != NULL && samples > 700 && samples < 800);
+
+    /* pad bits come out reversed by the ROL loop */
+    libnes_set_input(nes, 0, LIBNES_A);
+    libnes_set_input(nes, LIBNES_PORTS, 0xFF); /* ignored */
+    libnes_run_frame(nes);
+    libnes_run_frame(nes);
+    CHECK(ram[1] == 0x80);
+    libnes_destroy(nes);
+    libnes_destroy(NULL);
+}
+
+static void test_states(const uint8_t* rom){
+    NES* a = libnes_create(rom, INES_SIZE, NULL);
+    NES* b = libnes_create(rom, INES_SIZE, NULL);
+    run_to(a, 30);
+    void* state = malloc(libnes_state_size());
+    libnes_save_state(a, state);
+    run_to(a, 90);
+
+    /* into another instance, which then keeps up with a */
+    run_to(b, 7);
+    CHECK(libnes_load_state(b, state, libnes_state_size()) == 1);
+    CHECK(libnes_frame_count(b) == 30);
+    run_to(b, 90);
+    CHECK(same_machine(a, b));
+
+    /* and back into the one that saved it */
+    CHECK(libnes_load_state(a, state, libnes_state_size()) == 1);
+    run_to(a, 90);
+    CHECK(same_machine(a, b));
+
+    CHECK(libnes_load_state(b, state, libnes_state_size() - 1) == 0);
+    uint8_t* bad = malloc(libnes_state_size());
+    memcpy(bad, state, libnes_state_size());
+    bad[0] ^= 0xFF;
+    CHECK(libnes_load_state(b, bad, libnes_state_size()) == 0);
+    CHECK(libnes_frame_count(b) == 90);
+
+    /* a different ROM won't take it */
+    uint8_t* other = malloc(INES_SIZE);
+    memcpy(other, rom, INES_SIZE);
+    other[16 + 0x1000] ^= 1;
+    NES* c = libnes_create(other, INES_SIZE, NULL);
+    CHECK(c != NULL && libnes_load_state(c, state, libnes_state_size()) == 0);
+    libnes_destroy(c);
+
+    free(other);
+    free(bad);
+    free(state);
+    libnes_destroy(a);
+    libnes_destroy(b);
+}
+
+static void test_cycles(const uint8_t* rom){
+    /* run_cycles to where run_frame stopped ends in the same place */
+    NES* a = libnes_create(rom, INES_SIZE, NULL);
+    NES* b = libnes_create(rom, INES_SIZE, NULL);
+    for (int i = 0; i < 10; ++i){
+        libnes_run_frame(a);
+        uint64_t target = libnes_cycle_count(a);
+        CHECK(libnes_run_cycles(b, target - libnes_cycle_count(b)) == 1);
+        CHECK(same_machine(a, b));
+    }
+    uint64_t before = libnes_cycle_count(b);
+    libnes_run_cycles(b, 1000);
+    CHECK(libnes_cycle_count(b) >= before + 1000 && libnes_cycle_count(b) < before + 1010);
+    libnes_destroy(a);
+    libnes_destroy(b);
+}
+
+static void test_movie(const uint8_t* rom){
+    /* the recording holds each frame's input after a 12 byte header */
+    NES* nes = libnes_create(rom, INES_SIZE, NULL);
+    CHECK(libnes_save_movie(nes, "libtest.nmv") == 0);
+    run_to(nes, 5);
+    CHECK(libnes_record_movie(nes) == 1);
+    run_to(nes, 45);
+    char path[] = "/tmp/libtest_XXXXXX";
+    int fd = mkstemp(path);
+    CHECK(fd >= 0 && libnes_save_movie(nes, path) == 1);
+    CHECK(libnes_save_movie(nes, "/nonexistent/libtest.nmv") == 0);
+    uint8_t movie[12 + 40 * LIBNES_PORTS + 1];
+    FILE* f = fdopen(fd, "rb");
+    size_t len = f != NULL ? fread(movie, 1, sizeof(movie), f) : 0;
+    CHECK(len == sizeof(movie) - 1);
+    CHECK(memcmp(movie, "NMV\x1A", 4) == 0 && movie[4] == LIBNES_PORTS && movie[8] == 40);
+    for (int i = 0; i < 40 && len == sizeof(movie) - 1; ++i)
+        CHECK(movie[12 + i * LIBNES_PORTS] == input(5 + i) && movie[13 + i * LIBNES_PORTS] == 0);
+    if (f != NULL)
+        fclose(f);
+    unlink(path);
+    libnes_destroy(nes);
+}
+
+static void test_out_of_memory(const uint8_t* rom){
+    /* with next to no address space left, creating fails back to us */
+    long pages = 0;
+    FILE* statm = fopen("/proc/self/statm", "r");
+    if (statm == NULL || fscanf(statm, "%ld", &pages) != 1){
+        fprintf(stderr, "libtest: no /proc/self/statm, skipping the out of memory test\n");
+        if (statm != NULL)
+            fclose(statm);
+        return;
+    }
+    fclose(statm);
+    struct rlimit old, low;
+    getrlimit(RLIMIT_AS, &old);
+    low = old;
+    low.rlim_cur = pages * sysconf(_SC_PAGESIZE) + (64 << 10);
+    setrlimit(RLIMIT_AS, &low);
+    const char* error = NULL;
+    NES* nes = libnes_create(rom, INES_SIZE, &error);
+    setrlimit(RLIMIT_AS, &old);
+    CHECK(nes == NULL && error != NULL);
+    libnes_destroy(nes);
+}
+
+int main(void){
+    CHECK(libnes_version() == LIBNES_VERSION);
+    uint8_t* rom = make_rom();
+    test_out_of_memory(rom); /* first, before freed memory can be reused */
+    test_rejects(rom);
+    test_run(rom);
+    test_states(rom);
+    test_cycles(rom);
+    test_movie(rom);
+    free(rom);
+    if (failures == 0)
+        printf("libtest: all passed\n");
+    return failures == 0 ? 0 : EXIT_FAILURE;
+}
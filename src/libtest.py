@@ -0,0 +1,61 @@
+"""libnes from another language: four machines on four threads through
+ctypes, a state moved between two of them. Usage: libtest.py libnes.so"""
+
+import ctypes
+import sys
+import threading
+
+lib = ctypes.CDLL(sys.argv[1] if len(sys.argv) > 1 else "./libnes.so")
+lib.libnes_create.restype = ctypes.c_void_p
+lib.libnes_create.argtypes = [ctypes.c_char_p, ctypes.c_size_t, ctypes.POINTER(ctypes.c_char_p)]
+lib.libnes_destroy.argtypes = [ctypes.c_void_p]
+lib.libnes_run_frame.argtypes = [ctypes.c_void_p]
+lib.libnes_frame_count.restype = ctypes.c_uint64
+lib.libnes_frame_count.argtypes = [ctypes.c_void_p]
+lib.libnes_set_input.argtypes = [ctypes.c_void_p, ctypes.c_uint, ctypes.c_uint8]
+lib.libnes_ram.restype = ctypes.POINTER(ctypes.c_uint8)
+lib.libnes_ram.argtypes = [ctypes.c_void_p]
+lib.libnes_state_size.restype = ctypes.c_size_t
+lib.libnes_save_state.argtypes = [ctypes.c_void_p, ctypes.c_void_p]
+lib.libnes_load_state.argtypes = [ctypes.c_void_p, ctypes.c_void_p, ctypes.c_size_t]
+
+RAM_SIZE = 0x800
+
+# NROM-128: INC $00 / ADC $00 / STA $01 / JMP $C000, vectors at $C000
+prg = bytearray(0x4000)
+prg[0:9] = bytes([0xE6, 0x00, 0x65, 0x00, 0x85, 0x01, 0x4C, 0x00, 0xC0])
+prg[0x3FFA:0x4000] = bytes([0x00, 0xC0] * 3)
+rom = b"NES\x1a" + bytes([1, 1]) + bytes(10) + bytes(prg) + bytes(0x2000)
+
+error = ctypes.c_char_p()
+assert not lib.libnes_create(rom[:100], 100, ctypes.byref(error)) and error.value
+
+machines = [lib.libnes_create(rom, len(rom), None) for _ in range(4)]
+assert all(machines)
+
+
+def run(nes, frames):
+    for frame in range(frames):
+        lib.libnes_set_input(nes, 0, frame & 0xFF)
+        assert lib.libnes_run_frame(nes) == 1
+
+
+threads = [threading.Thread(target=run, args=(nes, 120)) for nes in machines]
+for t in threads:
+    t.start()
+for t in threads:
+    t.join()
+rams = [bytes(lib.libnes_ram(nes)[:RAM_SIZE]) for nes in machines]
+assert all(ram == rams[0] for ram in rams) and rams[0] != bytes(RAM_SIZE)
+assert all(lib.libnes_frame_count(nes) == 120 for nes in machines)
+
+state = ctypes.create_string_buffer(lib.libnes_state_size())
+run(machines[0], 10)
+lib.libnes_save_state(machines[0], state)
+assert lib.libnes_load_state(machines[3], state, len(state)) == 1
+assert bytes(lib.libnes_ram(machines[3])[:RAM_SIZE]) == bytes(lib.libnes_ram(machines[0])[:RAM_SIZE])
+assert lib.libnes_load_state(machines[3], state, len(state) - 1) == 0
+
+for nes in machines:
+    lib.libnes_destroy(nes)
+print("libtest.py: all passed")
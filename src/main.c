@@ -1,27 +1,112 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
 #include <getopt.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
 
+#include "hash.h"
 #include "nes.h"
+#include "netplay.h"
+#include "pace.h"
+#include "runner.h"
+#include "stream.h"
 #include "util.h"
 
+#define NESTEST_INSTRUCTIONS 8991 /* lines in the nestest golden log, unofficial opcodes included */
+
 typedef struct Options{
     const char *rom_filename;
+    bool runner; /* -b: batch run every ROM given, see runner.h */
+    bool diff; /* -d: compare the two frame hash logs given */
+    const char *movie; /* -P: replay this input movie headless, as fast as possible */
+    const char *video_out; /* -V: stream frames here ("-" for stdout, not in DEBUG builds) */
+    const char *audio_out; /* -A: stream WAV audio here */
+    VideoFormat video_format; /* -F y4m|rgb */
+    unsigned scale; /* -x 1..SCALE_MAX, video out only */
+    ScaleFilter filter; /* -x with an s suffix: scanlines */
+    const char *observe; /* -S: publish observations to this shared memory name */
+    unsigned run_ahead; /* -a: frames to run ahead of the shown one */
+    const char *netplay; /* -n loop|udp:latency:jitter, two player rollback self test */
+    const char *codemap_dir; /* -c: analyse PRG statically, maps cached here by ROM hash */
+    const char *access_log; /* -L: write PREFIX.cdl and PREFIX.txt heatmap at the end, needs make cdl */
+    const char *breakpoints; /* -B x:ADDR,rw:ADDR,...: report every hit and carry on */
+    bool paced; /* -s given */
+    double speed; /* -s: times the NTSC frame rate, 0 for as fast as possible */
+    RunnerConfig run;
+    const char *rom_list;
+    char *const *rom_paths;
+    int n_rom_paths;
 } Options;
 
 static Options* parse_options(int argc, char *const argv[]);
+static void run_headless(const Options*);
+static int run_netplay(const Options*);
+static void analyze_rom(const Options*);
+static uint8_t test_input(int, uint64_t);
+static void write_access_log(NES*, const char*);
+static void set_breakpoints(NES*, const char*);
+static int open_output(const char*);
 
 int main(int argc, char *const argv[]){
 
     Options* options = parse_options(argc, argv);
+
+    if (options->runner){
+        int failed = run_roms(&options->run, options->rom_paths, options->n_rom_paths, options->rom_list);
+        free(options);
+        return failed == 0 ? 0 : EXIT_FAILURE;
+    }
+
+    if (options->diff){
+        if (options->n_rom_paths != 2)
+            err_exit("-d expects two hash logs");
+        HashLog* a = hashlog_read(options->rom_paths[0]);
+        HashLog* b = hashlog_read(options->rom_paths[1]);
+        int64_t frame = hashlog_diverge(a, b);
+        if (frame < 0)
+            printf("identical over %lu frames\n", a->n < b->n ? a->n : b->n);
+        else
+            printf("diverged at frame %ld\n", frame);
+        free_hashlog(a);
+        free_hashlog(b);
+        free(options);
+        return frame < 0 ? 0 : EXIT_FAILURE;
+    }
+
     if (options->rom_filename == NULL) 
         err_exit("No ROM provided");
 
+    if (options->netplay != NULL){
+        int failed = run_netplay(options);
+        free(options);
+        return failed;
+    }
+
+    if (options->codemap_dir != NULL){
+        analyze_rom(options);
+        free(options);
+        return 0;
+    }
+
+    if (options->movie != NULL || options->video_out != NULL || options->audio_out != NULL || options->observe != NULL || options->run_ahead > 0
+        || options->access_log != NULL || options->breakpoints != NULL || options->paced){
+        run_headless(options);
+        free(options);
+        return 0;
+    }
+
     printf("Power on\n");
-    NES nes = power_on(options->rom_filename);
+    NES* nes = power_on(options->rom_filename);
+    for (int i = 0 ; i < NESTEST_INSTRUCTIONS; ++i)
+        FDE(&nes->cpu);
 
     printf("Power off\n");
-    power_off(&nes);
+    power_off(nes);
 
     free(options);
 
@@ -30,20 +115,268 @@ int main(int argc, char *const argv[]){
 }
 
 static Options* parse_options(int argc, char *const argv[]){
-    Options *options = xalloc(1, sizeof(Options), twoarg_malloc);
+    Options *options = xalloc(1, sizeof(Options), calloc);
     if (options == NULL) return options;
     options->rom_filename = NULL;
+    options->run.frames = 600;
+    options->scale = 1;
 
-    /*  int opt;
-        while((opt = getopt(argc, argv, "x:s:")) != -1)
+    int opt;
+    char *end;
+    while((opt = getopt(argc, argv, "bdf:p:m:j:o:l:H:P:V:A:F:S:a:n:c:L:B:s:x:")) != -1)
         switch(opt){
-            case 'x': options->scale = strtol(optarg, NULL, 0); break;
-            case 's': options->speed = strtol(optarg, NULL, 0); break;
-            default: ;
+            case 'x':
+                /* 2, 3, 4, or 2s... for scanlines */
+                options->scale = strtoul(optarg, &end, 10);
+                if (*end == 's'){
+                    options->filter = FILTER_SCANLINES;
+                    ++end;
+                }
+                if (end == optarg || *end != '\0' || options->scale < 1 || options->scale > SCALE_MAX
+                    || (options->filter == FILTER_SCANLINES && options->scale < 2))
+                    err_exit("-x expects a scale from 1 to %d, s after it for scanlines from 2 up, got %s", SCALE_MAX, optarg);
+                break;
+            case 'b': options->runner = true; break;
+            case 'd': options->diff = true; break;
+            case 'f': options->run.frames = strtoul(optarg, NULL, 0); break;
+            case 'p':
+                options->run.stop_pc = true;
+                options->run.pc = strtol(optarg, NULL, 0);
+                break;
+            case 'm': {
+                /* ADDR=VAL, ADDR in the 2K of internal RAM */
+                long addr = strtol(optarg, &end, 0);
+                if (end == optarg || *end != '=')
+                    err_exit("-m expects ADDR=VALUE, got %s", optarg);
+                long val = strtol(end + 1, &end, 0);
+                if (addr < 0 || addr >= RAM_SIZE || val < 0 || val > 0xFF || *end != '\0')
+                    err_exit("-m expects an address below $%X and a byte value, got %s", RAM_SIZE, optarg);
+                options->run.stop_ram = true;
+                options->run.ram_addr = addr;
+                options->run.ram_val = val;
+                break;
+            }
+            case 'j': options->run.jobs = strtol(optarg, NULL, 0); break;
+            case 'o': options->run.output = optarg; break;
+            case 'l': options->rom_list = optarg; break;
+            case 'H': options->run.hashlog_dir = optarg; break;
+            case 'P': options->movie = optarg; break;
+            case 'V': options->video_out = optarg; break;
+            case 'S': options->observe = optarg; break;
+            case 'A': options->audio_out = optarg; break;
+            case 'a': options->run_ahead = strtoul(optarg, NULL, 0); break;
+            case 'n': options->netplay = optarg; break;
+            case 'c': options->codemap_dir = optarg; break;
+            case 'L': options->access_log = optarg; break;
+            case 'B': options->breakpoints = optarg; break;
+            case 's':
+                options->paced = true;
+                options->speed = strtod(optarg, &end);
+                if (end == optarg || *end != '\0' || options->speed < 0)
+                    err_exit("-s expects a speed like 1, 0.5 or 0 for unbounded, got %s", optarg);
+                break;
+            case 'F':
+                if (strcmp(optarg, "rgb") == 0) options->video_format = VIDEO_RGB;
+                else if (strcmp(optarg, "y4m") == 0) options->video_format = VIDEO_Y4M;
+                else err_exit("-F expects y4m or rgb, got %s", optarg);
+                break;
+            default: err_exit("Usage: %s [-b [-f frames] [-p pc] [-m addr=value] [-j jobs] [-o results.csv|.json] [-l list] [-H hashlog_dir]] rom... | [-P movie] [-f frames] [-V video] [-A audio.wav] [-F y4m|rgb] [-x scale[s]] [-S /shm_name] [-a frames] [-L cdl_prefix] [-B x:addr,rw:addr,...] [-s speed] rom | -n loop|udp:latency:jitter [-f frames] rom | -c map_dir rom | -d log log", argv[0]);
         }
-    */
 
-    if (optind < argc) options->rom_filename = argv[optind++];
+    if (optind < argc) options->rom_filename = argv[optind];
+    options->rom_paths = argv + optind;
+    options->n_rom_paths = argc - optind;
 
     return options;
 }
+
+static void run_headless(const Options* options){
+    /* runs the movie's length if there is one, otherwise -f frames,
+       streaming A/V if asked. Turbo unless -s sets a speed */
+    int video_fd = open_output(options->video_out);
+    int audio_fd = open_output(options->audio_out);
+    NES* nes = power_on(options->rom_filename);
+    if (options->access_log != NULL && nes->access == NULL)
+        err_exit("-L needs a build with -DCDL, make cdl builds nes_cdl.out");
+    uint64_t frames = options->run.frames;
+    if (options->breakpoints != NULL)
+        set_breakpoints(nes, options->breakpoints);
+    if (options->movie != NULL){
+        Movie* movie = movie_load(options->movie);
+        frames = movie->frames;
+        attach_movie(nes, movie);
+    }
+    if (options->observe != NULL)
+        nes->observe = open_observation(options->observe);
+    /* threaded frames come out one behind, which run-ahead would undo and
+       observations can't have, their picture goes with that frame's RAM.
+       The access log wants drawn tiles, which only rendering marks */
+    bool inline_frames = options->run_ahead > 0 || options->observe != NULL;
+    if (options->video_out != NULL || options->observe != NULL || options->access_log != NULL)
+        set_render_mode(nes, inline_frames ? RENDER_INLINE : RENDER_THREADED);
+    set_run_ahead(nes, options->run_ahead);
+    Stream* stream = NULL;
+    if (video_fd >= 0 || audio_fd >= 0)
+        stream = open_stream(video_fd, audio_fd, options->video_format, options->scale, options->filter, APU_SAMPLE_RATE);
+
+    Pacer* pacer = make_pacer(options->speed, frames);
+    while (nes->frames < frames){
+        bool done = run_frame(nes);
+        if (nes->stopped)
+            debug_dump(nes, stderr);
+        if (!done)
+            continue;
+        if (stream != NULL)
+            stream_frame(stream, nes->ppu.framebuffer, nes->apu.samples, nes->apu.nsamples);
+        pace_frame(pacer);
+    }
+    if (stream != NULL)
+        close_stream(stream);
+
+    if (video_fd > STDOUT_FILENO) close(video_fd);
+    if (audio_fd > STDOUT_FILENO) close(audio_fd);
+
+    fprintf(stderr, "ran %lu frames, state hash %016lx\n", frames, hash_state(nes));
+    pace_report(pacer, stderr);
+    free_pacer(pacer);
+    if (nes->ahead_runs > 0)
+        fprintf(stderr, "run-ahead %u: %.3f ms CPU per frame on top\n",
+                nes->run_ahead, nes->ahead_ns / 1e6 / nes->ahead_runs);
+    if (nes->debugger != NULL)
+        fprintf(stderr, "%lu breakpoint and watchpoint stops\n", nes->debugger->stops);
+    if (options->access_log != NULL)
+        write_access_log(nes, options->access_log);
+    power_off(nes);
+}
+
+static int run_netplay(const Options* options){
+    /* two sessions in this process, one per player, over an in-memory or
+       localhost UDP link with lag on both directions. Both must end up
+       where a plain run with the real inputs does */
+    char kind[8];
+    unsigned latency, jitter;
+    if (sscanf(options->netplay, "%7[a-z]:%u:%u", kind, &latency, &jitter) != 3)
+        err_exit("-n expects loop|udp:latency:jitter, got %s", options->netplay);
+    Transport links[2];
+    if (strcmp(kind, "loop") == 0)
+        make_loopback_pair(&links[0], &links[1]);
+    else if (strcmp(kind, "udp") == 0){
+        for (int i = 0; i < 2; ++i)
+            links[i] = make_udp_transport(0);
+        udp_transport_peer(&links[0], udp_transport_port(&links[1]));
+        udp_transport_peer(&links[1], udp_transport_port(&links[0]));
+    }
+    else
+        err_exit("-n expects loop or udp, got %s", kind);
+
+    NES* nes[2];
+    Netplay* np[2];
+    for (int i = 0; i < 2; ++i){
+        nes[i] = power_on(options->rom_filename);
+        np[i] = make_netplay(nes[i], make_lagged_transport(links[i], latency, jitter, i + 1), i);
+    }
+    uint64_t frames = options->run.frames;
+    while (np[0]->frame < frames || np[1]->frame < frames){
+        for (int i = 0; i < 2; ++i)
+            if (np[i]->frame < frames)
+                netplay_advance(np[i], test_input(i, np[i]->frame));
+    }
+    /* let the last inputs land */
+    while (!(netplay_poll(np[0]) & netplay_poll(np[1])))
+        for (int i = 0; i < 2; ++i)
+            np[i]->transport.tick(np[i]->transport.ctx);
+
+    NES* plain = power_on(options->rom_filename);
+    while (plain->frames < frames){
+        for (int i = 0; i < 2; ++i)
+            plain->input[i] = test_input(i, plain->frames);
+        run_frame(plain);
+    }
+    uint64_t expected = hash_state(plain);
+    power_off(plain);
+
+    int failed = 0;
+    for (int i = 0; i < 2; ++i){
+        const NetplayStats* s = &np[i]->stats;
+        uint64_t h = hash_state(nes[i]);
+        fprintf(stderr, "player %d: %lu frames, %lu rollbacks (%.2f frames deep on average, %u max), "
+                "%.3f ms per rollback, %lu stalls, state hash %016lx %s\n",
+                i + 1, s->frames, s->rollbacks, s->rollbacks ? (double) s->rolled_back / s->rollbacks : 0.0,
+                s->max_depth, s->rollbacks ? s->resim_ns / 1e6 / s->rollbacks : 0.0, s->stalls, h,
+                h == expected ? "matches" : "DIFFERS");
+        failed |= h != expected;
+        free_netplay(np[i]);
+        power_off(nes[i]);
+    }
+    return failed;
+}
+
+static void analyze_rom(const Options* options){
+    NES* nes = power_on(options->rom_filename);
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    bool cached;
+    nes->codemap = cached_codemap(&nes->mem, options->codemap_dir, &cached);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    const CodeMap* map = nes->codemap;
+    fprintf(stderr, "PRG %016lx: %u instructions in %u blocks, %u operand bytes, %u data bytes, "
+            "%.1f%% of PRG reached, %s in %.3f ms\n",
+            map->rom_hash, map->instructions, map->blocks, map->operand_bytes, map->data_bytes,
+            100.0 * (map->instructions + map->operand_bytes) / CODEMAP_SIZE,
+            cached ? "loaded" : "analysed", ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / 1e6);
+    power_off(nes);
+}
+
+static uint8_t test_input(int player, uint64_t frame){
+    /* held for 8 frames at a time, so guesses are right most of the time */
+    uint32_t x = (uint32_t)(frame / 8) * 2654435761u ^ (player + 1) * 40503u;
+    x ^= x >> 15;
+    x *= 2246822519u;
+    x ^= x >> 13;
+    return x;
+}
+
+static void write_access_log(NES* nes, const char* prefix){
+    /* the renderer's marks are only complete once it's stopped */
+    set_render_mode(nes, RENDER_OFF);
+    char path[4096];
+    snprintf(path, sizeof(path), "%s.cdl", prefix);
+    cdl_write(nes->access, &nes->mem, &nes->ppumem, path);
+    snprintf(path, sizeof(path), "%s.txt", prefix);
+    heatmap_write(nes->access, path);
+}
+
+static void set_breakpoints(NES* nes, const char* spec){
+    /* comma separated KINDS:ADDR, KINDS any of x (run), r (read), w (write) */
+    while (*spec != '\0'){
+        uint8_t kinds = 0;
+        for (; *spec != ':'; ++spec)
+            switch (*spec){
+                case 'x': kinds |= BREAK_EXEC; break;
+                case 'r': kinds |= BREAK_READ; break;
+                case 'w': kinds |= BREAK_WRITE; break;
+                default: err_exit("-B expects x, r or w before ':', got %s", spec);
+            }
+        char* end;
+        long addr = strtol(spec + 1, &end, 16);
+        if (end == spec + 1 || (*end != ',' && *end != '\0') || addr < 0 || addr > 0xFFFF)
+            err_exit("-B expects a hex address after ':', got %s", spec + 1);
+        set_breakpoint(nes, addr, kinds);
+        spec = *end == ',' ? end + 1 : end;
+    }
+}
+
+static int open_output(const char* path){
+    if (path == NULL)
+        return -1;
+    if (strcmp(path, "-") == 0){
+        #ifdef DEBUG
+        err_exit("This build traces to stdout (-DDEBUG), so it can't stream there too");
+        #endif
+        return STDOUT_FILENO;
+    }
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        err_exit("Couldn't open %s for writing", path);
+    return fd;
+}
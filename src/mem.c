@@ -1,5 +1,6 @@
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "mem.h"
 #include "util.h"
@@ -20,11 +21,25 @@ Memory alloc_main_memory(PPU* ppu){
     uint8_t** test_reg = map+(0x4018);
     uint8_t** prg = map+(0x4020);
 
-    Memory mem = { map, ram, ppu_reg, data_reg, test_reg, prg };
+    Memory mem = { map, ram, ppu_reg, data_reg, test_reg, prg, NULL, NULL, NULL };
+
+    /* everything is RAM until the cartridge maps itself in. PAGE_IO
+       pages have read side effects too, memread checks for them */
+    memset(mem.write_policy, PAGE_RAM, CPU_PAGES);
+    set_write_policy(&mem, 0x2000, 0x3FFF, PAGE_IO);
+    set_write_policy(&mem, IO_START, IO_START + 0xFF, PAGE_IO);
+    mem.mapper = NULL;
+    mem.mapper_write = NULL;
 
     return mem;
 }
 
+void set_write_policy(Memory* mem, uint16_t first, uint16_t last, WritePolicy policy){
+    /* pages holding first through last, inclusive */
+    for (int page = first >> PAGE_SHIFT; page <= last >> PAGE_SHIFT; ++page)
+        mem->write_policy[page] = policy;
+}
+
 PPUMemory alloc_ppu_memory(void){
     uint8_t* _map = xalloc(PPU_MEM_SIZE, sizeof(uint8_t), calloc);
     uint8_t** map = xalloc(PPU_MEM_SIZE, sizeof(uint8_t*), calloc);
@@ -36,7 +51,8 @@ PPUMemory alloc_ppu_memory(void){
     uint8_t** no_render = map+(0x3000);
     uint8_t** palette = map+(0x3F00);
 
-    PPUMemory mem = { map, pattern, nametable, no_render, palette };
+    PPUMemory mem = { map, _map + 0x2000, MIRROR_HORIZONTAL, false, pattern, nametable, no_render, palette };
+    set_mirroring(&mem, MIRROR_HORIZONTAL);
 
     return mem;
 }
@@ -76,21 +92,37 @@ void init_main_memory(uint8_t* _map, uint8_t** map, PPU* ppu){
     }
 }
 
+void set_mirroring(PPUMemory* mem, Mirroring mirroring){
+    /* point each 1K of $2000-$3EFF at the table it mirrors. A fixed
+       rewrite of the nametable pointers, fetches stay a single *map[addr] */
+    static const uint8_t tables[][4] = {
+        [MIRROR_HORIZONTAL] = { 0, 0, 1, 1 },
+        [MIRROR_VERTICAL] = { 0, 1, 0, 1 },
+        [MIRROR_SINGLE_LOW] = { 0, 0, 0, 0 },
+        [MIRROR_SINGLE_HIGH] = { 1, 1, 1, 1 },
+        [MIRROR_FOUR_SCREEN] = { 0, 1, 2, 3 },
+    };
+    mem->mirroring = mirroring;
+    for (int i = 0x2000; i < 0x3F00; ++i){
+        uint8_t table = tables[mirroring][(i >> 10) & 3];
+        mem->map[i] = mem->vram + table * NAMETABLE_SIZE + (i & (NAMETABLE_SIZE - 1));
+    }
+}
+
 void init_ppu_memory(uint8_t* _map, uint8_t** map){
     /* TODO use memcpy */
 
-    /* non-mirrored pattern tables and nametables */
-    for(int i = 0; i < 0x3000; ++i){
+    /* pattern tables. Nametables are mapped by set_mirroring */
+    for(int i = 0; i < 0x2000; ++i){
         map[i] = _map + i;
     }
 
-    /* partial nametable mirror, usually unused and not rendered from */
-    for(int i = 0x3000; i < 0x3EFF; ++i){
-        map[i] = map[i-0x1000];
-    }
-
-    /* 2x mirrored palette control RAM */
-    for(int i = 0x3F00; i < 0x3FFF; ++i){
-        map[i] = _map + (i % 128);
+    /* 32 bytes of palette RAM mirrored up to $3FFF. The sprite palettes'
+       first entries ($3F10/$3F14/$3F18/$3F1C) are the background's */
+    for(int i = 0x3F00; i < PPU_MEM_SIZE; ++i){
+        int entry = i % PALETTE_SIZE;
+        if ((entry & 0x13) == 0x10)
+            entry &= 0x0F;
+        map[i] = _map + 0x3F00 + entry;
     }
 }
@@ -4,8 +4,41 @@
 #include <stdint.h>
 #include <stdbool.h>
 
-#define CPU_MEM_SIZE 0xFFFF /* 64K memory map */
-#define PPU_MEM_SIZE 0x3FFF /* 16K memory map */
+#define CPU_MEM_SIZE 0x10000 /* 64K memory map */
+#define PPU_MEM_SIZE 0x4000 /* 16K memory map */
+#define RAM_SIZE 0x800 /* 2K internal RAM, the base of the CPU map */
+
+/* APU and controller registers. Their page and the PPU registers' are
+   PAGE_IO: reads and writes go through io_read/io_write instead of map */
+#define IO_START 0x4000
+#define IO_SIZE 0x20
+
+#define PAGE_SHIFT 8
+#define CPU_PAGES (CPU_MEM_SIZE >> PAGE_SHIFT) /* 256 byte pages */
+
+/* what a CPU write to a page does, looked up once per write */
+typedef enum WritePolicy{
+    PAGE_RAM, /* store through map */
+    PAGE_ROM, /* dropped, the page is read only */
+    PAGE_MAPPER, /* mapper registers, goes to mapper_write */
+    PAGE_IO, /* registers with side effects, goes to io_write */
+    PAGE_WATCH /* has breakpoints or watchpoints, reads and writes go to watch_ */
+} WritePolicy;
+
+/* code/data logger bits, one byte of them per bus address (cdl.h).
+   Only built in with -DCDL, otherwise CDL_MARK is nothing */
+#define CDL_EXEC 0x01 /* fetched as an opcode */
+#define CDL_OPERAND 0x02 /* fetched as an operand */
+#define CDL_READ 0x04
+#define CDL_WRITE 0x08
+#define CDL_TILE 0x10 /* pattern byte drawn */
+#define CDL_PCM 0x20 /* DMC sample fetch */
+
+#ifdef CDL
+#define CDL_MARK(cdl, addr, bits) ((cdl)[addr] |= (bits))
+#else
+#define CDL_MARK(cdl, addr, bits) ((void) 0)
+#endif
 
 typedef struct Memory{
 
@@ -18,18 +51,58 @@ typedef struct Memory{
     uint8_t** test_reg; /* $4018-$401F, disabled/cpu test registers */
     uint8_t** prg; /* $4020-$FFFF cartridge space (PRG ROM) */
 
+    /* memory mapped I/O handlers, io is passed back as the first argument */
+    void* io;
+    uint8_t (*io_read)(void*, uint16_t);
+    void (*io_write)(void*, uint16_t, uint8_t);
+
+    /* write side of the bus, one WritePolicy per page */
+    uint8_t write_policy[CPU_PAGES];
+    void* mapper;
+    void (*mapper_write)(void*, uint16_t, uint8_t);
+
+    /* PAGE_WATCH handlers (debugger.c), watch is passed back. watch_exec
+       is asked before running an instruction there, false stops the CPU */
+    void* watch;
+    bool (*watch_exec)(void*, uint16_t);
+    uint8_t (*watch_read)(void*, uint16_t, bool);
+    void (*watch_write)(void*, uint16_t, uint8_t);
+
+    uint32_t prg_size; /* PRG ROM bytes behind $8000-$FFFF */
+#ifdef CDL
+    uint8_t* cdl; /* CPU_MEM_SIZE CDL_* bytes */
+#endif
+
 } Memory;
 
+#define NAMETABLE_SIZE 0x400 /* 1K, the PPU has 2K of its own, four screen carts add 2K */
+#define PALETTE_SIZE 0x20
+
+typedef enum Mirroring{
+    MIRROR_HORIZONTAL, /* $2000=$2400, $2800=$2C00 */
+    MIRROR_VERTICAL, /* $2000=$2800, $2400=$2C00 */
+    MIRROR_SINGLE_LOW, /* all four are the first table */
+    MIRROR_SINGLE_HIGH, /* all four are the second table */
+    MIRROR_FOUR_SCREEN /* four separate tables */
+} Mirroring;
+
 typedef struct PPUMemory{
 
     uint8_t** map;
+    uint8_t* vram; /* 4 * NAMETABLE_SIZE bytes behind the nametables */
+    Mirroring mirroring;
+    bool chr_ram; /* pattern tables are writable through $2007 */
 
     /* offset accessors */
     uint8_t** pattern; /* $0000-$1FFF pattern tables (CHR ROM) */
-    uint8_t** nametable; /* $2000-$2FFF nametables (RAM) */
-    uint8_t** no_render; /* $3000-$3EFF partial mirror of the nametable space */
+    uint8_t** nametable; /* $2000-$2FFF nametables, mirrored onto vram (set_mirroring) */
+    uint8_t** no_render; /* $3000-$3EFF partial mirror of $2000-$2EFF */
     uint8_t** palette; /* $3F00-$3FFF palette RAM and mirror */
 
+#ifdef CDL
+    uint8_t* cdl; /* PPU_MEM_SIZE CDL_* bytes */
+#endif
+
 } PPUMemory;
 
 typedef union FreeableMemory {
@@ -42,8 +115,10 @@ typedef union FreeableMemory {
 #include "ppu.h"
 
 Memory alloc_main_memory(PPU*);
+void set_write_policy(Memory*, uint16_t, uint16_t, WritePolicy);
 void free_memory(FreeableMemory);
 
 PPUMemory alloc_ppu_memory(void);
+void set_mirroring(PPUMemory*, Mirroring);
 
 #endif
@@ -1,37 +1,98 @@
+#define _POSIX_C_SOURCE 200809L
+
 #ifdef DEBUG
 #include <stdio.h>
 #endif
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
 #include "nes.h"
 #include "ppu.h"
+#include "apu.h"
 #include "cpu.h"
+#include "hash.h"
+#include "input.h"
+#include "render.h"
+#include "ring.h"
+#include "sched.h"
+#include "shm.h"
 #include "mem.h"
 #include "rom.h"
+#include "util.h"
+
+static NES* assemble(void);
+static void boot(NES*);
+static void start_frame(NES*);
+static void end_frame(NES*);
+static bool emulate_frame(NES*);
+static bool run_ahead(NES*);
+static bool run_events(NES*);
+static void schedule_apu(NES*);
+static void set_irq(NES*, uint8_t, bool);
+static bool nmi_line(const PPU*);
+static void oam_dma(NES*);
+static uint64_t dot_cycle(uint64_t);
+static uint32_t frame_dot(const NES*);
+static uint8_t io_read(void*, uint16_t);
+static void io_write(void*, uint16_t, uint8_t);
+
+NES* power_on(const char* rom_filename){
+    NES* nes = assemble();
+    load_rom(nes, rom_filename); /* TODO at some point down the line, we probably just want to do this as something separate from power_on, and just wait for a call while idling */
+    boot(nes);
+    return nes;
+}
+
+NES* power_on_image(const uint8_t* rom, size_t size){
+    /* power_on for an iNES file in memory, NULL if it fails probe_rom_image */
+    if (probe_rom_image(rom, size) != NULL)
+        return NULL;
+    NES* nes = assemble();
+    load_rom_image(nes, rom, size);
+    boot(nes);
+    return nes;
+}
+
+static NES* assemble(void){
+    /* everything but the cartridge */
+    NES* nes = xalloc(1, sizeof(NES), calloc);
+    nes->ppumem = alloc_ppu_memory();
+    nes->ppu = make_ppu(&nes->ppumem);
+    nes->mem = alloc_main_memory(&nes->ppu);
+    nes->sched = make_scheduler();
+    nes->cpu = make_cpu(&nes->mem, &nes->sched);
+    nes->apu = make_apu(&nes->mem, APU_SAMPLE_RATE);
+    nes->mem.io = nes;
+    nes->mem.io_read = io_read;
+    nes->mem.io_write = io_write;
+    #ifdef CDL
+    nes->access = xalloc(1, sizeof(AccessMap), calloc);
+    nes->mem.cdl = nes->access->cpu;
+    nes->ppumem.cdl = nes->access->ppu;
+    #endif
+    for (int i = 0; i < CONTROLLER_PORTS; ++i)
+        nes->pads[i] = make_controller(&nes->input[i]);
+    return nes;
+}
 
-NES power_on(const char* rom_filename){
-    PPUMemory ppumem = alloc_ppu_memory();
-    PPU ppu = make_ppu(&ppumem);
-    Memory mem = alloc_main_memory(&ppu);
-    CPU cpu = make_cpu(&mem);
-    NES nes = { cpu, ppu, mem, ppumem };
-    load_rom(&nes, rom_filename); /* TODO at some point down the line, we probably just want to do this as something separate from power_on, and just wait for a call while idling */
+static void boot(NES* nes){
     #ifdef DEBUG
     printf("Sampling NROM mirroring...\n");
     for (int i = 0x8000; i < 0x8010; ++i){
-        printf("Location %04X: %02x\n", i, *(nes.mem.map[i]));
+        printf("Location %04X: %02x\n", i, *(nes->mem.map[i]));
     }
     for (int i = 0xC000; i < 0xC010; ++i){
-        printf("Location %04X: %02x\n", i, *(nes.mem.map[i]));
+        printf("Location %04X: %02x\n", i, *(nes->mem.map[i]));
     }
     printf("Sampling PPU memory\n");
     for (int i = 0; i < 0x20; ++i){
-        printf("Location %04X: %02x\n", i, *(nes.ppumem.map[i]));
+        printf("Location %04X: %02x\n", i, *(nes->ppumem.map[i]));
     }
     #endif
-    reset(&cpu);
-    for (int i = 0 ; i < 5003; ++i)
-        FDE(&cpu);
-    return nes;
+    reset(&nes->cpu);
+    start_frame(nes);
+    schedule_apu(nes);
 }
 
 void power_off(NES* nes){
@@ -41,4 +102,423 @@ void power_off(NES* nes){
     free_memory(mem);
     mem.ppumem = &(nes->ppumem);
     free_memory(mem);
+    free_ppu(&nes->ppu);
+    free_hashlog(nes->hashlog);
+    free_movie(nes->movie);
+    close_observation(nes->observe, true);
+    free_renderer(nes->renderer);
+    free(nes->ahead);
+    free(nes->codemap);
+    free(nes->access);
+    free(nes->debugger);
+    free(nes);
+}
+
+bool run_frame(NES* nes){
+    /* true when the frame ran to its end. A breakpoint or watchpoint can
+       stop it first (nes->stopped), the next call carries on from there */
+    nes->stopped = false;
+    if (nes->run_ahead > 0)
+        return run_ahead(nes);
+    return emulate_frame(nes);
+}
+
+bool run_cycles(NES* nes, uint64_t cycles){
+    /* at least cycles more CPU cycles, the last instruction isn't cut
+       short. Frames end as they're reached, run-ahead isn't done. False
+       if a breakpoint or watchpoint stopped it first */
+    nes->stopped = false;
+    uint64_t end = nes->cpu.cycles + cycles;
+    while (nes->cpu.cycles < end && !nes->stopped){
+        uint64_t limit = nes->sched.next < end ? nes->sched.next : end;
+        while (nes->cpu.cycles < limit)
+            FDE(&nes->cpu);
+        if (nes->cpu.cycles >= nes->sched.next && run_events(nes))
+            end_frame(nes);
+    }
+    return !nes->stopped;
+}
+
+static bool emulate_frame(NES* nes){
+    /* run the CPU up to the end of the next frame. Instructions run back to
+       back until the next scheduled event, which includes the frame end */
+    bool frame_end;
+    do {
+        while (nes->cpu.cycles < nes->sched.next)
+            FDE(&nes->cpu);
+        frame_end = run_events(nes);
+    } while (!frame_end && !nes->stopped);
+    if (frame_end)
+        end_frame(nes);
+    return frame_end;
+}
+
+static bool run_ahead(NES* nes){
+    /* the real frame without its picture, then run_ahead more with the
+       same input and no sound. The last one is drawn and shown, then
+       the state goes back to the end of the real frame */
+    Renderer* renderer = nes->renderer;
+    FrameExchange* video = nes->video_out;
+    if (renderer != NULL && renderer->threaded)
+        err_exit("Run-ahead needs an inline renderer, threaded frames come out late");
+    nes->renderer = NULL;
+    nes->video_out = NULL;
+    if (!emulate_frame(nes)){
+        nes->renderer = renderer;
+        nes->video_out = video;
+        return false;
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &start);
+    save_state(nes, nes->ahead);
+    nes->hidden = true;
+    nes->apu.synth = false;
+    for (unsigned i = 1; i <= nes->run_ahead; ++i){
+        if (i == nes->run_ahead && renderer != NULL){
+            render_sync(renderer, &nes->ppu);
+            nes->renderer = renderer;
+        }
+        emulate_frame(nes);
+    }
+    nes->hidden = false;
+    load_state(nes, nes->ahead);
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &end);
+    nes->ahead_ns += (end.tv_sec - start.tv_sec) * 1000000000ull + end.tv_nsec - start.tv_nsec;
+    nes->ahead_runs++;
+
+    nes->renderer = renderer;
+    nes->video_out = video;
+    if (video != NULL){
+        fx_publish(video);
+        nes->ppu.framebuffer = fx_back(video);
+    }
+    return true;
+}
+
+void set_run_ahead(NES* nes, unsigned frames){
+    nes->run_ahead = frames;
+    if (frames > 0 && nes->ahead == NULL)
+        nes->ahead = xalloc(1, sizeof(Snapshot), twoarg_malloc);
+}
+
+void save_state(const NES* nes, Snapshot* s){
+    s->cpu = nes->cpu;
+    s->ppu = nes->ppu;
+    s->apu = nes->apu;
+    s->sched = nes->sched;
+    s->dma_page = nes->dma_page;
+    memcpy(s->pads, nes->pads, sizeof(s->pads));
+    s->frames = nes->frames;
+    memcpy(s->ram, nes->mem.map[0], RAM_SIZE);
+    memcpy(s->cart, nes->mem.map[IO_START], sizeof(s->cart));
+    const PPUMemory* ppumem = &nes->ppumem;
+    if (ppumem->chr_ram)
+        memcpy(s->chr, ppumem->map[0], sizeof(s->chr));
+    memcpy(s->vram, ppumem->vram, sizeof(s->vram));
+    memcpy(s->palette, ppumem->map[0x3F00], PALETTE_SIZE);
+    s->mirroring = ppumem->mirroring;
+}
+
+void load_state(NES* nes, const Snapshot* s){
+    /* pointers stay this NES's own, so a snapshot from another NES running
+       the same ROM loads too. The framebuffer isn't state, it stays
+       wherever it points now, and cpu.ram follows the watchpoints set now */
+    CPU cpu = nes->cpu;
+    PPU ppu = nes->ppu;
+    Memory* apu_mem = nes->apu.mem;
+    nes->cpu = s->cpu;
+    nes->cpu.mem = cpu.mem;
+    nes->cpu.ram = cpu.ram;
+    nes->cpu.sched = cpu.sched;
+    nes->ppu = s->ppu;
+    nes->ppu.ppumemory = ppu.ppumemory;
+    nes->ppu.framebuffer = ppu.framebuffer;
+    nes->ppu.frame_storage = ppu.frame_storage;
+    nes->apu = s->apu;
+    nes->apu.mem = apu_mem;
+    nes->sched = s->sched;
+    nes->dma_page = s->dma_page;
+    for (int i = 0; i < CONTROLLER_PORTS; ++i){
+        nes->pads[i] = s->pads[i];
+        nes->pads[i].buttons = &nes->input[i];
+    }
+    nes->frames = s->frames;
+    memcpy(nes->mem.map[0], s->ram, RAM_SIZE);
+    memcpy(nes->mem.map[IO_START], s->cart, sizeof(s->cart));
+    PPUMemory* ppumem = &nes->ppumem;
+    if (ppumem->chr_ram)
+        memcpy(ppumem->map[0], s->chr, sizeof(s->chr));
+    memcpy(ppumem->vram, s->vram, sizeof(s->vram));
+    memcpy(ppumem->map[0x3F00], s->palette, PALETTE_SIZE);
+    if (ppumem->mirroring != s->mirroring)
+        set_mirroring(ppumem, s->mirroring);
+}
+
+static uint64_t dot_cycle(uint64_t dot){
+    /* first CPU cycle at or after a PPU dot */
+    return (dot + PPU_DOTS_PER_CPU_CYCLE - 1) / PPU_DOTS_PER_CPU_CYCLE;
+}
+
+static void start_frame(NES* nes){
+    /* frames are kept in PPU dots so the 2/3 cycle remainder doesn't
+       drift. Scanline 0 starts the frame, the pre-render line ends it */
+    uint64_t start = nes->frames * PPU_DOTS_PER_FRAME;
+    Scheduler* s = &nes->sched;
+    sched_set(s, EVENT_FRAME_END, dot_cycle(start + PPU_DOTS_PER_FRAME));
+    sched_set(s, EVENT_VBLANK, dot_cycle(start + VBLANK_LINE * PPU_DOTS_PER_LINE + 1));
+    sched_set(s, EVENT_PRERENDER, dot_cycle(start + PRERENDER_LINE * PPU_DOTS_PER_LINE + 1));
+    uint32_t hit = ppu_sprite0_dot(&nes->ppu);
+    sched_set(s, EVENT_SPRITE0, hit == PPU_NO_HIT ? SCHED_NEVER : dot_cycle(start + hit));
+}
+
+static void schedule_apu(NES* nes){
+    /* after anything that can move the APU's IRQ times: its events and
+       register accesses. Sample fetches made since then halted the CPU,
+       like OAM DMA that's added to its clock at once */
+    nes->cpu.cycles += apu_take_stall(&nes->apu);
+    sched_set(&nes->sched, EVENT_APU_FRAME_IRQ, apu_next_frame_irq(&nes->apu));
+    sched_set(&nes->sched, EVENT_DMC_FETCH, apu_next_dmc_fetch(&nes->apu));
+    set_irq(nes, IRQ_APU, apu_irq(&nes->apu));
+}
+
+static void set_irq(NES* nes, uint8_t source, bool level){
+    /* the CPU only looks at its lines when told to, which is when one
+       goes up. Lowering one needs nothing */
+    uint8_t was = nes->cpu.irq;
+    if (level)
+        nes->cpu.irq |= source;
+    else
+        nes->cpu.irq &= ~source;
+    if (!was && nes->cpu.irq)
+        sched_set(&nes->sched, EVENT_INTERRUPT, nes->cpu.cycles);
+}
+
+static bool nmi_line(const PPU* ppu){
+    /* the PPU's NMI output, low while both vblank and PPUCTRL.7 are set */
+    return (ppu->ppuctrl & PPUCTRL_NMI) && (ppu->ppustatus & PPUSTATUS_VBLANK);
+}
+
+static bool run_events(NES* nes){
+    /* handle every event that's due. True when the frame has ended */
+    bool frame_end = false;
+    uint64_t now = nes->cpu.cycles;
+    EventType type;
+    while (sched_pop(&nes->sched, now, &type)){
+        switch (type){
+            case EVENT_FRAME_END:
+                frame_end = true;
+                break;
+            case EVENT_VBLANK:
+                nes->ppu.ppustatus |= PPUSTATUS_VBLANK;
+                if (nes->ppu.ppuctrl & PPUCTRL_NMI){
+                    nes->cpu.nmi = true;
+                    sched_set(&nes->sched, EVENT_INTERRUPT, now);
+                }
+                break;
+            case EVENT_PRERENDER:
+                nes->ppu.ppustatus &= ~(PPUSTATUS_VBLANK | PPUSTATUS_SPRITE0 | PPUSTATUS_OVERFLOW);
+                break;
+            case EVENT_SPRITE0:
+                if ((nes->ppu.ppumask & PPUMASK_RENDER) == PPUMASK_RENDER)
+                    nes->ppu.ppustatus |= PPUSTATUS_SPRITE0;
+                break;
+            case EVENT_APU_FRAME_IRQ:
+            case EVENT_DMC_FETCH:
+                apu_run(&nes->apu, now);
+                schedule_apu(nes);
+                break;
+            case EVENT_MAPPER_IRQ:
+                /* mappers with IRQ counters schedule this and acknowledge
+                   it by clearing the line. NROM has none */
+                set_irq(nes, IRQ_MAPPER, true);
+                break;
+            case EVENT_INTERRUPT:
+                cpu_interrupt(&nes->cpu);
+                break;
+            case EVENT_OAM_DMA:
+                oam_dma(nes);
+                break;
+            case EVENT_BREAK:
+                break; /* only here to end the run loop, nes->stopped is set */
+            default: ;
+        }
+    }
+    return frame_end;
+}
+
+static void end_frame(NES* nes){
+    apu_end_frame(&nes->apu, nes->cpu.cycles);
+    if (nes->renderer != NULL){
+        /* threaded renderers hand back the previous frame from their own
+           buffers, it's copied so the framebuffer stays where it was */
+        uint8_t* frame = render_frame(nes->renderer, nes->ppu.framebuffer);
+        if (frame != nes->ppu.framebuffer)
+            memcpy(nes->ppu.framebuffer, frame, FRAME_SIZE);
+    }
+    if (!nes->hidden){
+        if (nes->audio_out != NULL)
+            ring_push(nes->audio_out, nes->apu.samples, nes->apu.nsamples);
+        /* a recording takes the input the frame ran with, playback loads
+           the input for the frame about to start */
+        if (nes->movie != NULL){
+            if (nes->movie->mode == MOVIE_RECORD)
+                movie_record(nes->movie, nes->input);
+            else if (!movie_play(nes->movie, nes->input))
+                memset(nes->input, 0, CONTROLLER_PORTS);
+        }
+    }
+    nes->frames++;
+    start_frame(nes);
+    if (nes->hidden)
+        return;
+    if (nes->observe != NULL)
+        publish_observation(nes->observe, &nes->cpu, nes_ram(nes), nes->ppu.framebuffer, nes->frames, nes->input);
+    if (nes->hashlog != NULL)
+        hashlog_append(nes->hashlog, hash_state(nes));
+    /* last, the observation and hash above take the frame just drawn
+       before the framebuffer moves on to the next back buffer */
+    if (nes->video_out != NULL){
+        fx_publish(nes->video_out);
+        nes->ppu.framebuffer = fx_back(nes->video_out);
+    }
+}
+
+static void oam_dma(NES* nes){
+    /* the whole transfer at once: one copy and the CPU stall added to its
+       clock. Runs right after the instruction that wrote $4014, so the
+       cycle count here is where the DMA starts */
+    uint16_t base = nes->dma_page << 8;
+    uint8_t** map = nes->mem.map;
+    uint8_t copy[OAM_SIZE];
+    const uint8_t* page = map[base];
+    for (int i = 0; i < OAM_SIZE; ++i)
+        CDL_MARK(nes->mem.cdl, base + i, CDL_READ);
+    if (nes->mem.write_policy[nes->dma_page] == PAGE_WATCH){
+        /* through the debugger so read watchpoints on the page fire */
+        for (int i = 0; i < OAM_SIZE; ++i)
+            copy[i] = nes->mem.watch_read(nes->mem.watch, base + i, true);
+        page = copy;
+    }
+    else if (map[base + 0xFF] != map[base] + 0xFF){
+        /* register pages map every byte somewhere else */
+        for (int i = 0; i < OAM_SIZE; ++i)
+            copy[i] = *(map[base + i]);
+        page = copy;
+    }
+    ppu_oam_dma(&nes->ppu, page);
+    if (nes->renderer != NULL)
+        render_record_dma(nes->renderer, frame_dot(nes), page);
+    nes->cpu.cycles += OAM_DMA_CYCLES + (nes->cpu.cycles & 1);
+}
+
+void attach_movie(NES* nes, Movie* movie){
+    /* the NES takes ownership. Playback starts with the current frame */
+    if (movie->ports > CONTROLLER_PORTS)
+        err_exit("Movie: %d controller ports, only %d supported", movie->ports, CONTROLLER_PORTS);
+    free_movie(nes->movie);
+    nes->movie = movie;
+    if (movie->mode == MOVIE_PLAYBACK)
+        movie_play(movie, nes->input);
+}
+
+void set_render_mode(NES* nes, RenderMode mode){
+    /* a threaded renderer finishes the frame it's drawing before it goes */
+    free_renderer(nes->renderer);
+    nes->renderer = NULL; /* still freeable if making the new one fails */
+    nes->renderer = mode == RENDER_OFF ? NULL : make_renderer(&nes->ppu, mode == RENDER_THREADED);
+    #ifdef CDL
+    if (nes->renderer != NULL)
+        nes->renderer->mem.cdl = nes->access->drawn;
+    #endif
+}
+
+void attach_outputs(NES* nes, SampleRing* audio, FrameExchange* video){
+    /* the host owns both and reads them from its own thread. Frames are
+       rendered straight into the exchange's back buffer, no copy */
+    nes->audio_out = audio;
+    nes->video_out = video;
+    if (video != NULL && video->size < FRAME_SIZE)
+        err_exit("Output: frame exchange buffers hold %lu bytes, frames need %d", video->size, FRAME_SIZE);
+    nes->ppu.framebuffer = video != NULL ? fx_back(video) : nes->ppu.frame_storage;
+}
+
+static uint32_t frame_dot(const NES* nes){
+    /* PPU dot within the current frame, what renderer accesses are timed in */
+    return nes->cpu.cycles * PPU_DOTS_PER_CPU_CYCLE - nes->frames * PPU_DOTS_PER_FRAME;
+}
+
+static uint8_t io_read(void* ctx, uint16_t addr){
+    NES* nes = ctx;
+    if (addr < IO_START){
+        uint8_t val = ppu_read_register(&nes->ppu, addr);
+        if (nes->renderer != NULL && ((addr & 7) == 2 || (addr & 7) == 7))
+            render_record(nes->renderer, frame_dot(nes), addr, val, ACCESS_READ);
+        return val;
+    }
+    switch (addr){
+        case 0x4015: {
+            uint8_t status = apu_read_status(&nes->apu, nes->cpu.cycles);
+            schedule_apu(nes); /* the read acknowledged the frame IRQ */
+            return status;
+        }
+        case 0x4016: return controller_read(&nes->pads[0]);
+        case 0x4017: return controller_read(&nes->pads[1]);
+        default: return *(nes->mem.map[addr]);
+    }
+}
+
+static void io_write(void* ctx, uint16_t addr, uint8_t val){
+    NES* nes = ctx;
+    if (addr < IO_START){
+        /* turning NMIs on during vblank is an edge on the line too */
+        bool nmi = nmi_line(&nes->ppu);
+        ppu_write_register(&nes->ppu, addr, val);
+        if (!nmi && nmi_line(&nes->ppu)){
+            nes->cpu.nmi = true;
+            sched_set(&nes->sched, EVENT_INTERRUPT, nes->cpu.cycles);
+        }
+        if (nes->renderer != NULL)
+            render_record(nes->renderer, frame_dot(nes), addr, val, ACCESS_WRITE);
+        return;
+    }
+    if (addr == 0x4016){
+        /* one strobe line for both ports */
+        controller_write(&nes->pads[0], val);
+        controller_write(&nes->pads[1], val);
+    }
+    else if (addr == 0x4014){
+        nes->dma_page = val;
+        sched_set(&nes->sched, EVENT_OAM_DMA, nes->cpu.cycles);
+    }
+    else if (addr <= 0x4013 || addr == 0x4015 || addr == 0x4017){
+        apu_write(&nes->apu, addr, val, nes->cpu.cycles);
+        schedule_apu(nes);
+    }
+    *(nes->mem.map[addr]) = val;
+}
+
+uint8_t* nes_ram(NES* nes){
+    /* internal RAM is the first RAM_SIZE bytes of the backing store */
+    return nes->mem.map[0];
+}
+
+uint64_t hash_state(NES* nes){
+    /* fingerprint of everything a frame can change: CPU registers, RAM,
+       VRAM and the rendered frame. Registers are packed by hand so struct
+       padding never reaches the hash */
+    CPU* cpu = &nes->cpu;
+    uint8_t regs[16] = { cpu->A, cpu->X, cpu->Y, cpu->P, cpu->SP, cpu->PC & 0xFF, cpu->PC >> 8 };
+    for (int i = 0; i < 8; ++i)
+        regs[8 + i] = cpu->cycles >> (8 * i);
+    uint64_t h = hash64(regs, sizeof(regs), 0);
+
+    h = hash64(nes_ram(nes), RAM_SIZE, h);
+    h = hash64(nes->ppumem.vram, 4 * NAMETABLE_SIZE, h); /* nametables */
+    uint8_t palette[32];
+    for (int i = 0; i < 32; ++i)
+        palette[i] = *(nes->ppumem.palette[i]);
+    h = hash64(palette, sizeof(palette), h);
+    h = hash64(nes->ppu.framebuffer, FRAME_SIZE, h);
+    return h;
 }
@@ -1,19 +1,84 @@
 #ifndef NES_H
 #define NES_H
 
+#include "analyze.h"
+#include "apu.h"
+#include "cdl.h"
 #include "cpu.h"
+#include "debugger.h"
+#include "hash.h"
+#include "input.h"
+#include "render.h"
+#include "ring.h"
+#include "sched.h"
+#include "shm.h"
 #include "mem.h"
 #include "ppu.h"
 
+#define CONTROLLER_PORTS 2
+
+/* Everything a frame can change, for saving and going back in memory.
+   load_state keeps the loading NES's own pointers in the copied structs */
+typedef struct Snapshot{
+    CPU cpu;
+    PPU ppu;
+    APU apu;
+    Scheduler sched;
+    uint8_t dma_page;
+    Controller pads[CONTROLLER_PORTS];
+    uint64_t frames;
+    uint8_t ram[RAM_SIZE];
+    uint8_t cart[0x4000]; /* $4000-$7FFF: register bytes and cartridge RAM */
+    uint8_t chr[0x2000]; /* pattern tables, only kept for CHR RAM */
+    uint8_t vram[4 * NAMETABLE_SIZE];
+    uint8_t palette[PALETTE_SIZE];
+    Mirroring mirroring;
+} Snapshot;
+
 typedef struct NES{
     CPU cpu;
     PPU ppu;
+    APU apu;
     Memory mem; /* CPU memory map */
     PPUMemory ppumem; /* PPU memory map */
+    Scheduler sched; /* timed events across all components */
+    uint8_t dma_page; /* source page of the pending OAM DMA */
+    uint8_t input[CONTROLLER_PORTS]; /* controller button state, one byte per port (BUTTON_*) */
+    Controller pads[CONTROLLER_PORTS]; /* $4016/$4017 */
+    Movie* movie; /* records or plays back input at frame ends, NULL when off */
+    SampleRing* audio_out; /* frame samples are pushed here, NULL when off */
+    FrameExchange* video_out; /* frames render into its back buffer, NULL when off */
+    Observation* observe; /* shared memory RAM/frame/registers, NULL when off */
+    Renderer* renderer; /* draws the framebuffer from recorded PPU accesses, NULL when off */
+    uint64_t frames; /* completed frames */
+    HashLog* hashlog; /* state hash appended at every frame end, NULL when off */
+    bool hidden; /* a run-ahead frame: nothing leaves the core but its picture */
+    unsigned run_ahead; /* frames run past each real one, 0 when off */
+    Snapshot* ahead; /* the real frame's state while running ahead */
+    uint64_t ahead_ns; /* thread CPU time spent running ahead, save and load included */
+    uint64_t ahead_runs;
+    CodeMap* codemap; /* static code/data map of PRG, NULL until analysed */
+    AccessMap* access; /* code/data logger, NULL unless built with -DCDL */
+    Debugger* debugger; /* breakpoints and watchpoints, NULL until one is set */
+    bool stopped; /* the last run_frame hit one, debugger->stop says which */
+    bool failed; /* an error was trapped mid-run (see err_trap), it can't run on */
     /* ... */
 } NES;
 
-NES power_on();
+/* NES is heap allocated and must stay put: the components keep pointers
+   into each other (cpu->mem, ppu->ppumemory, PPU registers in the CPU map) */
+NES* power_on(const char*);
+NES* power_on_image(const uint8_t*, size_t);
 void power_off(NES*);
+bool run_frame(NES*);
+bool run_cycles(NES*, uint64_t);
+uint8_t* nes_ram(NES*);
+uint64_t hash_state(NES*);
+void attach_movie(NES*, Movie*);
+void attach_outputs(NES*, SampleRing*, FrameExchange*);
+void set_render_mode(NES*, RenderMode);
+void set_run_ahead(NES*, unsigned);
+void save_state(const NES*, Snapshot*);
+void load_state(NES*, const Snapshot*);
 
 #endif
@@ -0,0 +1,365 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "netplay.h"
+#include "util.h"
+
+#define PACKET_MAX 64
+#define PACKET_HEADER 7 /* "NP", first frame (uint32 LE), count */
+#define QUEUE_CAP 256
+
+typedef struct Packet{
+    uint8_t data[PACKET_MAX];
+    size_t len;
+    uint64_t due; /* tick it's delivered at, lagged transports only */
+} Packet;
+
+typedef struct PacketQueue{
+    Packet packets[QUEUE_CAP];
+    unsigned head, n;
+} PacketQueue;
+
+/* two queues, one per direction. Both ends must be used from one thread */
+typedef struct Loopback{
+    PacketQueue queues[2];
+    int open; /* ends not closed yet */
+} Loopback;
+
+typedef struct LoopbackEnd{
+    Loopback* pair;
+    int side;
+} LoopbackEnd;
+
+typedef struct Lagged{
+    Transport inner;
+    unsigned latency, jitter;
+    uint32_t rng;
+    uint64_t now;
+    Packet held[QUEUE_CAP];
+    unsigned n;
+} Lagged;
+
+typedef struct UDP{
+    int fd;
+    struct sockaddr_in peer;
+} UDP;
+
+static void send_inputs(Netplay*, uint64_t);
+static void receive(Netplay*);
+static void set_inputs(Netplay*, uint64_t);
+static void roll_back(Netplay*);
+
+/* transports */
+
+static void queue_push(PacketQueue* q, const uint8_t* data, size_t len){
+    /* a full queue drops, like a network would */
+    if (q->n == QUEUE_CAP || len > PACKET_MAX)
+        return;
+    Packet* p = &q->packets[(q->head + q->n++) % QUEUE_CAP];
+    memcpy(p->data, data, len);
+    p->len = len;
+}
+
+static void loopback_send(void* ctx, const uint8_t* data, size_t len){
+    LoopbackEnd* end = ctx;
+    queue_push(&end->pair->queues[end->side ^ 1], data, len);
+}
+
+static ssize_t loopback_recv(void* ctx, uint8_t* buf, size_t cap){
+    LoopbackEnd* end = ctx;
+    PacketQueue* q = &end->pair->queues[end->side];
+    if (q->n == 0)
+        return -1;
+    Packet* p = &q->packets[q->head];
+    q->head = (q->head + 1) % QUEUE_CAP;
+    q->n--;
+    size_t len = p->len < cap ? p->len : cap;
+    memcpy(buf, p->data, len);
+    return len;
+}
+
+static void loopback_close(void* ctx){
+    LoopbackEnd* end = ctx;
+    if (--end->pair->open == 0)
+        free(end->pair);
+    free(end);
+}
+
+void make_loopback_pair(Transport* a, Transport* b){
+    Loopback* pair = xalloc(1, sizeof(Loopback), calloc);
+    pair->open = 2;
+    Transport* ends[2] = { a, b };
+    for (int i = 0; i < 2; ++i){
+        LoopbackEnd* end = xalloc(1, sizeof(LoopbackEnd), calloc);
+        end->pair = pair;
+        end->side = i;
+        *ends[i] = (Transport){ end, loopback_send, loopback_recv, NULL, loopback_close };
+    }
+}
+
+static void udp_send(void* ctx, const uint8_t* data, size_t len){
+    /* lost and refused datagrams are the protocol's problem, not ours */
+    UDP* udp = ctx;
+    sendto(udp->fd, data, len, 0, (struct sockaddr*) &udp->peer, sizeof(udp->peer));
+}
+
+static ssize_t udp_recv(void* ctx, uint8_t* buf, size_t cap){
+    UDP* udp = ctx;
+    ssize_t n = recv(udp->fd, buf, cap, 0);
+    return n < 0 ? -1 : n;
+}
+
+static void udp_close(void* ctx){
+    UDP* udp = ctx;
+    close(udp->fd);
+    free(udp);
+}
+
+Transport make_udp_transport(uint16_t port){
+    UDP* udp = xalloc(1, sizeof(UDP), calloc);
+    udp->fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (udp->fd < 0)
+        err_exit("Netplay: Couldn't open a UDP socket");
+    struct sockaddr_in addr = { 0 };
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if (bind(udp->fd, (struct sockaddr*) &addr, sizeof(addr)) != 0)
+        err_exit("Netplay: Couldn't bind UDP port %u", port);
+    fcntl(udp->fd, F_SETFL, fcntl(udp->fd, F_GETFL) | O_NONBLOCK);
+    udp->peer = addr;
+    return (Transport){ udp, udp_send, udp_recv, NULL, udp_close };
+}
+
+uint16_t udp_transport_port(const Transport* t){
+    const UDP* udp = t->ctx;
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    getsockname(udp->fd, (struct sockaddr*) &addr, &len);
+    return ntohs(addr.sin_port);
+}
+
+void udp_transport_peer(Transport* t, uint16_t port){
+    UDP* udp = t->ctx;
+    udp->peer.sin_port = htons(port);
+}
+
+static uint32_t xorshift(uint32_t* s){
+    *s ^= *s << 13;
+    *s ^= *s >> 17;
+    *s ^= *s << 5;
+    return *s;
+}
+
+static void lagged_send(void* ctx, const uint8_t* data, size_t len){
+    Lagged* lag = ctx;
+    lag->inner.send(lag->inner.ctx, data, len);
+}
+
+static ssize_t lagged_recv(void* ctx, uint8_t* buf, size_t cap){
+    /* arrivals are held latency + [0, jitter] ticks, so jitter reorders */
+    Lagged* lag = ctx;
+    Packet p;
+    ssize_t n;
+    while (lag->n < QUEUE_CAP && (n = lag->inner.recv(lag->inner.ctx, p.data, PACKET_MAX)) >= 0){
+        p.len = n;
+        p.due = lag->now + lag->latency + (lag->jitter ? xorshift(&lag->rng) % (lag->jitter + 1) : 0);
+        lag->held[lag->n++] = p;
+    }
+    for (unsigned i = 0; i < lag->n; ++i){
+        if (lag->held[i].due > lag->now)
+            continue;
+        size_t len = lag->held[i].len < cap ? lag->held[i].len : cap;
+        memcpy(buf, lag->held[i].data, len);
+        lag->held[i] = lag->held[--lag->n];
+        return len;
+    }
+    return -1;
+}
+
+static void lagged_tick(void* ctx){
+    Lagged* lag = ctx;
+    lag->now++;
+    if (lag->inner.tick != NULL)
+        lag->inner.tick(lag->inner.ctx);
+}
+
+static void lagged_close(void* ctx){
+    Lagged* lag = ctx;
+    close_transport(&lag->inner);
+    free(lag);
+}
+
+Transport make_lagged_transport(Transport inner, unsigned latency, unsigned jitter, uint32_t seed){
+    /* delays what inner receives, in ticks (frames) */
+    Lagged* lag = xalloc(1, sizeof(Lagged), calloc);
+    lag->inner = inner;
+    lag->latency = latency;
+    lag->jitter = jitter;
+    lag->rng = seed ? seed : 1;
+    return (Transport){ lag, lagged_send, lagged_recv, lagged_tick, lagged_close };
+}
+
+void close_transport(Transport* t){
+    if (t->close != NULL)
+        t->close(t->ctx);
+    t->ctx = NULL;
+}
+
+/* sessions */
+
+Netplay* make_netplay(NES* nes, Transport transport, uint8_t port){
+    /* both sides must start from the same state, e.g. right after power_on */
+    if (port >= 2)
+        err_exit("Netplay: port %u, only 0 and 1 are playable", port);
+    Netplay* np = xalloc(1, sizeof(Netplay), calloc);
+    np->nes = nes;
+    np->transport = transport;
+    np->port = port;
+    np->rollback = UINT64_MAX;
+    for (int i = 0; i < NETPLAY_RING; ++i)
+        np->remote_frame[i] = UINT64_MAX;
+    return np;
+}
+
+void free_netplay(Netplay* np){
+    /* the transport goes with it, the NES doesn't */
+    if (np == NULL)
+        return;
+    close_transport(&np->transport);
+    free(np);
+}
+
+bool netplay_advance(Netplay* np, uint8_t input){
+    /* run the next frame with the local player's input. False when it
+       couldn't: the other side is a whole window behind, try again later */
+    if (np->transport.tick != NULL)
+        np->transport.tick(np->transport.ctx);
+    netplay_poll(np);
+    if (np->frame >= np->confirmed + NETPLAY_WINDOW){
+        np->stats.stalls++;
+        send_inputs(np, np->frame); /* in case ours were lost */
+        return false;
+    }
+    np->local[np->frame % NETPLAY_RING] = input;
+    send_inputs(np, np->frame + 1);
+    save_state(np->nes, &np->states[np->frame % NETPLAY_WINDOW]);
+    set_inputs(np, np->frame);
+    /* the peer won't wait on a breakpoint: the stop is counted by the
+       debugger and the frame carried on, or the sessions would part */
+    while (!run_frame(np->nes))
+        ;
+    np->frame++;
+    np->stats.frames++;
+    return true;
+}
+
+bool netplay_poll(Netplay* np){
+    /* take in what arrived and fix any wrong guesses. True when every
+       remote input up to the current frame is in */
+    receive(np);
+    if (np->rollback != UINT64_MAX)
+        roll_back(np);
+    return np->confirmed >= np->frame;
+}
+
+static void send_inputs(Netplay* np, uint64_t end){
+    /* the last NETPLAY_REDUNDANCY local inputs before frame end */
+    if (end == 0)
+        return;
+    uint64_t first = end > NETPLAY_REDUNDANCY ? end - NETPLAY_REDUNDANCY : 0;
+    uint8_t packet[PACKET_HEADER + NETPLAY_REDUNDANCY] = { 'N', 'P' };
+    for (int i = 0; i < 4; ++i)
+        packet[2 + i] = first >> (8 * i);
+    packet[6] = end - first;
+    for (uint64_t f = first; f < end; ++f)
+        packet[PACKET_HEADER + f - first] = np->local[f % NETPLAY_RING];
+    np->transport.send(np->transport.ctx, packet, PACKET_HEADER + end - first);
+}
+
+static void receive(Netplay* np){
+    uint8_t packet[PACKET_MAX];
+    ssize_t len;
+    while ((len = np->transport.recv(np->transport.ctx, packet, sizeof(packet))) >= 0){
+        if (len < PACKET_HEADER || packet[0] != 'N' || packet[1] != 'P' || len < PACKET_HEADER + packet[6])
+            continue;
+        uint64_t first = 0;
+        for (int i = 0; i < 4; ++i)
+            first |= (uint64_t) packet[2 + i] << (8 * i);
+        for (int i = 0; i < packet[6]; ++i){
+            uint64_t f = first + i;
+            if (f < np->confirmed || f >= np->confirmed + NETPLAY_RING)
+                continue;
+            np->remote[f % NETPLAY_RING] = packet[PACKET_HEADER + i];
+            np->remote_frame[f % NETPLAY_RING] = f;
+        }
+    }
+    /* confirm in order. A frame already run with a different guess is
+       where a rollback has to start */
+    for (;;){
+        unsigned slot = np->confirmed % NETPLAY_RING;
+        if (np->remote_frame[slot] != np->confirmed)
+            break;
+        if (np->confirmed < np->frame && np->remote[slot] != np->guessed[slot] && np->confirmed < np->rollback)
+            np->rollback = np->confirmed;
+        np->confirmed++;
+    }
+}
+
+static void set_inputs(Netplay* np, uint64_t frame){
+    /* the remote input if it's here, otherwise the last confirmed one */
+    unsigned slot = frame % NETPLAY_RING;
+    uint8_t remote = 0;
+    if (np->remote_frame[slot] == frame)
+        remote = np->remote[slot];
+    else if (np->confirmed > 0)
+        remote = np->remote[(np->confirmed - 1) % NETPLAY_RING];
+    np->guessed[slot] = remote;
+    np->nes->input[np->port] = np->local[slot];
+    np->nes->input[np->port ^ 1] = remote;
+}
+
+static void roll_back(Netplay* np){
+    /* back to the first wrongly guessed frame and up to now again, hidden
+       like run-ahead frames: no picture, sound, movie or hashes */
+    NES* nes = np->nes;
+    uint64_t from = np->rollback;
+    np->rollback = UINT64_MAX;
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &start);
+    Renderer* renderer = nes->renderer;
+    nes->renderer = NULL;
+    load_state(nes, &np->states[from % NETPLAY_WINDOW]);
+    bool synth = nes->apu.synth;
+    nes->apu.synth = false;
+    nes->hidden = true;
+    for (uint64_t f = from; f < np->frame; ++f){
+        if (f > from)
+            save_state(nes, &np->states[f % NETPLAY_WINDOW]);
+        set_inputs(np, f);
+        run_frame(nes);
+    }
+    nes->hidden = false;
+    nes->apu.synth = synth;
+    nes->renderer = renderer;
+    if (renderer != NULL)
+        render_sync(renderer, &nes->ppu);
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &end);
+
+    unsigned depth = np->frame - from;
+    np->stats.rollbacks++;
+    np->stats.rolled_back += depth;
+    if (depth > np->stats.max_depth)
+        np->stats.max_depth = depth;
+    np->stats.resim_ns += (end.tv_sec - start.tv_sec) * 1000000000ull + end.tv_nsec - start.tv_nsec;
+}
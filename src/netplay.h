@@ -0,0 +1,69 @@
+#ifndef NETPLAY_H
+#define NETPLAY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "nes.h"
+
+/* Two player rollback netplay. Each side runs its own input as soon as
+   it has it and guesses the other's (the last one it got). States for
+   the last NETPLAY_WINDOW frames are kept; when a real input turns out
+   different from the guess, the state from that frame is loaded and the
+   frames since are run again, hidden, in one go */
+
+#define NETPLAY_WINDOW 8 /* frames a guess can be rolled back */
+#define NETPLAY_RING 64 /* inputs kept per side, more than the window */
+#define NETPLAY_REDUNDANCY 8 /* inputs per packet, newest last, lost packets are covered by the next */
+
+/* Packets between the two sides. recv returns one packet's length, -1
+   when none is waiting. tick, if set, is called once per frame */
+typedef struct Transport{
+    void* ctx;
+    void (*send)(void*, const uint8_t*, size_t);
+    ssize_t (*recv)(void*, uint8_t*, size_t);
+    void (*tick)(void*);
+    void (*close)(void*);
+} Transport;
+
+void make_loopback_pair(Transport*, Transport*);
+Transport make_udp_transport(uint16_t); /* bound to this port on 127.0.0.1, 0 picks one */
+uint16_t udp_transport_port(const Transport*);
+void udp_transport_peer(Transport*, uint16_t);
+Transport make_lagged_transport(Transport, unsigned, unsigned, uint32_t); /* latency and jitter in frames, seed */
+void close_transport(Transport*);
+
+typedef struct NetplayStats{
+    uint64_t frames;
+    uint64_t rollbacks;
+    uint64_t rolled_back; /* frames run again, over all rollbacks */
+    unsigned max_depth;
+    uint64_t resim_ns; /* thread CPU time spent in rollbacks */
+    uint64_t stalls; /* frames not run because the other side was a window behind */
+} NetplayStats;
+
+typedef struct Netplay{
+    NES* nes;
+    Transport transport;
+    uint8_t port; /* controller port of the local player */
+    uint64_t frame; /* next frame to run */
+
+    uint8_t local[NETPLAY_RING];
+    uint8_t remote[NETPLAY_RING];
+    uint64_t remote_frame[NETPLAY_RING]; /* frame each remote slot holds */
+    uint8_t guessed[NETPLAY_RING]; /* remote input each frame ran with */
+    uint64_t confirmed; /* remote inputs before this frame are all in */
+    uint64_t rollback; /* earliest frame run with a wrong guess, UINT64_MAX when none */
+
+    Snapshot states[NETPLAY_WINDOW]; /* state at the start of each frame */
+    NetplayStats stats;
+} Netplay;
+
+Netplay* make_netplay(NES*, Transport, uint8_t);
+void free_netplay(Netplay*);
+bool netplay_advance(Netplay*, uint8_t);
+bool netplay_poll(Netplay*);
+
+#endif
@@ -0,0 +1,290 @@
+#ifndef OPCODES_H
+#define OPCODES_H
+
+/* Every 6502 opcode, the one place they're described. cpu.c expands this
+   into the dispatch switch, the cycle table and the debug disassembly,
+   analyze.c into the static disassembler's instruction lengths.
+
+   OP(opcode, mnemonic, handler, addressing mode, base cycles, official)
+
+   The addressing mode names the addr_ function that resolves the operand,
+   and picks the bus access the handler is specialised with. Base cycles
+   don't include page crossing or taken branch penalties */
+
+/* operand bytes following the opcode, per addressing mode */
+#define BYTES_Accumulator 0
+#define BYTES_Absolute 2
+#define BYTES_AbsoluteX 2
+#define BYTES_AbsoluteX_NoPageCheck 2
+#define BYTES_AbsoluteY 2
+#define BYTES_AbsoluteY_NoPageCheck 2
+#define BYTES_Immediate 1
+#define BYTES_Implied 0
+#define BYTES_Indirect 2
+#define BYTES_IndirectX 1
+#define BYTES_IndirectY 1
+#define BYTES_IndirectY_NoPageCheck 1
+#define BYTES_Relative 1
+#define BYTES_ZeroPage 1
+#define BYTES_ZeroPageX 1
+#define BYTES_ZeroPageY 1
+
+#define OPCODE_TABLE(OP) \
+    OP(0x00, BRK, BRK,   Implied,               7, 1) \
+    OP(0x01, ORA, ORA,   IndirectX,             6, 1) \
+    OP(0x02, JAM, JAM,   Implied,               2, 0) \
+    OP(0x03, SLO, SLO,   IndirectX,             8, 0) \
+    OP(0x04, NOP, NOP,   ZeroPage,              3, 0) \
+    OP(0x05, ORA, ORA,   ZeroPage,              3, 1) \
+    OP(0x06, ASL, ASL,   ZeroPage,              5, 1) \
+    OP(0x07, SLO, SLO,   ZeroPage,              5, 0) \
+    OP(0x08, PHP, PHP,   Implied,               3, 1) \
+    OP(0x09, ORA, ORA,   Immediate,             2, 1) \
+    OP(0x0A, ASL, ASL_A, Accumulator,           2, 1) \
+    OP(0x0B, ANC, ANC,   Immediate,             2, 0) \
+    OP(0x0C, NOP, NOP,   Absolute,              4, 0) \
+    OP(0x0D, ORA, ORA,   Absolute,              4, 1) \
+    OP(0x0E, ASL, ASL,   Absolute,              6, 1) \
+    OP(0x0F, SLO, SLO,   Absolute,              6, 0) \
+    OP(0x10, BPL, BPL,   Relative,              2, 1) \
+    OP(0x11, ORA, ORA,   IndirectY,             5, 1) \
+    OP(0x12, JAM, JAM,   Implied,               2, 0) \
+    OP(0x13, SLO, SLO,   IndirectY_NoPageCheck, 8, 0) \
+    OP(0x14, NOP, NOP,   ZeroPageX,             4, 0) \
+    OP(0x15, ORA, ORA,   ZeroPageX,             4, 1) \
+    OP(0x16, ASL, ASL,   ZeroPageX,             6, 1) \
+    OP(0x17, SLO, SLO,   ZeroPageX,             6, 0) \
+    OP(0x18, CLC, CLC,   Implied,               2, 1) \
+    OP(0x19, ORA, ORA,   AbsoluteY,             4, 1) \
+    OP(0x1A, NOP, NOP,   Implied,               2, 0) \
+    OP(0x1B, SLO, SLO,   AbsoluteY_NoPageCheck, 7, 0) \
+    OP(0x1C, NOP, NOP,   AbsoluteX,             4, 0) \
+    OP(0x1D, ORA, ORA,   AbsoluteX,             4, 1) \
+    OP(0x1E, ASL, ASL,   AbsoluteX_NoPageCheck, 7, 1) \
+    OP(0x1F, SLO, SLO,   AbsoluteX_NoPageCheck, 7, 0) \
+    OP(0x20, JSR, JSR,   Absolute,              6, 1) \
+    OP(0x21, AND, AND,   IndirectX,             6, 1) \
+    OP(0x22, JAM, JAM,   Implied,               2, 0) \
+    OP(0x23, RLA, RLA,   IndirectX,             8, 0) \
+    OP(0x24, BIT, BIT,   ZeroPage,              3, 1) \
+    OP(0x25, AND, AND,   ZeroPage,              3, 1) \
+    OP(0x26, ROL, ROL,   ZeroPage,              5, 1) \
+    OP(0x27, RLA, RLA,   ZeroPage,              5, 0) \
+    OP(0x28, PLP, PLP,   Implied,               4, 1) \
+    OP(0x29, AND, AND,   Immediate,             2, 1) \
+    OP(0x2A, ROL, ROL_A, Accumulator,           2, 1) \
+    OP(0x2B, ANC, ANC,   Immediate,             2, 0) \
+    OP(0x2C, BIT, BIT,   Absolute,              4, 1) \
+    OP(0x2D, AND, AND,   Absolute,              4, 1) \
+    OP(0x2E, ROL, ROL,   Absolute,              6, 1) \
+    OP(0x2F, RLA, RLA,   Absolute,              6, 0) \
+    OP(0x30, BMI, BMI,   Relative,              2, 1) \
+    OP(0x31, AND, AND,   IndirectY,             5, 1) \
+    OP(0x32, JAM, JAM,   Implied,               2, 0) \
+    OP(0x33, RLA, RLA,   IndirectY_NoPageCheck, 8, 0) \
+    OP(0x34, NOP, NOP,   ZeroPageX,             4, 0) \
+    OP(0x35, AND, AND,   ZeroPageX,             4, 1) \
+    OP(0x36, ROL, ROL,   ZeroPageX,             6, 1) \
+    OP(0x37, RLA, RLA,   ZeroPageX,             6, 0) \
+    OP(0x38, SEC, SEC,   Implied,               2, 1) \
+    OP(0x39, AND, AND,   AbsoluteY,             4, 1) \
+    OP(0x3A, NOP, NOP,   Implied,               2, 0) \
+    OP(0x3B, RLA, RLA,   AbsoluteY_NoPageCheck, 7, 0) \
+    OP(0x3C, NOP, NOP,   AbsoluteX,             4, 0) \
+    OP(0x3D, AND, AND,   AbsoluteX,             4, 1) \
+    OP(0x3E, ROL, ROL,   AbsoluteX_NoPageCheck, 7, 1) \
+    OP(0x3F, RLA, RLA,   AbsoluteX_NoPageCheck, 7, 0) \
+    OP(0x40, RTI, RTI,   Implied,               6, 1) \
+    OP(0x41, EOR, EOR,   IndirectX,             6, 1) \
+    OP(0x42, JAM, JAM,   Implied,               2, 0) \
+    OP(0x43, SRE, SRE,   IndirectX,             8, 0) \
+    OP(0x44, NOP, NOP,   ZeroPage,              3, 0) \
+    OP(0x45, EOR, EOR,   ZeroPage,              3, 1) \
+    OP(0x46, LSR, LSR,   ZeroPage,              5, 1) \
+    OP(0x47, SRE, SRE,   ZeroPage,              5, 0) \
+    OP(0x48, PHA, PHA,   Implied,               3, 1) \
+    OP(0x49, EOR, EOR,   Immediate,             2, 1) \
+    OP(0x4A, LSR, LSR_A, Accumulator,           2, 1) \
+    OP(0x4B, ALR, ALR,   Immediate,             2, 0) \
+    OP(0x4C, JMP, JMP,   Absolute,              3, 1) \
+    OP(0x4D, EOR, EOR,   Absolute,              4, 1) \
+    OP(0x4E, LSR, LSR,   Absolute,              6, 1) \
+    OP(0x4F, SRE, SRE,   Absolute,              6, 0) \
+    OP(0x50, BVC, BVC,   Relative,              2, 1) \
+    OP(0x51, EOR, EOR,   IndirectY,             5, 1) \
+    OP(0x52, JAM, JAM,   Implied,               2, 0) \
+    OP(0x53, SRE, SRE,   IndirectY_NoPageCheck, 8, 0) \
+    OP(0x54, NOP, NOP,   ZeroPageX,             4, 0) \
+    OP(0x55, EOR, EOR,   ZeroPageX,             4, 1) \
+    OP(0x56, LSR, LSR,   ZeroPageX,             6, 1) \
+    OP(0x57, SRE, SRE,   ZeroPageX,             6, 0) \
+    OP(0x58, CLI, CLI,   Implied,               2, 1) \
+    OP(0x59, EOR, EOR,   AbsoluteY,             4, 1) \
+    OP(0x5A, NOP, NOP,   Implied,               2, 0) \
+    OP(0x5B, SRE, SRE,   AbsoluteY_NoPageCheck, 7, 0) \
+    OP(0x5C, NOP, NOP,   AbsoluteX,             4, 0) \
+    OP(0x5D, EOR, EOR,   AbsoluteX,             4, 1) \
+    OP(0x5E, LSR, LSR,   AbsoluteX_NoPageCheck, 7, 1) \
+    OP(0x5F, SRE, SRE,   AbsoluteX_NoPageCheck, 7, 0) \
+    OP(0x60, RTS, RTS,   Implied,               6, 1) \
+    OP(0x61, ADC, ADC,   IndirectX,             6, 1) \
+    OP(0x62, JAM, JAM,   Implied,               2, 0) \
+    OP(0x63, RRA, RRA,   IndirectX,             8, 0) \
+    OP(0x64, NOP, NOP,   ZeroPage,              3, 0) \
+    OP(0x65, ADC, ADC,   ZeroPage,              3, 1) \
+    OP(0x66, ROR, ROR,   ZeroPage,              5, 1) \
+    OP(0x67, RRA, RRA,   ZeroPage,              5, 0) \
+    OP(0x68, PLA, PLA,   Implied,               4, 1) \
+    OP(0x69, ADC, ADC,   Immediate,             2, 1) \
+    OP(0x6A, ROR, ROR_A, Accumulator,           2, 1) \
+    OP(0x6B, ARR, ARR,   Immediate,             2, 0) \
+    OP(0x6C, JMP, JMP,   Indirect,              5, 1) \
+    OP(0x6D, ADC, ADC,   Absolute,              4, 1) \
+    OP(0x6E, ROR, ROR,   Absolute,              6, 1) \
+    OP(0x6F, RRA, RRA,   Absolute,              6, 0) \
+    OP(0x70, BVS, BVS,   Relative,              2, 1) \
+    OP(0x71, ADC, ADC,   IndirectY,             5, 1) \
+    OP(0x72, JAM, JAM,   Implied,               2, 0) \
+    OP(0x73, RRA, RRA,   IndirectY_NoPageCheck, 8, 0) \
+    OP(0x74, NOP, NOP,   ZeroPageX,             4, 0) \
+    OP(0x75, ADC, ADC,   ZeroPageX,             4, 1) \
+    OP(0x76, ROR, ROR,   ZeroPageX,             6, 1) \
+    OP(0x77, RRA, RRA,   ZeroPageX,             6, 0) \
+    OP(0x78, SEI, SEI,   Implied,               2, 1) \
+    OP(0x79, ADC, ADC,   AbsoluteY,             4, 1) \
+    OP(0x7A, NOP, NOP,   Implied,               2, 0) \
+    OP(0x7B, RRA, RRA,   AbsoluteY_NoPageCheck, 7, 0) \
+    OP(0x7C, NOP, NOP,   AbsoluteX,             4, 0) \
+    OP(0x7D, ADC, ADC,   AbsoluteX,             4, 1) \
+    OP(0x7E, ROR, ROR,   AbsoluteX_NoPageCheck, 7, 1) \
+    OP(0x7F, RRA, RRA,   AbsoluteX_NoPageCheck, 7, 0) \
+    OP(0x80, NOP, NOP,   Immediate,             2, 0) \
+    OP(0x81, STA, STA,   IndirectX,             6, 1) \
+    OP(0x82, NOP, NOP,   Immediate,             2, 0) \
+    OP(0x83, SAX, SAX,   IndirectX,             6, 0) \
+    OP(0x84, STY, STY,   ZeroPage,              3, 1) \
+    OP(0x85, STA, STA,   ZeroPage,              3, 1) \
+    OP(0x86, STX, STX,   ZeroPage,              3, 1) \
+    OP(0x87, SAX, SAX,   ZeroPage,              3, 0) \
+    OP(0x88, DEY, DEY,   Implied,               2, 1) \
+    OP(0x89, NOP, NOP,   Immediate,             2, 0) \
+    OP(0x8A, TXA, TXA,   Implied,               2, 1) \
+    OP(0x8B, XAA, XAA,   Immediate,             2, 0) \
+    OP(0x8C, STY, STY,   Absolute,              4, 1) \
+    OP(0x8D, STA, STA,   Absolute,              4, 1) \
+    OP(0x8E, STX, STX,   Absolute,              4, 1) \
+    OP(0x8F, SAX, SAX,   Absolute,              4, 0) \
+    OP(0x90, BCC, BCC,   Relative,              2, 1) \
+    OP(0x91, STA, STA,   IndirectY_NoPageCheck, 6, 1) \
+    OP(0x92, JAM, JAM,   Implied,               2, 0) \
+    OP(0x93, SHA, SHA,   IndirectY_NoPageCheck, 6, 0) \
+    OP(0x94, STY, STY,   ZeroPageX,             4, 1) \
+    OP(0x95, STA, STA,   ZeroPageX,             4, 1) \
+    OP(0x96, STX, STX,   ZeroPageY,             4, 1) \
+    OP(0x97, SAX, SAX,   ZeroPageY,             4, 0) \
+    OP(0x98, TYA, TYA,   Implied,               2, 1) \
+    OP(0x99, STA, STA,   AbsoluteY_NoPageCheck, 5, 1) \
+    OP(0x9A, TXS, TXS,   Implied,               2, 1) \
+    OP(0x9B, TAS, TAS,   AbsoluteY_NoPageCheck, 5, 0) \
+    OP(0x9C, SHY, SHY,   AbsoluteX_NoPageCheck, 5, 0) \
+    OP(0x9D, STA, STA,   AbsoluteX_NoPageCheck, 5, 1) \
+    OP(0x9E, SHX, SHX,   AbsoluteY_NoPageCheck, 5, 0) \
+    OP(0x9F, SHA, SHA,   AbsoluteY_NoPageCheck, 5, 0) \
+    OP(0xA0, LDY, LDY,   Immediate,             2, 1) \
+    OP(0xA1, LDA, LDA,   IndirectX,             6, 1) \
+    OP(0xA2, LDX, LDX,   Immediate,             2, 1) \
+    OP(0xA3, LAX, LAX,   IndirectX,             6, 0) \
+    OP(0xA4, LDY, LDY,   ZeroPage,              3, 1) \
+    OP(0xA5, LDA, LDA,   ZeroPage,              3, 1) \
+    OP(0xA6, LDX, LDX,   ZeroPage,              3, 1) \
+    OP(0xA7, LAX, LAX,   ZeroPage,              3, 0) \
+    OP(0xA8, TAY, TAY,   Implied,               2, 1) \
+    OP(0xA9, LDA, LDA,   Immediate,             2, 1) \
+    OP(0xAA, TAX, TAX,   Implied,               2, 1) \
+    OP(0xAB, LXA, LXA,   Immediate,             2, 0) \
+    OP(0xAC, LDY, LDY,   Absolute,              4, 1) \
+    OP(0xAD, LDA, LDA,   Absolute,              4, 1) \
+    OP(0xAE, LDX, LDX,   Absolute,              4, 1) \
+    OP(0xAF, LAX, LAX,   Absolute,              4, 0) \
+    OP(0xB0, BCS, BCS,   Relative,              2, 1) \
+    OP(0xB1, LDA, LDA,   IndirectY,             5, 1) \
+    OP(0xB2, JAM, JAM,   Implied,               2, 0) \
+    OP(0xB3, LAX, LAX,   IndirectY,             5, 0) \
+    OP(0xB4, LDY, LDY,   ZeroPageX,             4, 1) \
+    OP(0xB5, LDA, LDA,   ZeroPageX,             4, 1) \
+    OP(0xB6, LDX, LDX,   ZeroPageY,             4, 1) \
+    OP(0xB7, LAX, LAX,   ZeroPageY,             4, 0) \
+    OP(0xB8, CLV, CLV,   Implied,               2, 1) \
+    OP(0xB9, LDA, LDA,   AbsoluteY,             4, 1) \
+    OP(0xBA, TSX, TSX,   Implied,               2, 1) \
+    OP(0xBB, LAS, LAS,   AbsoluteY,             4, 0) \
+    OP(0xBC, LDY, LDY,   AbsoluteX,             4, 1) \
+    OP(0xBD, LDA, LDA,   AbsoluteX,             4, 1) \
+    OP(0xBE, LDX, LDX,   AbsoluteY,             4, 1) \
+    OP(0xBF, LAX, LAX,   AbsoluteY,             4, 0) \
+    OP(0xC0, CPY, CPY,   Immediate,             2, 1) \
+    OP(0xC1, CMP, CMP,   IndirectX,             6, 1) \
+    OP(0xC2, NOP, NOP,   Immediate,             2, 0) \
+    OP(0xC3, DCP, DCP,   IndirectX,             8, 0) \
+    OP(0xC4, CPY, CPY,   ZeroPage,              3, 1) \
+    OP(0xC5, CMP, CMP,   ZeroPage,              3, 1) \
+    OP(0xC6, DEC, DEC,   ZeroPage,              5, 1) \
+    OP(0xC7, DCP, DCP,   ZeroPage,              5, 0) \
+    OP(0xC8, INY, INY,   Implied,               2, 1) \
+    OP(0xC9, CMP, CMP,   Immediate,             2, 1) \
+    OP(0xCA, DEX, DEX,   Implied,               2, 1) \
+    OP(0xCB, AXS, AXS,   Immediate,             2, 0) \
+    OP(0xCC, CPY, CPY,   Absolute,              4, 1) \
+    OP(0xCD, CMP, CMP,   Absolute,              4, 1) \
+    OP(0xCE, DEC, DEC,   Absolute,              6, 1) \
+    OP(0xCF, DCP, DCP,   Absolute,              6, 0) \
+    OP(0xD0, BNE, BNE,   Relative,              2, 1) \
+    OP(0xD1, CMP, CMP,   IndirectY,             5, 1) \
+    OP(0xD2, JAM, JAM,   Implied,               2, 0) \
+    OP(0xD3, DCP, DCP,   IndirectY_NoPageCheck, 8, 0) \
+    OP(0xD4, NOP, NOP,   ZeroPageX,             4, 0) \
+    OP(0xD5, CMP, CMP,   ZeroPageX,             4, 1) \
+    OP(0xD6, DEC, DEC,   ZeroPageX,             6, 1) \
+    OP(0xD7, DCP, DCP,   ZeroPageX,             6, 0) \
+    OP(0xD8, CLD, CLD,   Implied,               2, 1) \
+    OP(0xD9, CMP, CMP,   AbsoluteY,             4, 1) \
+    OP(0xDA, NOP, NOP,   Implied,               2, 0) \
+    OP(0xDB, DCP, DCP,   AbsoluteY_NoPageCheck, 7, 0) \
+    OP(0xDC, NOP, NOP,   AbsoluteX,             4, 0) \
+    OP(0xDD, CMP, CMP,   AbsoluteX,             4, 1) \
+    OP(0xDE, DEC, DEC,   AbsoluteX_NoPageCheck, 7, 1) \
+    OP(0xDF, DCP, DCP,   AbsoluteX_NoPageCheck, 7, 0) \
+    OP(0xE0, CPX, CPX,   Immediate,             2, 1) \
+    OP(0xE1, SBC, SBC,   IndirectX,             6, 1) \
+    OP(0xE2, NOP, NOP,   Immediate,             2, 0) \
+    OP(0xE3, ISB, ISB,   IndirectX,             8, 0) \
+    OP(0xE4, CPX, CPX,   ZeroPage,              3, 1) \
+    OP(0xE5, SBC, SBC,   ZeroPage,              3, 1) \
+    OP(0xE6, INC, INC,   ZeroPage,              5, 1) \
+    OP(0xE7, ISB, ISB,   ZeroPage,              5, 0) \
+    OP(0xE8, INX, INX,   Implied,               2, 1) \
+    OP(0xE9, SBC, SBC,   Immediate,             2, 1) \
+    OP(0xEA, NOP, NOP,   Implied,               2, 1) \
+    OP(0xEB, SBC, SBC,   Immediate,             2, 0) \
+    OP(0xEC, CPX, CPX,   Absolute,              4, 1) \
+    OP(0xED, SBC, SBC,   Absolute,              4, 1) \
+    OP(0xEE, INC, INC,   Absolute,              6, 1) \
+    OP(0xEF, ISB, ISB,   Absolute,              6, 0) \
+    OP(0xF0, BEQ, BEQ,   Relative,              2, 1) \
+    OP(0xF1, SBC, SBC,   IndirectY,             5, 1) \
+    OP(0xF2, JAM, JAM,   Implied,               2, 0) \
+    OP(0xF3, ISB, ISB,   IndirectY_NoPageCheck, 8, 0) \
+    OP(0xF4, NOP, NOP,   ZeroPageX,             4, 0) \
+    OP(0xF5, SBC, SBC,   ZeroPageX,             4, 1) \
+    OP(0xF6, INC, INC,   ZeroPageX,             6, 1) \
+    OP(0xF7, ISB, ISB,   ZeroPageX,             6, 0) \
+    OP(0xF8, SED, SED,   Implied,               2, 1) \
+    OP(0xF9, SBC, SBC,   AbsoluteY,             4, 1) \
+    OP(0xFA, NOP, NOP,   Implied,               2, 0) \
+    OP(0xFB, ISB, ISB,   AbsoluteY_NoPageCheck, 7, 0) \
+    OP(0xFC, NOP, NOP,   AbsoluteX,             4, 0) \
+    OP(0xFD, SBC, SBC,   AbsoluteX,             4, 1) \
+    OP(0xFE, INC, INC,   AbsoluteX_NoPageCheck, 7, 1) \
+    OP(0xFF, ISB, ISB,   AbsoluteX_NoPageCheck, 7, 0)
+
+#endif
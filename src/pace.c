@@ -0,0 +1,101 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "pace.h"
+#include "util.h"
+
+static uint64_t clock_ns(clockid_t);
+static void sleep_until(uint64_t);
+static int compare_ns(const void*, const void*);
+
+Pacer* make_pacer(double speed, uint64_t frames){
+    /* frames sizes the frame time log, it grows past that if needed */
+    if (speed < 0)
+        err_exit("Pacer: speed can't be negative, got %g", speed);
+    Pacer* p = xalloc(1, sizeof(Pacer), calloc);
+    p->speed = speed;
+    p->period_ns = speed > 0 ? FRAME_NS / speed : 0;
+    p->cap = frames > 0 ? frames : 1;
+    p->frame_ns = xalloc(p->cap, sizeof(uint32_t), twoarg_malloc);
+    p->start_ns = p->epoch = p->wake = clock_ns(CLOCK_MONOTONIC);
+    p->start_cpu_ns = clock_ns(CLOCK_PROCESS_CPUTIME_ID);
+    return p;
+}
+
+void free_pacer(Pacer* p){
+    free(p->frame_ns);
+    free(p);
+}
+
+void pace_frame(Pacer* p){
+    /* call once a frame is done, returns when the next one should start */
+    uint64_t now = clock_ns(CLOCK_MONOTONIC);
+    if (p->frames == p->cap){
+        p->cap *= 2;
+        p->frame_ns = realloc(p->frame_ns, p->cap * sizeof(uint32_t));
+        if (p->frame_ns == NULL)
+            err_exit("Pacer: Failed to grow frame log to %lu frames", p->cap);
+    }
+    uint64_t spent = now - p->wake;
+    p->frame_ns[p->frames++] = spent < UINT32_MAX ? spent : UINT32_MAX;
+
+    if (p->speed > 0){
+        uint64_t deadline = p->epoch + (uint64_t)(++p->due * p->period_ns);
+        if (now > deadline + PACE_MAX_LAG * p->period_ns){
+            /* a stall (debugger, swapped out host): drop the lost time */
+            p->epoch = now;
+            p->due = 0;
+            ++p->resyncs;
+        }
+        else if (now < deadline){
+            sleep_until(deadline);
+            now = clock_ns(CLOCK_MONOTONIC);
+        }
+    }
+    p->wake = now;
+}
+
+void pace_report(const Pacer* p, FILE* out){
+    double wall = (clock_ns(CLOCK_MONOTONIC) - p->start_ns) / 1e9;
+    double cpu = (clock_ns(CLOCK_PROCESS_CPUTIME_ID) - p->start_cpu_ns) / 1e9;
+    double pct[4] = {0};
+    if (p->frames > 0){
+        uint32_t* sorted = xalloc(p->frames, sizeof(uint32_t), twoarg_malloc);
+        memcpy(sorted, p->frame_ns, p->frames * sizeof(uint32_t));
+        qsort(sorted, p->frames, sizeof(uint32_t), compare_ns);
+        const double at[4] = {0.5, 0.9, 0.99, 1.0};
+        for (int i = 0; i < 4; ++i)
+            pct[i] = sorted[(uint64_t)(at[i] * (p->frames - 1))] / 1e6;
+        free(sorted);
+    }
+    char speed[32];
+    if (p->speed > 0)
+        snprintf(speed, sizeof(speed), "%gx", p->speed);
+    else
+        snprintf(speed, sizeof(speed), "turbo");
+    /* host CPU counts every thread, so the renderer can take it past 100% */
+    fprintf(out, "speed %s: %.2f fps emulated, %.1f%% host CPU, frame time p50 %.3f p90 %.3f p99 %.3f max %.3f ms, %lu resyncs\n",
+            speed, wall > 0 ? p->frames / wall : 0.0, wall > 0 ? 100 * cpu / wall : 0.0,
+            pct[0], pct[1], pct[2], pct[3], p->resyncs);
+}
+
+static uint64_t clock_ns(clockid_t clock){
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void sleep_until(uint64_t deadline){
+    struct timespec ts = { deadline / 1000000000ull, deadline % 1000000000ull };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+        ;
+}
+
+static int compare_ns(const void* a, const void* b){
+    uint32_t x = *(const uint32_t*) a, y = *(const uint32_t*) b;
+    return (x > y) - (x < y);
+}
@@ -0,0 +1,35 @@
+#ifndef PACE_H
+#define PACE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "apu.h"
+#include "ppu.h"
+
+/* NTSC frames average 89341.5 dots, rendering skips a dot every odd frame */
+#define FRAME_NS ((PPU_DOTS_PER_FRAME - 0.5) / PPU_DOTS_PER_CPU_CYCLE / CPU_CLOCK_NTSC * 1e9)
+#define PACE_MAX_LAG 4 /* frames behind before deadlines restart from now */
+
+/* Holds frames to speed x the NTSC rate with absolute CLOCK_MONOTONIC
+   deadlines. Frame n is due at epoch + n * period, so sleep overshoot
+   never adds up. Falling further behind than PACE_MAX_LAG moves the
+   epoch instead of running a burst to catch up. Speed 0 never sleeps */
+typedef struct Pacer{
+    double speed;
+    double period_ns;
+    uint64_t epoch;
+    uint64_t due; /* frames since epoch */
+    uint64_t resyncs;
+    uint64_t wake; /* when the current frame started */
+    uint32_t* frame_ns; /* time spent in each frame, sleeping excluded */
+    uint64_t frames, cap;
+    uint64_t start_ns, start_cpu_ns;
+} Pacer;
+
+Pacer* make_pacer(double, uint64_t);
+void free_pacer(Pacer*);
+void pace_frame(Pacer*);
+void pace_report(const Pacer*, FILE*);
+
+#endif
@@ -1,8 +1,260 @@
+#include <stdlib.h>
+#include <string.h>
+
 #include "mem.h"
 #include "ppu.h"
 #include "util.h"
 
+const uint8_t PALETTE_RGB[64][3] = {
+    {84,84,84}, {0,30,116}, {8,16,144}, {48,0,136}, {68,0,100}, {92,0,48}, {84,4,0}, {60,24,0},
+    {32,42,0}, {8,58,0}, {0,64,0}, {0,60,0}, {0,50,60}, {0,0,0}, {0,0,0}, {0,0,0},
+    {152,150,152}, {8,76,196}, {48,50,236}, {92,30,228}, {136,20,176}, {160,20,100}, {152,34,32}, {120,60,0},
+    {84,90,0}, {40,114,0}, {8,124,0}, {0,118,40}, {0,102,120}, {0,0,0}, {0,0,0}, {0,0,0},
+    {236,238,236}, {76,154,236}, {120,124,236}, {176,98,236}, {228,84,236}, {236,88,180}, {236,106,100}, {212,136,32},
+    {160,170,0}, {116,196,0}, {76,208,32}, {56,204,108}, {56,180,204}, {60,60,60}, {0,0,0}, {0,0,0},
+    {236,238,236}, {168,204,236}, {188,188,236}, {212,178,236}, {236,174,236}, {236,174,212}, {236,180,176}, {228,196,144},
+    {204,210,120}, {180,222,120}, {168,226,144}, {152,226,180}, {160,214,228}, {160,162,160}, {0,0,0}, {0,0,0}
+};
+
+static void increment_x(PPU*);
+static void increment_y(PPU*);
+static void render_background(const PPU*, uint8_t*);
+static void render_sprites(const PPU*, int, uint8_t*, bool*);
+
 PPU make_ppu(PPUMemory* mem){
-    PPU ppu = {0, 0, 0xA0, 0, 0, 0, 0, 0, mem};
+    uint8_t* framebuffer = xalloc(FRAME_SIZE, sizeof(uint8_t), calloc);
+    PPU ppu = {0, 0, 0xA0, 0, 0, 0, 0, 0, 0, 0, 0, false, 0, 0, mem, framebuffer, framebuffer};
     return ppu;
 }
+
+void free_ppu(PPU* ppu){
+    free(ppu->frame_storage);
+}
+
+uint32_t ppu_sprite0_dot(const PPU* ppu){
+    /* dot within the frame where sprite 0 first reaches the screen, which
+       is the earliest its hit can happen. Pixels aren't rendered yet so
+       opacity isn't checked. PPU_NO_HIT if it's off screen */
+    uint8_t y = ppu->oam[0], x = ppu->oam[3];
+    if (y >= FRAME_HEIGHT - 1 || x == 0xFF)
+        return PPU_NO_HIT;
+    return (y + 1) * PPU_DOTS_PER_LINE + x + 1;
+}
+
+void ppu_oam_dma(PPU* ppu, const uint8_t* page){
+    /* 256 bytes land in OAM starting at OAMADDR, wrapping around */
+    unsigned first = OAM_SIZE - ppu->oamaddr;
+    memcpy(ppu->oam + ppu->oamaddr, page, first);
+    memcpy(ppu->oam, page + first, OAM_SIZE - first);
+}
+
+uint8_t ppu_read_register(PPU* ppu, uint16_t addr){
+    /* $2000-$2007, mirrored every 8 bytes up to $3FFF */
+    switch (addr & 7){
+        case 2: {
+            uint8_t status = (ppu->ppustatus & 0xE0) | (ppu->latch & 0x1F);
+            ppu->ppustatus &= ~PPUSTATUS_VBLANK;
+            ppu->w = false;
+            return status;
+        }
+        case 4: return ppu->oam[ppu->oamaddr];
+        case 7: {
+            /* palette reads come straight back, the buffer gets the
+               nametable byte underneath them instead */
+            uint16_t a = ppu->v & 0x3FFF;
+            uint8_t val = ppu->read_buffer;
+            uint8_t** map = ppu->ppumemory->map;
+            CDL_MARK(ppu->ppumemory->cdl, a, CDL_READ);
+            if (a >= 0x3F00){
+                val = *(map[a]);
+                ppu->read_buffer = *(map[a - 0x1000]);
+            }
+            else
+                ppu->read_buffer = *(map[a]);
+            ppu->v += ppu->ppuctrl & PPUCTRL_INCREMENT ? 32 : 1;
+            return val;
+        }
+        default: return ppu->latch;
+    }
+}
+
+void ppu_write_register(PPU* ppu, uint16_t addr, uint8_t val){
+    ppu->latch = val;
+    switch (addr & 7){
+        case 0:
+            ppu->ppuctrl = val;
+            ppu->t = (ppu->t & 0xF3FF) | ((val & 0x03) << 10);
+            break;
+        case 1: ppu->ppumask = val; break;
+        case 2: break;
+        case 3: ppu->oamaddr = val; break;
+        case 4:
+            ppu->oamdata = val;
+            ppu->oam[ppu->oamaddr++] = val;
+            break;
+        case 5:
+            ppu->ppuscroll = val;
+            if (!ppu->w){
+                ppu->t = (ppu->t & 0xFFE0) | (val >> 3);
+                ppu->x = val & 0x07;
+            }
+            else
+                ppu->t = (ppu->t & 0x8C1F) | ((val & 0x07) << 12) | ((val & 0xF8) << 2);
+            ppu->w = !ppu->w;
+            break;
+        case 6:
+            ppu->ppuaddr = val;
+            if (!ppu->w)
+                ppu->t = (ppu->t & 0x00FF) | ((val & 0x3F) << 8);
+            else {
+                ppu->t = (ppu->t & 0xFF00) | val;
+                ppu->v = ppu->t;
+            }
+            ppu->w = !ppu->w;
+            break;
+        case 7: {
+            ppu->ppudata = val;
+            uint16_t a = ppu->v & 0x3FFF;
+            CDL_MARK(ppu->ppumemory->cdl, a, CDL_WRITE);
+            if (a >= 0x2000 || ppu->ppumemory->chr_ram)
+                *(ppu->ppumemory->map[a]) = val;
+            ppu->v += ppu->ppuctrl & PPUCTRL_INCREMENT ? 32 : 1;
+            break;
+        }
+    }
+}
+
+void ppu_render_line(PPU* ppu, int line, uint8_t* row){
+    /* one scanline of palette indices from the state at its start, then
+       the end of line scroll updates. Changes within a line show up on
+       the next one */
+    uint8_t** map = ppu->ppumemory->map;
+    uint8_t mask = ppu->ppumask;
+    uint8_t bg[FRAME_WIDTH] = {0};
+    uint8_t sprites[FRAME_WIDTH] = {0};
+    bool behind[FRAME_WIDTH];
+
+    if (!(mask & PPUMASK_RENDER)){
+        memset(row, *(map[0x3F00]) & 0x3F, FRAME_WIDTH);
+        return;
+    }
+    if (mask & PPUMASK_BG)
+        render_background(ppu, bg);
+    if (mask & PPUMASK_SPRITES)
+        render_sprites(ppu, line, sprites, behind);
+    if (!(mask & PPUMASK_BG_LEFT))
+        memset(bg, 0, 8);
+    if (!(mask & PPUMASK_SPRITE_LEFT))
+        memset(sprites, 0, 8);
+
+    uint8_t grey = mask & PPUMASK_GREYSCALE ? 0x30 : 0x3F;
+    for (int px = 0; px < FRAME_WIDTH; ++px){
+        uint8_t entry = bg[px];
+        if (sprites[px] && !(entry && behind[px]))
+            entry = sprites[px];
+        row[px] = *(map[0x3F00 + entry]) & grey;
+    }
+    increment_y(ppu);
+    /* horizontal position back to the left edge */
+    ppu->v = (ppu->v & ~0x041F) | (ppu->t & 0x041F);
+}
+
+void ppu_start_frame(PPU* ppu){
+    /* pre-render line: the whole address is reloaded from t, horizontal
+       at dot 257 and vertical by dot 304 */
+    if (ppu->ppumask & PPUMASK_RENDER)
+        ppu->v = ppu->t;
+}
+
+static void increment_x(PPU* ppu){
+    /* coarse X, into the next horizontal nametable on wrap */
+    if ((ppu->v & 0x001F) == 31){
+        ppu->v &= ~0x001F;
+        ppu->v ^= 0x0400;
+    }
+    else
+        ppu->v++;
+}
+
+static void increment_y(PPU* ppu){
+    /* fine Y, then coarse Y. Row 29 wraps into the next vertical
+       nametable, rows 30 and 31 (attributes) wrap in place */
+    if ((ppu->v & 0x7000) != 0x7000){
+        ppu->v += 0x1000;
+        return;
+    }
+    ppu->v &= ~0x7000;
+    uint16_t y = (ppu->v & 0x03E0) >> 5;
+    if (y == 29){
+        y = 0;
+        ppu->v ^= 0x0800;
+    }
+    else if (y == 31)
+        y = 0;
+    else
+        y++;
+    ppu->v = (ppu->v & ~0x03E0) | (y << 5);
+}
+
+static void render_background(const PPU* ppu, uint8_t* bg){
+    /* palette entry (0 when transparent) of each background pixel. 33
+       tiles because fine X can push the line into one more */
+    PPU scroll = *ppu;
+    uint8_t** map = ppu->ppumemory->map;
+    uint16_t table = ppu->ppuctrl & PPUCTRL_BG_TABLE ? 0x1000 : 0;
+    for (int tile = 0; tile < 33; ++tile){
+        uint16_t v = scroll.v;
+        uint8_t name = *(map[0x2000 | (v & 0x0FFF)]);
+        uint8_t attr = *(map[0x23C0 | (v & 0x0C00) | ((v >> 4) & 0x38) | ((v >> 2) & 0x07)]);
+        uint8_t palette = ((attr >> (((v >> 4) & 0x04) | (v & 0x02))) & 0x03) << 2;
+        uint16_t pattern = table + name * 16 + ((v >> 12) & 0x07);
+        uint8_t lo = *(map[pattern]), hi = *(map[pattern + 8]);
+        CDL_MARK(ppu->ppumemory->cdl, pattern, CDL_TILE);
+        CDL_MARK(ppu->ppumemory->cdl, pattern + 8, CDL_TILE);
+        for (int bit = 0; bit < 8; ++bit){
+            int px = tile * 8 + bit - ppu->x;
+            if (px < 0 || px >= FRAME_WIDTH)
+                continue;
+            uint8_t c = ((lo >> (7 - bit)) & 1) | (((hi >> (7 - bit)) & 1) << 1);
+            bg[px] = c ? palette | c : 0;
+        }
+        increment_x(&scroll);
+    }
+}
+
+static void render_sprites(const PPU* ppu, int line, uint8_t* out, bool* behind){
+    /* the first 8 sprites in OAM on this line, lower indices in front.
+       Sprites show one line below their Y */
+    uint8_t** map = ppu->ppumemory->map;
+    int height = ppu->ppuctrl & PPUCTRL_TALL_SPRITES ? 16 : 8;
+    int found = 0;
+    for (int i = 0; i < OAM_SIZE && found < 8; i += 4){
+        const uint8_t* s = ppu->oam + i;
+        int row = line - 1 - s[0];
+        if (row < 0 || row >= height)
+            continue;
+        found++;
+        uint8_t tile = s[1], attr = s[2];
+        if (attr & 0x80) /* vertical flip */
+            row = height - 1 - row;
+        uint16_t pattern;
+        if (height == 16)
+            pattern = ((tile & 1) << 12) + ((tile & 0xFE) + (row >> 3)) * 16 + (row & 7);
+        else
+            pattern = (ppu->ppuctrl & PPUCTRL_SPRITE_TABLE ? 0x1000 : 0) + tile * 16 + row;
+        uint8_t lo = *(map[pattern]), hi = *(map[pattern + 8]);
+        CDL_MARK(ppu->ppumemory->cdl, pattern, CDL_TILE);
+        CDL_MARK(ppu->ppumemory->cdl, pattern + 8, CDL_TILE);
+        for (int bit = 0; bit < 8; ++bit){
+            int px = s[3] + bit;
+            if (px >= FRAME_WIDTH || out[px])
+                continue;
+            int shift = attr & 0x40 ? bit : 7 - bit; /* horizontal flip */
+            uint8_t c = ((lo >> shift) & 1) | (((hi >> shift) & 1) << 1);
+            if (c){
+                out[px] = 0x10 | ((attr & 0x03) << 2) | c;
+                behind[px] = attr & 0x20;
+            }
+        }
+    }
+}
@@ -1,10 +1,42 @@
 #ifndef PPU_H
 #define PPU_H
 
+#include <stdbool.h>
 #include <stdint.h>
 
 #include "mem.h"
 
+/* visible output, one palette index (0-63) per pixel */
+#define FRAME_WIDTH 256
+#define FRAME_HEIGHT 240
+#define FRAME_SIZE (FRAME_WIDTH * FRAME_HEIGHT)
+
+/* NTSC: 341 dots x 262 scanlines, 3 dots per CPU cycle */
+#define PPU_DOTS_PER_FRAME 89342
+#define PPU_DOTS_PER_CPU_CYCLE 3
+#define PPU_DOTS_PER_LINE 341
+#define VBLANK_LINE 241
+#define PRERENDER_LINE 261
+
+#define PPUCTRL_INCREMENT 0x04 /* VRAM address += 32 instead of 1 */
+#define PPUCTRL_SPRITE_TABLE 0x08
+#define PPUCTRL_BG_TABLE 0x10
+#define PPUCTRL_TALL_SPRITES 0x20 /* 8x16 */
+#define PPUCTRL_NMI 0x80
+#define PPUMASK_GREYSCALE 0x01
+#define PPUMASK_BG_LEFT 0x02
+#define PPUMASK_SPRITE_LEFT 0x04
+#define PPUMASK_BG 0x08
+#define PPUMASK_SPRITES 0x10
+#define PPUMASK_RENDER 0x18 /* background and sprites */
+#define PPUSTATUS_VBLANK 0x80
+#define PPUSTATUS_SPRITE0 0x40
+#define PPUSTATUS_OVERFLOW 0x20
+
+#define OAM_SIZE 256
+#define OAM_DMA_CYCLES 513 /* CPU stall, +1 when it starts on an odd cycle */
+#define PPU_NO_HIT UINT32_MAX
+
 typedef struct PPU{
 
     uint8_t ppuctrl;
@@ -16,10 +48,35 @@ typedef struct PPU{
     uint8_t ppuaddr;
     uint8_t ppudata;
 
+    /* internal registers behind $2005/$2006/$2007 */
+    uint16_t v; /* current VRAM address */
+    uint16_t t; /* temporary VRAM address, the top left of the screen */
+    uint8_t x; /* fine X scroll */
+    bool w; /* second write of $2005/$2006 */
+    uint8_t read_buffer; /* $2007 reads return the previous fetch */
+    uint8_t latch; /* last value written, read back from write only registers */
+
     PPUMemory* ppumemory;
 
+    /* FRAME_SIZE bytes. May be pointed at caller owned storage so frames
+       land where they are consumed (see batch.c, attach_outputs) */
+    uint8_t* framebuffer;
+    uint8_t* frame_storage; /* the PPU's own framebuffer */
+
+    uint8_t oam[OAM_SIZE]; /* 64 sprites of Y, tile, attributes, X */
+
 } PPU;
 
+/* RGB for each of the 64 palette indices in a frame */
+extern const uint8_t PALETTE_RGB[64][3];
+
 PPU make_ppu(PPUMemory*);
+void free_ppu(PPU*);
+uint32_t ppu_sprite0_dot(const PPU*);
+void ppu_oam_dma(PPU*, const uint8_t*);
+uint8_t ppu_read_register(PPU*, uint16_t);
+void ppu_write_register(PPU*, uint16_t, uint8_t);
+void ppu_render_line(PPU*, int, uint8_t*);
+void ppu_start_frame(PPU*);
 
 #endif
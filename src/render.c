@@ -0,0 +1,193 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "render.h"
+#include "util.h"
+
+#define LOG_START_CAP 1024
+
+static void* render_main(void*);
+static void replay(Renderer*, RenderLog*, uint8_t*);
+static size_t apply_until(Renderer*, const RenderLog*, size_t, size_t*, uint32_t);
+
+Renderer* make_renderer(const PPU* source, bool threaded){
+    /* the renderer's PPU starts as a copy of source, which can be mid-run */
+    Renderer* r = xalloc(1, sizeof(Renderer), calloc);
+    r->mem = alloc_ppu_memory();
+    for (int i = 0; i < 2; ++i){
+        r->logs[i].cap = LOG_START_CAP;
+        r->logs[i].accesses = xalloc(LOG_START_CAP, sizeof(PPUAccess), twoarg_malloc);
+    }
+    render_sync(r, source);
+
+    r->threaded = threaded;
+    if (threaded){
+        for (int i = 0; i < 2; ++i)
+            r->buffers[i] = xalloc(FRAME_SIZE, sizeof(uint8_t), calloc);
+        pthread_mutex_init(&r->lock, NULL);
+        pthread_cond_init(&r->wake, NULL);
+        pthread_cond_init(&r->done, NULL);
+        if (pthread_create(&r->thread, NULL, render_main, r) != 0){
+            /* nothing to join, free it as an inline one */
+            r->threaded = false;
+            pthread_mutex_destroy(&r->lock);
+            pthread_cond_destroy(&r->wake);
+            pthread_cond_destroy(&r->done);
+            free(r->buffers[0]);
+            free(r->buffers[1]);
+            free_renderer(r);
+            err_exit("Render: Couldn't start render thread");
+        }
+    }
+    return r;
+}
+
+void free_renderer(Renderer* r){
+    if (r == NULL)
+        return;
+    if (r->threaded){
+        pthread_mutex_lock(&r->lock);
+        r->quit = true;
+        pthread_cond_signal(&r->wake);
+        pthread_mutex_unlock(&r->lock);
+        pthread_join(r->thread, NULL);
+        pthread_mutex_destroy(&r->lock);
+        pthread_cond_destroy(&r->wake);
+        pthread_cond_destroy(&r->done);
+        free(r->buffers[0]);
+        free(r->buffers[1]);
+    }
+    for (int i = 0; i < 2; ++i){
+        free(r->logs[i].accesses);
+        free(r->logs[i].dma);
+    }
+    FreeableMemory mem;
+    mem.ppumem = &r->mem;
+    free_memory(mem);
+    free(r);
+}
+
+void render_sync(Renderer* r, const PPU* source){
+    /* restart from source's state at the start of a frame, dropping what
+       was recorded. A threaded renderer finishes its frame first */
+    if (r->threaded){
+        pthread_mutex_lock(&r->lock);
+        while (r->pending)
+            pthread_cond_wait(&r->done, &r->lock);
+        pthread_mutex_unlock(&r->lock);
+    }
+    const PPUMemory* src = source->ppumemory;
+    memcpy(r->mem.map[0], src->map[0], 0x2000); /* pattern tables */
+    memcpy(r->mem.vram, src->vram, 4 * NAMETABLE_SIZE);
+    memcpy(r->mem.map[0x3F00], src->map[0x3F00], PALETTE_SIZE);
+    if (r->mem.mirroring != src->mirroring)
+        set_mirroring(&r->mem, src->mirroring);
+    r->mem.chr_ram = src->chr_ram;
+    r->ppu = *source;
+    r->ppu.ppumemory = &r->mem;
+    r->ppu.framebuffer = r->ppu.frame_storage = NULL;
+    ppu_start_frame(&r->ppu); /* the emulation thread's PPU doesn't scroll */
+    for (int i = 0; i < 2; ++i){
+        r->logs[i].n = 0;
+        r->logs[i].ndma = 0;
+    }
+}
+
+void render_record(Renderer* r, uint32_t dot, uint16_t addr, uint8_t val, AccessKind kind){
+    RenderLog* log = &r->logs[r->recording];
+    if (log->n == log->cap){
+        log->cap *= 2;
+        log->accesses = realloc(log->accesses, log->cap * sizeof(PPUAccess));
+        if (log->accesses == NULL)
+            err_exit("Render: Failed to grow the access log to %lu entries", log->cap);
+    }
+    log->accesses[log->n++] = (PPUAccess){ dot, addr, val, kind };
+}
+
+void render_record_dma(Renderer* r, uint32_t dot, const uint8_t* page){
+    RenderLog* log = &r->logs[r->recording];
+    if (log->ndma == log->dma_cap){
+        log->dma_cap = log->dma_cap ? log->dma_cap * 2 : 4;
+        log->dma = realloc(log->dma, log->dma_cap * OAM_SIZE);
+        if (log->dma == NULL)
+            err_exit("Render: Failed to grow the DMA log to %lu pages", log->dma_cap);
+    }
+    memcpy(log->dma + log->ndma++ * OAM_SIZE, page, OAM_SIZE);
+    render_record(r, dot, 0x4014, 0, ACCESS_DMA);
+}
+
+uint8_t* render_frame(Renderer* r, uint8_t* target){
+    /* end of the recorded frame. Inline, it is drawn into target and
+       target comes back. Threaded, it starts drawing on the render thread
+       and the frame before it comes back, untouched until the next call
+       (blank the first time) */
+    if (!r->threaded){
+        replay(r, &r->logs[r->recording], target);
+        return target;
+    }
+    pthread_mutex_lock(&r->lock);
+    while (r->pending)
+        pthread_cond_wait(&r->done, &r->lock);
+    uint8_t* finished = r->buffers[r->drawing];
+    r->drawing ^= 1;
+    r->recording ^= 1;
+    r->pending = true;
+    pthread_cond_signal(&r->wake);
+    pthread_mutex_unlock(&r->lock);
+    return finished;
+}
+
+static void* render_main(void* arg){
+    Renderer* r = arg;
+    pthread_mutex_lock(&r->lock);
+    for (;;){
+        while (!r->pending && !r->quit)
+            pthread_cond_wait(&r->wake, &r->lock);
+        if (!r->pending)
+            break;
+        /* the emulation thread records into the other log meanwhile */
+        RenderLog* log = &r->logs[r->recording ^ 1];
+        uint8_t* out = r->buffers[r->drawing];
+        pthread_mutex_unlock(&r->lock);
+        replay(r, log, out);
+        pthread_mutex_lock(&r->lock);
+        r->pending = false;
+        pthread_cond_signal(&r->done);
+    }
+    pthread_mutex_unlock(&r->lock);
+    return NULL;
+}
+
+static void replay(Renderer* r, RenderLog* log, uint8_t* out){
+    /* each line is drawn from the accesses made before it started, its
+       end of line scroll update comes after those made before dot 257 */
+    size_t next = 0, dma = 0;
+    for (int line = 0; line < FRAME_HEIGHT; ++line){
+        uint32_t start = line * PPU_DOTS_PER_LINE;
+        next = apply_until(r, log, next, &dma, start + 1);
+        ppu_render_line(&r->ppu, line, out + line * FRAME_WIDTH);
+        next = apply_until(r, log, next, &dma, start + 257);
+    }
+    next = apply_until(r, log, next, &dma, PRERENDER_LINE * PPU_DOTS_PER_LINE + 280);
+    ppu_start_frame(&r->ppu);
+    apply_until(r, log, next, &dma, UINT32_MAX);
+    log->n = 0;
+    log->ndma = 0;
+}
+
+static size_t apply_until(Renderer* r, const RenderLog* log, size_t next, size_t* dma, uint32_t dot){
+    /* replay the accesses made before dot, returns the first one left */
+    for (; next < log->n && log->accesses[next].dot < dot; ++next){
+        const PPUAccess* a = &log->accesses[next];
+        switch (a->kind){
+            case ACCESS_WRITE: ppu_write_register(&r->ppu, a->addr, a->val); break;
+            case ACCESS_READ: ppu_read_register(&r->ppu, a->addr); break;
+            case ACCESS_DMA: ppu_oam_dma(&r->ppu, log->dma + (*dma)++ * OAM_SIZE); break;
+        }
+    }
+    return next;
+}
@@ -0,0 +1,68 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mem.h"
+#include "ppu.h"
+
+/* Pixels are drawn by replaying the frame's PPU register accesses,
+   recorded with their dot, against a copy of the PPU that only the
+   renderer touches. Everything the CPU can observe (status flags, sprite
+   0 hit, $2007 reads) stays with the emulation thread's PPU, so running
+   the replay elsewhere or later never changes the emulation */
+
+typedef enum RenderMode{
+    RENDER_OFF, /* no pixels, the framebuffer is left alone */
+    RENDER_INLINE, /* replayed at the end of the frame, on the emulation thread */
+    RENDER_THREADED /* replayed on a render thread while the next frame runs, one frame behind */
+} RenderMode;
+
+typedef enum AccessKind{
+    ACCESS_WRITE,
+    ACCESS_READ, /* $2002 and $2007 reads move PPU state */
+    ACCESS_DMA /* OAM DMA, the page is in the log's dma pages */
+} AccessKind;
+
+typedef struct PPUAccess{
+    uint32_t dot; /* PPU dot within the frame */
+    uint16_t addr;
+    uint8_t val;
+    uint8_t kind; /* AccessKind */
+} PPUAccess;
+
+typedef struct RenderLog{
+    PPUAccess* accesses;
+    size_t n, cap;
+    uint8_t* dma; /* OAM_SIZE bytes per ACCESS_DMA, in order */
+    size_t ndma, dma_cap;
+} RenderLog;
+
+typedef struct Renderer{
+    PPU ppu; /* the renderer's own PPU, one frame behind when threaded */
+    PPUMemory mem;
+    RenderLog logs[2];
+    uint8_t recording; /* log being filled by the emulation thread */
+
+    bool threaded;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t done;
+    bool pending; /* a frame is handed over and not drawn yet */
+    bool quit;
+    uint8_t* buffers[2]; /* threaded frames, drawn and handed back in turn */
+    uint8_t drawing;
+} Renderer;
+
+Renderer* make_renderer(const PPU*, bool);
+void free_renderer(Renderer*);
+void render_sync(Renderer*, const PPU*);
+void render_record(Renderer*, uint32_t, uint16_t, uint8_t, AccessKind);
+void render_record_dma(Renderer*, uint32_t, const uint8_t*);
+uint8_t* render_frame(Renderer*, uint8_t*);
+
+#endif
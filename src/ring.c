@@ -0,0 +1,118 @@
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ring.h"
+#include "util.h"
+
+SampleRing* make_sample_ring(size_t capacity){
+    size_t cap = 1;
+    while (cap < capacity)
+        cap <<= 1;
+    SampleRing* ring = aligned_alloc(CACHE_LINE, sizeof(SampleRing));
+    if (ring == NULL)
+        err_exit("Ring: Failed to allocate sample ring");
+    memset(ring, 0, sizeof(SampleRing));
+    ring->buf = xalloc(cap, sizeof(int16_t), calloc);
+    ring->mask = cap - 1;
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->dropped, 0);
+    atomic_init(&ring->underruns, 0);
+    return ring;
+}
+
+void free_sample_ring(SampleRing* ring){
+    if (ring == NULL) return;
+    free(ring->buf);
+    free(ring);
+}
+
+size_t ring_push(SampleRing* ring, const int16_t* samples, size_t n){
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    size_t space = ring->mask + 1 - (head - tail);
+    size_t count = n < space ? n : space;
+    /* at most two copies, either side of the wrap */
+    size_t start = head & ring->mask;
+    size_t first = count < ring->mask + 1 - start ? count : ring->mask + 1 - start;
+    memcpy(ring->buf + start, samples, first * sizeof(int16_t));
+    memcpy(ring->buf, samples + first, (count - first) * sizeof(int16_t));
+    atomic_store_explicit(&ring->head, head + count, memory_order_release);
+    if (count < n)
+        atomic_fetch_add_explicit(&ring->dropped, n - count, memory_order_relaxed);
+    return count;
+}
+
+size_t ring_pop(SampleRing* ring, int16_t* samples, size_t n){
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    size_t avail = head - tail;
+    size_t count = n < avail ? n : avail;
+    size_t start = tail & ring->mask;
+    size_t first = count < ring->mask + 1 - start ? count : ring->mask + 1 - start;
+    memcpy(samples, ring->buf + start, first * sizeof(int16_t));
+    memcpy(samples + first, ring->buf, (count - first) * sizeof(int16_t));
+    atomic_store_explicit(&ring->tail, tail + count, memory_order_release);
+    if (count < n)
+        atomic_fetch_add_explicit(&ring->underruns, 1, memory_order_relaxed);
+    return count;
+}
+
+size_t ring_available(SampleRing* ring){
+    return atomic_load_explicit(&ring->head, memory_order_acquire)
+         - atomic_load_explicit(&ring->tail, memory_order_acquire);
+}
+
+FrameExchange* make_frame_exchange(size_t size){
+    FrameExchange* fx = aligned_alloc(CACHE_LINE, sizeof(FrameExchange));
+    if (fx == NULL)
+        err_exit("Ring: Failed to allocate frame exchange");
+    memset(fx, 0, sizeof(FrameExchange));
+    for (int i = 0; i < 3; ++i)
+        fx->buffers[i] = xalloc(size, sizeof(uint8_t), calloc);
+    fx->size = size;
+    fx->back = 0;
+    atomic_init(&fx->middle, 1);
+    fx->front = 2;
+    atomic_init(&fx->published, 0);
+    atomic_init(&fx->dropped, 0);
+    atomic_init(&fx->repeats, 0);
+    return fx;
+}
+
+void free_frame_exchange(FrameExchange* fx){
+    if (fx == NULL) return;
+    for (int i = 0; i < 3; ++i)
+        free(fx->buffers[i]);
+    free(fx);
+}
+
+uint8_t* fx_back(FrameExchange* fx){
+    return fx->buffers[fx->back];
+}
+
+void fx_publish(FrameExchange* fx){
+    /* acq_rel: our writes to the back buffer are visible to whoever takes
+       it from the middle, and we see their reads finished before reuse */
+    uint8_t old = atomic_exchange_explicit(&fx->middle, fx->back | FRAME_FRESH, memory_order_acq_rel);
+    if (old & FRAME_FRESH)
+        atomic_fetch_add_explicit(&fx->dropped, 1, memory_order_relaxed);
+    fx->back = old & ~FRAME_FRESH;
+    atomic_fetch_add_explicit(&fx->published, 1, memory_order_relaxed);
+}
+
+const uint8_t* fx_acquire(FrameExchange* fx, bool* fresh){
+    /* newest published frame, or the previous one again if nothing new */
+    bool is_fresh = atomic_load_explicit(&fx->middle, memory_order_relaxed) & FRAME_FRESH;
+    if (is_fresh){
+        uint8_t old = atomic_exchange_explicit(&fx->middle, fx->front, memory_order_acq_rel);
+        fx->front = old & ~FRAME_FRESH;
+    }
+    else
+        atomic_fetch_add_explicit(&fx->repeats, 1, memory_order_relaxed);
+    if (fresh != NULL)
+        *fresh = is_fresh;
+    return fx->buffers[fx->front];
+}
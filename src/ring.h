@@ -0,0 +1,52 @@
+#ifndef RING_H
+#define RING_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "util.h"
+
+/* Lock-free handoff from the emulation thread (producer) to one host
+   output thread (consumer). Neither side ever blocks: a full ring drops
+   samples and an empty one comes up short, both are counted */
+
+typedef struct SampleRing{
+    int16_t* buf;
+    size_t mask; /* capacity - 1, capacity is a power of two */
+    _Alignas(CACHE_LINE) _Atomic size_t head; /* next write, producer owned */
+    _Alignas(CACHE_LINE) _Atomic size_t tail; /* next read, consumer owned */
+    _Alignas(CACHE_LINE) _Atomic uint64_t dropped; /* samples that didn't fit */
+    _Atomic uint64_t underruns; /* pops that got fewer samples than asked */
+} SampleRing;
+
+SampleRing* make_sample_ring(size_t);
+void free_sample_ring(SampleRing*);
+size_t ring_push(SampleRing*, const int16_t*, size_t);
+size_t ring_pop(SampleRing*, int16_t*, size_t);
+size_t ring_available(SampleRing*);
+
+/* Triple buffered frames: the producer always has a back buffer to render
+   into, publishing swaps it with the middle one. The consumer swaps its
+   front buffer with the middle one when a fresh frame is there */
+#define FRAME_FRESH 0x80
+
+typedef struct FrameExchange{
+    uint8_t* buffers[3];
+    size_t size;
+    uint8_t back; /* producer owned */
+    uint8_t front; /* consumer owned */
+    _Alignas(CACHE_LINE) _Atomic uint8_t middle; /* buffer index | FRAME_FRESH */
+    _Alignas(CACHE_LINE) _Atomic uint64_t published;
+    _Atomic uint64_t dropped; /* frames replaced before the consumer took them */
+    _Atomic uint64_t repeats; /* acquires with no new frame */
+} FrameExchange;
+
+FrameExchange* make_frame_exchange(size_t);
+void free_frame_exchange(FrameExchange*);
+uint8_t* fx_back(FrameExchange*);
+void fx_publish(FrameExchange*);
+const uint8_t* fx_acquire(FrameExchange*, bool*);
+
+#endif
@@ -1,6 +1,7 @@
 #include <errno.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "rom.h"
@@ -9,11 +10,14 @@
 #define HEADER_LEN 16
 
 const InesHeader read_ines_header(const uint8_t*);
-void validate_ines_header(const InesHeader*, const char*);
 const InesHeader load_rom(NES*, const char*);
-void map_rom(NES*, const InesHeader*, uint8_t*, uint8_t*);
-void map_NROM_128(NES*, const InesHeader*, uint8_t*, uint8_t*);
-void map_NROM_256(NES*, const InesHeader*, uint8_t*, uint8_t*);
+const InesHeader load_rom_image(NES*, const uint8_t*, size_t);
+const char* probe_rom(const char*);
+const char* probe_rom_image(const uint8_t*, size_t);
+static const char* check_header(const uint8_t*, size_t);
+void map_rom(NES*, const InesHeader*, const uint8_t*, const uint8_t*);
+void map_NROM_128(NES*, const InesHeader*, const uint8_t*, const uint8_t*);
+void map_NROM_256(NES*, const InesHeader*, const uint8_t*, const uint8_t*);
 
 const InesHeader read_ines_header(const uint8_t* header){
     /* Parse an ines header and to a struct 
@@ -25,56 +29,89 @@ const InesHeader read_ines_header(const uint8_t* header){
     /* TODO offset 5 is the LSB of a 12-bit value CHRROM size (NES 2.0) but
      * this is good enough for testing and any retail NES game. */
     uint8_t chrrom = header[5];
-    uint8_t mapper = (header[7] & 0xF0) & (header[6] >> 4);
-    const InesHeader h = { sig, prgrom, chrrom, mapper };
+    uint8_t mapper = (header[7] & 0xF0) | (header[6] >> 4);
+    Mirroring mirroring = header[6] & 0x08 ? MIRROR_FOUR_SCREEN
+                        : header[6] & 0x01 ? MIRROR_VERTICAL : MIRROR_HORIZONTAL;
+    const InesHeader h = { sig, prgrom, chrrom, mapper, mirroring };
     /* TODO update this as we need to read and support more stuff */
     return h;
 }
 
-void validate_ines_header(const InesHeader* header, const char* filename){
-    if(header->valid_signature != true)
-        err_exit("ROM: iNES signature mismatch while loading %s", filename);
-    if(header->mapper != 0)
-        err_exit("ROM: Mapper %d not supported while loading %s", header->mapper, filename);
-    /* TODO update validation based on what we do and don't support. Maybe just return error to caller */
-}
-
 const InesHeader load_rom(NES* nes, const char* filename){
 
     FILE* rom = fopen(filename, "rb");
     if (rom == NULL)
         err_exit("ROM: Error opening file %s: %s", filename, strerror(errno));
+    fseek(rom, 0, SEEK_END);
+    long size = ftell(rom);
+    rewind(rom);
+    if (size < 0)
+        err_exit("ROM: Couldn't get the size of %s", filename);
+    uint8_t* image = xalloc(size > 0 ? size : 1, sizeof(uint8_t), twoarg_malloc);
+    if (fread(image, 1, size, rom) != (size_t) size)
+        err_exit("ROM: Couldn't read %s", filename);
+    fclose(rom);
 
-    size_t read;
+    const char* problem = probe_rom_image(image, size);
+    if (problem != NULL)
+        err_exit("ROM: %s while loading %s", problem, filename);
+    const InesHeader header = load_rom_image(nes, image, size);
+    free(image);
 
-    /* read+validate header */
-    uint8_t header_bytes[HEADER_LEN];
-    read = fread(header_bytes, 1, HEADER_LEN, rom);
-    if (read != HEADER_LEN) 
-        err_exit("ROM: Couldn't read header from %s", filename);
-    const InesHeader header = read_ines_header(header_bytes);
-    validate_ines_header(&header, filename);
-
-    /* read prgrom */
-    uint8_t prg[header.prgrom*PRGROM_PAGESIZE]; /* TODO consider heap alloc if these get several times bigger */
-    read = fread(prg, 1, header.prgrom*PRGROM_PAGESIZE, rom); /* TODO wrap freads for single size read */
-    if (read != header.prgrom*PRGROM_PAGESIZE) 
-        err_exit("ROM: PRGROM read failed while loading %s. Read %d of %d bytes specified in header", 
-                  read, header.prgrom*PRGROM_PAGESIZE);
-    /* read chrrom */
-    uint8_t chr[header.chrrom*CHRROM_PAGESIZE];
-    read = fread(chr, 1, header.chrrom*CHRROM_PAGESIZE, rom); /* TODO wrap freads for single size read */
-    if (read != header.chrrom*CHRROM_PAGESIZE) 
-        err_exit("ROM: CHRROM read failed while loading %s. Read %d of %d bytes specified in header", 
-                  read, header.chrrom*CHRROM_PAGESIZE);
+    return header;
+}
 
+const InesHeader load_rom_image(NES* nes, const uint8_t* image, size_t size){
+    /* an iNES file already in memory, which must pass probe_rom_image */
+    const char* problem = probe_rom_image(image, size);
+    if (problem != NULL)
+        err_exit("ROM: %s", problem);
+    const InesHeader header = read_ines_header(image);
+    const uint8_t* prg = image + HEADER_LEN;
+    const uint8_t* chr = prg + header.prgrom * PRGROM_PAGESIZE;
     map_rom(nes, &header, prg, chr);
+    return header;
+}
+
+const char* probe_rom(const char* filename){
+    /* Non-fatal version of the checks load_rom does, for callers that go
+       through many ROMs. NULL if the ROM should load, the reason otherwise */
+    FILE* rom = fopen(filename, "rb");
+    if (rom == NULL)
+        return "can't open file";
+    uint8_t header_bytes[HEADER_LEN];
+    size_t read = fread(header_bytes, 1, HEADER_LEN, rom);
+    fseek(rom, 0, SEEK_END);
+    long size = ftell(rom);
     fclose(rom);
 
-    return header;
+    if (read != HEADER_LEN)
+        return "couldn't read header";
+    return check_header(header_bytes, size);
+}
+
+const char* probe_rom_image(const uint8_t* image, size_t size){
+    /* probe_rom for a file already in memory */
+    if (size < HEADER_LEN)
+        return "couldn't read header";
+    return check_header(image, size);
+}
+
+static const char* check_header(const uint8_t* header_bytes, size_t size){
+    /* what we support, and a file long enough for it */
+    const InesHeader header = read_ines_header(header_bytes);
+    if (header.valid_signature != true)
+        return "iNES signature mismatch";
+    if (header.mapper != 0)
+        return "mapper not supported";
+    if (header.prgrom < 1 || header.prgrom > 2 || header.chrrom > 1)
+        return "PRG or CHR size doesn't fit NROM";
+    if (size < HEADER_LEN + header.prgrom*PRGROM_PAGESIZE + header.chrrom*CHRROM_PAGESIZE)
+        return "file shorter than header sizes";
+    return NULL;
 }
 
-void map_NROM_256(NES* nes, const InesHeader* header, uint8_t* prg, uint8_t* chr){
+void map_NROM_256(NES* nes, const InesHeader* header, const uint8_t* prg, const uint8_t* chr){
     unsigned int s = PRGROM_PAGESIZE * header->prgrom;
     uint8_t* dest = (nes->mem).map[PRGROM_START];
     memcpy(dest, prg, s);
@@ -83,7 +120,7 @@ void map_NROM_256(NES* nes, const InesHeader* header, uint8_t* prg, uint8_t* chr
     memcpy(dest, chr, s);
 }
 
-void map_NROM_128(NES* nes, const InesHeader* header, uint8_t* prg, uint8_t* chr){
+void map_NROM_128(NES* nes, const InesHeader* header, const uint8_t* prg, const uint8_t* chr){
     unsigned int nb = PRGROM_PAGESIZE * header->prgrom;
     uint8_t* dest = (nes->mem).map[PRGROM_START];
     memcpy(dest, prg, nb);
@@ -95,9 +132,14 @@ void map_NROM_128(NES* nes, const InesHeader* header, uint8_t* prg, uint8_t* chr
     memcpy(dest, chr, nb);
 }
 
-void map_rom(NES* nes, const InesHeader* header, uint8_t* prg, uint8_t* chr){
+void map_rom(NES* nes, const InesHeader* header, const uint8_t* prg, const uint8_t* chr){
     if (header->prgrom == 2)
         map_NROM_256(nes, header, prg, chr);
     else
         map_NROM_128(nes, header, prg, chr);
+    set_mirroring(&nes->ppumem, header->mirroring);
+    nes->mem.prg_size = PRGROM_PAGESIZE * header->prgrom;
+    nes->ppumem.chr_ram = header->chrrom == 0;
+    /* NROM has no registers, stray writes to PRG ROM are dropped */
+    set_write_policy(&nes->mem, PRGROM_START, 0xFFFF, PAGE_ROM);
 }
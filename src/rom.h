@@ -1,6 +1,7 @@
 #ifndef ROM_H
 #define ROM_H
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 
@@ -17,10 +18,14 @@ typedef struct InesHeader {
     uint8_t prgrom; /* number of 16K PRG ROM pages */
     uint8_t chrrom; /* number of 8K CHR ROM page */
     uint8_t mapper;
+    Mirroring mirroring; /* flags 6: bit 0 vertical, bit 3 four screen */
     /* TODO add more stuff when needed */
 
 } InesHeader;
 
 const InesHeader load_rom(NES*, const char*);
+const InesHeader load_rom_image(NES*, const uint8_t*, size_t);
+const char* probe_rom(const char*);
+const char* probe_rom_image(const uint8_t*, size_t);
 
 #endif
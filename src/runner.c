@@ -0,0 +1,238 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "batch.h"
+#include "hash.h"
+#include "nes.h"
+#include "rom.h"
+#include "runner.h"
+#include "util.h"
+
+typedef struct RomList{
+    char** paths;
+    size_t n;
+    size_t cap;
+} RomList;
+
+typedef struct RomResult{
+    const char* status; /* "frames", "pc", "ram" for how the run ended, or "skipped" */
+    const char* reason; /* why a ROM was skipped */
+    uint64_t frames;
+    uint64_t cycles;
+    uint64_t ram_hash;
+    uint64_t frame_hash;
+    double wall; /* seconds */
+} RomResult;
+
+typedef struct RunJob{
+    const RunnerConfig* config;
+    RomList* roms;
+    RomResult* results;
+} RunJob;
+
+static void add_rom(RomList*, const char*);
+static void add_path(RomList*, const char*);
+static void add_list(RomList*, const char*);
+static int compare_paths(const void*, const void*);
+static void run_one(void*, size_t);
+static double now(void);
+static void write_csv(FILE*, const RomList*, const RomResult*);
+static void write_json(FILE*, const RomList*, const RomResult*);
+
+int run_roms(const RunnerConfig* config, char* const* paths, int npaths, const char* list){
+    RomList roms = { NULL, 0, 0 };
+    for (int i = 0; i < npaths; ++i)
+        add_path(&roms, paths[i]);
+    if (list != NULL)
+        add_list(&roms, list);
+    if (roms.n == 0)
+        err_exit("Runner: No ROMs found");
+
+    RomResult* results = xalloc(roms.n, sizeof(RomResult), calloc);
+    RunJob job = { config, &roms, results };
+    BatchPool* pool = batch_pool_create(config->jobs);
+    batch_pool_run(pool, roms.n, run_one, &job);
+    batch_pool_destroy(pool);
+
+    FILE* out = stdout;
+    if (config->output != NULL){
+        out = fopen(config->output, "w");
+        if (out == NULL)
+            err_exit("Runner: Couldn't open %s for writing", config->output);
+    }
+    size_t len = config->output != NULL ? strlen(config->output) : 0;
+    if (len >= 5 && strcasecmp(config->output + len - 5, ".json") == 0)
+        write_json(out, &roms, results);
+    else
+        write_csv(out, &roms, results);
+    if (out != stdout)
+        fclose(out);
+
+    int failed = 0;
+    for (size_t i = 0; i < roms.n; ++i){
+        if (results[i].reason != NULL)
+            failed++;
+        free(roms.paths[i]);
+    }
+    free(roms.paths);
+    free(results);
+    return failed;
+}
+
+static void run_one(void* ctx, size_t i){
+    RunJob* job = ctx;
+    const RunnerConfig* config = job->config;
+    const char* path = job->roms->paths[i];
+    RomResult* result = &job->results[i];
+
+    result->reason = probe_rom(path);
+    if (result->reason != NULL){
+        result->status = "skipped";
+        return;
+    }
+
+    double start = now();
+    NES* nes = power_on(path);
+    set_render_mode(nes, RENDER_INLINE); /* frame_hash and the hashlog see drawn frames */
+    if (config->hashlog_dir != NULL)
+        nes->hashlog = make_hashlog();
+    result->status = "frames";
+    if (config->stop_pc)
+        set_breakpoint(nes, config->pc, BREAK_EXEC);
+    while (nes->frames < config->frames){
+        run_frame(nes);
+        if (nes->stopped){
+            result->status = "pc";
+            break;
+        }
+        if (config->stop_ram && nes_ram(nes)[config->ram_addr] == config->ram_val){
+            result->status = "ram";
+            break;
+        }
+    }
+    result->wall = now() - start;
+    result->frames = nes->frames;
+    result->cycles = nes->cpu.cycles;
+    result->ram_hash = hash64(nes_ram(nes), RAM_SIZE, 0);
+    result->frame_hash = hash64(nes->ppu.framebuffer, FRAME_SIZE, 0);
+    if (nes->hashlog != NULL){
+        const char* base = strrchr(path, '/');
+        base = base ? base + 1 : path;
+        /* prefixed by the ROM's place in the run, same named ROMs from
+           different directories would otherwise share (and race on) a log */
+        char* logname = xalloc(strlen(config->hashlog_dir) + strlen(base) + 30, sizeof(char), twoarg_malloc);
+        sprintf(logname, "%s/%lu-%s.hashes", config->hashlog_dir, i, base);
+        hashlog_write(nes->hashlog, logname);
+        free(logname);
+    }
+    power_off(nes);
+}
+
+static double now(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void add_rom(RomList* roms, const char* path){
+    if (roms->n == roms->cap){
+        roms->cap = roms->cap ? roms->cap * 2 : 64;
+        roms->paths = realloc(roms->paths, roms->cap * sizeof(char*));
+        if (roms->paths == NULL)
+            err_exit("Runner: Failed to grow ROM list to %lu entries", roms->cap);
+    }
+    char* copy = strdup(path);
+    if (copy == NULL)
+        err_exit("Runner: Failed to copy path %s", path);
+    roms->paths[roms->n++] = copy;
+}
+
+static void add_path(RomList* roms, const char* path){
+    /* directories contribute every *.nes directly inside them, sorted so
+       the output order doesn't depend on the filesystem */
+    struct stat st;
+    if (stat(path, &st) != 0 || !S_ISDIR(st.st_mode)){
+        add_rom(roms, path);
+        return;
+    }
+    DIR* dir = opendir(path);
+    if (dir == NULL)
+        err_exit("Runner: Couldn't open directory %s", path);
+    size_t first = roms->n;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL){
+        size_t len = strlen(entry->d_name);
+        if (len < 4 || strcasecmp(entry->d_name + len - 4, ".nes") != 0)
+            continue;
+        char* full = xalloc(strlen(path) + len + 2, sizeof(char), twoarg_malloc);
+        sprintf(full, "%s/%s", path, entry->d_name);
+        add_rom(roms, full);
+        free(full);
+    }
+    closedir(dir);
+    qsort(roms->paths + first, roms->n - first, sizeof(char*), compare_paths);
+}
+
+static void add_list(RomList* roms, const char* list){
+    FILE* f = fopen(list, "r");
+    if (f == NULL)
+        err_exit("Runner: Couldn't open ROM list %s", list);
+    char* line = NULL;
+    size_t cap = 0;
+    ssize_t len;
+    while ((len = getline(&line, &cap, f)) != -1){
+        while (len > 0 && (line[len-1] == '\n' || line[len-1] == '\r'))
+            line[--len] = '\0';
+        if (len == 0 || line[0] == '#')
+            continue;
+        add_path(roms, line);
+    }
+    free(line);
+    fclose(f);
+}
+
+static int compare_paths(const void* a, const void* b){
+    return strcmp(*(char* const*) a, *(char* const*) b);
+}
+
+static void write_csv(FILE* out, const RomList* roms, const RomResult* results){
+    fprintf(out, "rom,status,frames,cycles,ram_hash,frame_hash,wall_ms,reason\n");
+    for (size_t i = 0; i < roms->n; ++i){
+        const RomResult* r = &results[i];
+        /* quote the path, doubling any quotes in it */
+        fputc('"', out);
+        for (const char* c = roms->paths[i]; *c; ++c){
+            if (*c == '"') fputc('"', out);
+            fputc(*c, out);
+        }
+        fprintf(out, "\",%s,%lu,%lu,%016lx,%016lx,%.3f,%s\n", r->status, r->frames, r->cycles,
+                r->ram_hash, r->frame_hash, r->wall * 1000, r->reason ? r->reason : "");
+    }
+}
+
+static void write_json(FILE* out, const RomList* roms, const RomResult* results){
+    fprintf(out, "[\n");
+    for (size_t i = 0; i < roms->n; ++i){
+        const RomResult* r = &results[i];
+        fprintf(out, "  {\"rom\": \"");
+        for (const char* c = roms->paths[i]; *c; ++c){
+            if (*c == '"' || *c == '\\') fputc('\\', out);
+            if ((unsigned char) *c < 0x20) fprintf(out, "\\u%04x", *c);
+            else fputc(*c, out);
+        }
+        fprintf(out, "\", \"status\": \"%s\", \"frames\": %lu, \"cycles\": %lu, "
+                "\"ram_hash\": \"%016lx\", \"frame_hash\": \"%016lx\", \"wall_ms\": %.3f",
+                r->status, r->frames, r->cycles, r->ram_hash, r->frame_hash, r->wall * 1000);
+        if (r->reason != NULL)
+            fprintf(out, ", \"reason\": \"%s\"", r->reason);
+        fprintf(out, "}%s\n", i + 1 < roms->n ? "," : "");
+    }
+    fprintf(out, "]\n");
+}
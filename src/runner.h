@@ -0,0 +1,26 @@
+#ifndef RUNNER_H
+#define RUNNER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* headless regression runner: many ROMs, each for a fixed number of frames
+   or until a stop condition, results written as one CSV or JSON record per ROM */
+typedef struct RunnerConfig{
+    unsigned frames; /* frame limit per ROM */
+    bool stop_pc; /* stop when the CPU reaches pc */
+    uint16_t pc;
+    bool stop_ram; /* stop at a frame boundary once RAM[ram_addr] == ram_val */
+    uint16_t ram_addr; /* below RAM_SIZE */
+    uint8_t ram_val;
+    int jobs; /* worker threads, <= 0 for one per core */
+    const char* output; /* NULL for stdout. ".json" suffix selects JSON, CSV otherwise */
+    const char* hashlog_dir; /* if set, per-frame state hashes go to <dir>/<index>-<rom>.hashes */
+} RunnerConfig;
+
+/* paths are ROM files or directories (every *.nes inside). list is a file
+   with one ROM path per line, may be NULL. Returns the number of ROMs that
+   couldn't be run */
+int run_roms(const RunnerConfig*, char* const*, int, const char*);
+
+#endif
@@ -0,0 +1,189 @@
+#include <stdbool.h>
+#include <string.h>
+
+/* SSE2 is part of x86-64, AVX2 is checked for at run time */
+#ifdef __SSE2__
+#define SCALE_X86
+#include <immintrin.h>
+#endif
+
+#include "scale.h"
+#include "util.h"
+
+static void scale_row_scalar(const uint8_t*, uint8_t*, size_t, unsigned);
+static void dim_row_scalar(const uint8_t*, uint8_t*, size_t, uint8_t);
+static void dim_row(const uint8_t*, uint8_t*, size_t, uint8_t);
+#ifdef SCALE_X86
+static bool has_avx2(void);
+static size_t scale_row_sse2(const uint8_t*, uint8_t*, size_t, unsigned);
+static size_t scale_row_avx2(const uint8_t*, uint8_t*, size_t, unsigned);
+static size_t scale_row_avx2_by(const uint8_t*, uint8_t*, size_t, unsigned);
+static size_t dim_row_sse2(const uint8_t*, uint8_t*, size_t, uint8_t);
+static size_t dim_row_avx2(const uint8_t*, uint8_t*, size_t, uint8_t);
+
+/* vpshufb only moves bytes within a 128-bit lane. Output piece m (16
+   bytes) takes source bytes (16m + j) / factor, all from one 16 byte half
+   of the input, and pieces m and m + factor use the same indices */
+static const uint8_t LANE_SHUFFLE[SCALE_MAX - 1][SCALE_MAX][16] = {
+    {
+        {0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7},
+        {8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13, 14, 14, 15, 15},
+    },
+    {
+        {0, 0, 0, 1, 1, 1, 2, 2, 2, 3, 3, 3, 4, 4, 4, 5},
+        {5, 5, 6, 6, 6, 7, 7, 7, 8, 8, 8, 9, 9, 9, 10, 10},
+        {10, 11, 11, 11, 12, 12, 12, 13, 13, 13, 14, 14, 14, 15, 15, 15},
+    },
+    {
+        {0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3},
+        {4, 4, 4, 4, 5, 5, 5, 5, 6, 6, 6, 6, 7, 7, 7, 7},
+        {8, 8, 8, 8, 9, 9, 9, 9, 10, 10, 10, 10, 11, 11, 11, 11},
+        {12, 12, 12, 12, 13, 13, 13, 13, 14, 14, 14, 14, 15, 15, 15, 15},
+    },
+};
+#endif
+
+void scale_row(const uint8_t* src, uint8_t* dst, size_t width, unsigned factor){
+    /* dst holds width * factor bytes */
+    if (factor < 1 || factor > SCALE_MAX)
+        err_exit("Scale: factor %u out of 1..%d", factor, SCALE_MAX);
+    if (factor == 1){
+        memcpy(dst, src, width);
+        return;
+    }
+    size_t done = 0;
+#ifdef SCALE_X86
+    done = has_avx2() ? scale_row_avx2(src, dst, width, factor) : scale_row_sse2(src, dst, width, factor);
+#endif
+    scale_row_scalar(src + done, dst + done * factor, width - done, factor);
+}
+
+void repeat_row(uint8_t* row, size_t bytes, unsigned factor, ScaleFilter filter, uint8_t black){
+    /* the factor - 1 rows follow row directly, bytes apart */
+    for (unsigned i = 1; i < factor; ++i){
+        if (filter == FILTER_SCANLINES && i == factor - 1)
+            dim_row(row, row + i * bytes, bytes, black);
+        else
+            memcpy(row + i * bytes, row, bytes);
+    }
+}
+
+static void dim_row(const uint8_t* src, uint8_t* dst, size_t n, uint8_t black){
+    size_t done = 0;
+#ifdef SCALE_X86
+    done = has_avx2() ? dim_row_avx2(src, dst, n, black) : dim_row_sse2(src, dst, n, black);
+#endif
+    dim_row_scalar(src + done, dst + done, n - done, black);
+}
+
+static void scale_row_scalar(const uint8_t* src, uint8_t* dst, size_t width, unsigned factor){
+    /* the tails, and 3x without AVX2 */
+    if (factor == 3 && width > 0){
+        /* 4 byte stores that overlap, each next one fixes the fourth byte */
+        for (size_t i = 0; i < width - 1; ++i, dst += 3){
+            uint32_t t = src[i] * 0x01010101u;
+            memcpy(dst, &t, 4);
+        }
+        dst[0] = dst[1] = dst[2] = src[width - 1];
+        return;
+    }
+    for (size_t i = 0; i < width; ++i)
+        for (unsigned j = 0; j < factor; ++j)
+            *dst++ = src[i];
+}
+
+static void dim_row_scalar(const uint8_t* src, uint8_t* dst, size_t n, uint8_t black){
+    /* rounds like pavgb */
+    for (size_t i = 0; i < n; ++i)
+        dst[i] = (src[i] + black + 1) >> 1;
+}
+
+#ifdef SCALE_X86
+static bool has_avx2(void){
+    /* cheap after the first call, libgcc caches the cpuid results */
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+
+static size_t scale_row_sse2(const uint8_t* src, uint8_t* dst, size_t width, unsigned factor){
+    /* SSE2 can only interleave, which gives 2x and 4x. 3x needs a byte
+       shuffle and is left to the scalar loop. Returns source bytes done */
+    if (factor == 3)
+        return 0;
+    size_t i = 0;
+    for (; i + 16 <= width; i += 16){
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i lo = _mm_unpacklo_epi8(v, v);
+        __m128i hi = _mm_unpackhi_epi8(v, v);
+        __m128i* out = (__m128i*)(dst + i * factor);
+        if (factor == 2){
+            _mm_storeu_si128(out, lo);
+            _mm_storeu_si128(out + 1, hi);
+        }
+        else {
+            _mm_storeu_si128(out, _mm_unpacklo_epi8(lo, lo));
+            _mm_storeu_si128(out + 1, _mm_unpackhi_epi8(lo, lo));
+            _mm_storeu_si128(out + 2, _mm_unpacklo_epi8(hi, hi));
+            _mm_storeu_si128(out + 3, _mm_unpackhi_epi8(hi, hi));
+        }
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static size_t scale_row_avx2(const uint8_t* src, uint8_t* dst, size_t width, unsigned factor){
+    /* a constant factor unrolls the inner loop and keeps it in registers */
+    switch (factor){
+        case 2: return scale_row_avx2_by(src, dst, width, 2);
+        case 3: return scale_row_avx2_by(src, dst, width, 3);
+        default: return scale_row_avx2_by(src, dst, width, 4);
+    }
+}
+
+__attribute__((target("avx2"), always_inline))
+static inline size_t scale_row_avx2_by(const uint8_t* src, uint8_t* dst, size_t width, unsigned factor){
+    /* 32 source bytes make factor outputs of 32. Output k's lanes are
+       pieces 2k and 2k + 1, shuffled out of whichever input half they need */
+    __m256i shuffle[SCALE_MAX];
+    for (unsigned k = 0; k < factor; ++k){
+        const uint8_t* lanes = LANE_SHUFFLE[factor - 2][0];
+        __m128i lo = _mm_loadu_si128((const __m128i*)(lanes + (2 * k) % factor * 16));
+        __m128i hi = _mm_loadu_si128((const __m128i*)(lanes + (2 * k + 1) % factor * 16));
+        shuffle[k] = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+    }
+    size_t i = 0;
+    for (; i + 32 <= width; i += 32){
+        __m128i a = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(src + i + 16));
+        const __m256i halves[3] = {
+            _mm256_broadcastsi128_si256(a),
+            _mm256_inserti128_si256(_mm256_castsi128_si256(a), b, 1),
+            _mm256_broadcastsi128_si256(b),
+        };
+        __m256i* out = (__m256i*)(dst + i * factor);
+        for (unsigned k = 0; k < factor; ++k){
+            /* lanes from halves a|a, a|b or b|b */
+            unsigned h = (2 * k) / factor + (2 * k + 1) / factor;
+            _mm256_storeu_si256(out + k, _mm256_shuffle_epi8(halves[h], shuffle[k]));
+        }
+    }
+    return i;
+}
+
+static size_t dim_row_sse2(const uint8_t* src, uint8_t* dst, size_t n, uint8_t black){
+    __m128i b = _mm_set1_epi8(black);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_avg_epu8(_mm_loadu_si128((const __m128i*)(src + i)), b));
+    return i;
+}
+
+__attribute__((target("avx2")))
+static size_t dim_row_avx2(const uint8_t* src, uint8_t* dst, size_t n, uint8_t black){
+    __m256i b = _mm256_set1_epi8(black);
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32)
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_avg_epu8(_mm256_loadu_si256((const __m256i*)(src + i)), b));
+    return i;
+}
+#endif
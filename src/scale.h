@@ -0,0 +1,19 @@
+#ifndef SCALE_H
+#define SCALE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SCALE_MAX 4
+
+typedef enum ScaleFilter{ FILTER_NONE, FILTER_SCANLINES } ScaleFilter;
+
+/* Nearest neighbour integer upscaling of 8-bit rows (palette indices or
+   one plane of a planar format), AVX2 when the host has it, SSE2
+   otherwise. scale_row widens a row factor times into dst, repeat_row
+   copies a widened row down over the factor - 1 rows under it. With
+   FILTER_SCANLINES the last copy is halved towards black */
+void scale_row(const uint8_t*, uint8_t*, size_t, unsigned);
+void repeat_row(uint8_t*, size_t, unsigned, ScaleFilter, uint8_t);
+
+#endif
@@ -0,0 +1,106 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sched.h"
+
+static void sift_up(Scheduler*, uint8_t);
+static void sift_down(Scheduler*, uint8_t);
+static void swap(Scheduler*, uint8_t, uint8_t);
+static void remove_at(Scheduler*, uint8_t);
+
+Scheduler make_scheduler(void){
+    Scheduler s;
+    s.next = SCHED_NEVER;
+    s.n = 0;
+    for (int i = 0; i < EVENT_TYPES; ++i)
+        s.slot[i] = EVENT_TYPES;
+    return s;
+}
+
+void sched_set(Scheduler* s, EventType type, uint64_t time){
+    /* schedule type at time, replacing any pending one. SCHED_NEVER cancels */
+    if (time == SCHED_NEVER){
+        sched_cancel(s, type);
+        return;
+    }
+    uint8_t i = s->slot[type];
+    if (i >= s->n){
+        i = s->n++;
+        s->heap[i].type = type;
+        s->slot[type] = i;
+        s->heap[i].time = time;
+        sift_up(s, i);
+    }
+    else if (time < s->heap[i].time){
+        s->heap[i].time = time;
+        sift_up(s, i);
+    }
+    else {
+        s->heap[i].time = time;
+        sift_down(s, i);
+    }
+    s->next = s->heap[0].time;
+}
+
+void sched_cancel(Scheduler* s, EventType type){
+    uint8_t i = s->slot[type];
+    if (i < s->n)
+        remove_at(s, i);
+}
+
+bool sched_pop(Scheduler* s, uint64_t now, EventType* type){
+    /* take the earliest event if it's due by now */
+    if (s->next > now)
+        return false;
+    *type = s->heap[0].type;
+    remove_at(s, 0);
+    return true;
+}
+
+uint64_t sched_time(const Scheduler* s, EventType type){
+    uint8_t i = s->slot[type];
+    return i < s->n ? s->heap[i].time : SCHED_NEVER;
+}
+
+static void remove_at(Scheduler* s, uint8_t i){
+    EventType type = s->heap[i].type;
+    uint8_t last = --s->n;
+    if (i != last){
+        swap(s, i, last);
+        sift_down(s, i);
+        sift_up(s, i);
+    }
+    s->slot[type] = EVENT_TYPES;
+    s->next = s->n > 0 ? s->heap[0].time : SCHED_NEVER;
+}
+
+static void swap(Scheduler* s, uint8_t a, uint8_t b){
+    Event tmp = s->heap[a];
+    s->heap[a] = s->heap[b];
+    s->heap[b] = tmp;
+    s->slot[s->heap[a].type] = a;
+    s->slot[s->heap[b].type] = b;
+}
+
+static void sift_up(Scheduler* s, uint8_t i){
+    while (i > 0){
+        uint8_t parent = (i - 1) / 2;
+        if (s->heap[parent].time <= s->heap[i].time)
+            break;
+        swap(s, i, parent);
+        i = parent;
+    }
+}
+
+static void sift_down(Scheduler* s, uint8_t i){
+    for (;;){
+        uint8_t min = i;
+        uint8_t l = 2 * i + 1, r = 2 * i + 2;
+        if (l < s->n && s->heap[l].time < s->heap[min].time) min = l;
+        if (r < s->n && s->heap[r].time < s->heap[min].time) min = r;
+        if (min == i)
+            break;
+        swap(s, i, min);
+        i = min;
+    }
+}
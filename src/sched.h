@@ -0,0 +1,48 @@
+#ifndef SCHED_H
+#define SCHED_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Everything that has to happen at a known time is kept here, keyed on the
+   CPU cycle counter (the master clock the rest of the emulator counts in,
+   PPU dots are rounded up to the next CPU cycle). The run loop only
+   compares cpu.cycles against next, and handles events when it's reached */
+
+#define SCHED_NEVER UINT64_MAX
+
+typedef enum EventType{
+    EVENT_FRAME_END,
+    EVENT_VBLANK, /* scanline 241 dot 1 */
+    EVENT_PRERENDER, /* scanline 261 dot 1, status flags clear */
+    EVENT_SPRITE0, /* predicted sprite 0 hit */
+    EVENT_APU_FRAME_IRQ,
+    EVENT_DMC_FETCH,
+    EVENT_MAPPER_IRQ,
+    EVENT_INTERRUPT, /* an interrupt line changed or I was cleared, poll the CPU */
+    EVENT_OAM_DMA, /* $4014 was written, runs once the writing instruction is done */
+    EVENT_BREAK, /* a breakpoint or watchpoint was hit, leave the run loop */
+    EVENT_TYPES
+} EventType;
+
+typedef struct Event{
+    uint64_t time;
+    EventType type;
+} Event;
+
+/* Indexed binary min-heap holding at most one event per type, so
+   rescheduling moves the existing entry instead of adding another */
+typedef struct Scheduler{
+    uint64_t next; /* time of the earliest event, SCHED_NEVER when empty */
+    uint8_t n;
+    Event heap[EVENT_TYPES];
+    uint8_t slot[EVENT_TYPES]; /* heap index of each type, n or more when unscheduled */
+} Scheduler;
+
+Scheduler make_scheduler(void);
+void sched_set(Scheduler*, EventType, uint64_t);
+void sched_cancel(Scheduler*, EventType);
+bool sched_pop(Scheduler*, uint64_t, EventType*);
+uint64_t sched_time(const Scheduler*, EventType);
+
+#endif
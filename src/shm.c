@@ -0,0 +1,110 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "shm.h"
+#include "util.h"
+
+_Static_assert(sizeof(ObsHeader) <= OBS_REGS_OFFSET, "ObsHeader overlaps the register block");
+_Static_assert(sizeof(ObsRegs) <= OBS_RAM_OFFSET - OBS_REGS_OFFSET, "ObsRegs overlaps RAM");
+
+Observation* open_observation(const char* name){
+    int fd = shm_open(name, O_CREAT | O_RDWR, 0600);
+    if (fd < 0)
+        err_exit("Shm: Couldn't create %s: %s", name, strerror(errno));
+    if (ftruncate(fd, OBS_SIZE) != 0)
+        err_exit("Shm: Couldn't size %s: %s", name, strerror(errno));
+    uint8_t* base = mmap(NULL, OBS_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+        err_exit("Shm: Couldn't map %s: %s", name, strerror(errno));
+
+    memset(base, 0, OBS_SIZE);
+    ObsHeader* header = (ObsHeader*) base;
+    header->version = OBS_VERSION;
+    atomic_init(&header->seq, 0);
+    header->regs_offset = OBS_REGS_OFFSET;
+    header->ram_offset = OBS_RAM_OFFSET;
+    header->ram_size = RAM_SIZE;
+    header->frame_offset = OBS_FRAME_OFFSET;
+    header->frame_size = FRAME_SIZE;
+    /* magic last, so a reader that sees it sees a filled in header */
+    atomic_thread_fence(memory_order_release);
+    header->magic = OBS_MAGIC;
+
+    Observation* obs = xalloc(1, sizeof(Observation), calloc);
+    obs->name = strdup(name);
+    obs->base = base;
+    return obs;
+}
+
+void close_observation(Observation* obs, bool unlink){
+    if (obs == NULL) return;
+    munmap(obs->base, OBS_SIZE);
+    if (unlink)
+        shm_unlink(obs->name);
+    free(obs->name);
+    free(obs);
+}
+
+void publish_observation(Observation* obs, const CPU* cpu, const uint8_t* ram,
+                         const uint8_t* frame, uint64_t frame_no, const uint8_t* input){
+    ObsHeader* header = (ObsHeader*) obs->base;
+    uint64_t seq = atomic_load_explicit(&header->seq, memory_order_relaxed);
+    atomic_store_explicit(&header->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    ObsRegs* regs = (ObsRegs*)(obs->base + OBS_REGS_OFFSET);
+    regs->cycles = cpu->cycles;
+    regs->PC = cpu->PC;
+    regs->A = cpu->A;
+    regs->X = cpu->X;
+    regs->Y = cpu->Y;
+    regs->P = cpu->P;
+    regs->SP = cpu->SP;
+    memcpy(regs->input, input, sizeof(regs->input));
+    memcpy(obs->base + OBS_RAM_OFFSET, ram, RAM_SIZE);
+    memcpy(obs->base + OBS_FRAME_OFFSET, frame, FRAME_SIZE);
+    header->frame = frame_no;
+
+    atomic_store_explicit(&header->seq, seq + 2, memory_order_release);
+}
+
+const uint8_t* map_observation(const char* name){
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0)
+        return NULL;
+    const uint8_t* base = mmap(NULL, OBS_SIZE, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+        return NULL;
+    if (((const ObsHeader*) base)->magic != OBS_MAGIC){
+        unmap_observation(base);
+        return NULL;
+    }
+    return base;
+}
+
+void unmap_observation(const uint8_t* base){
+    if (base != NULL)
+        munmap((void*) base, OBS_SIZE);
+}
+
+uint64_t obs_read_begin(const ObsHeader* header){
+    /* spin while the writer is mid-copy */
+    uint64_t seq;
+    while ((seq = atomic_load_explicit((_Atomic uint64_t*) &header->seq, memory_order_acquire)) & 1)
+        ;
+    return seq;
+}
+
+bool obs_read_retry(const ObsHeader* header, uint64_t seq){
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit((_Atomic uint64_t*) &header->seq, memory_order_relaxed) != seq;
+}
@@ -0,0 +1,71 @@
+#ifndef SHM_H
+#define SHM_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "cpu.h"
+#include "mem.h"
+#include "ppu.h"
+
+/* Observation segment, one per instance, created with shm_open under a
+   name like "/nes0". Fixed layout so readers in any language can map it:
+
+     0    ObsHeader
+     64   ObsRegs
+     128  RAM (RAM_SIZE bytes)
+     2176 framebuffer (FRAME_SIZE palette indices, the same frame as RAM)
+
+   Published at every frame end under a sequence lock: seq is odd while
+   the writer is copying. Readers note seq, read, and retry if seq was odd
+   or has changed since.
+
+   The writer copies RAM and the frame in (about 64K a frame) rather than
+   running the machine in the segment: RAM changes all through a frame,
+   and a lock held for the whole frame would leave free running readers
+   almost no time to read. Readers copy nothing, they read in place */
+
+#define OBS_MAGIC 0x4F53454E /* "NESO" little-endian */
+#define OBS_VERSION 1
+#define OBS_REGS_OFFSET 64
+#define OBS_RAM_OFFSET 128
+#define OBS_FRAME_OFFSET (OBS_RAM_OFFSET + RAM_SIZE)
+#define OBS_SIZE (OBS_FRAME_OFFSET + FRAME_SIZE)
+
+typedef struct ObsHeader{
+    uint32_t magic;
+    uint32_t version;
+    _Atomic uint64_t seq;
+    uint64_t frame; /* frame number of the current observation */
+    uint32_t regs_offset;
+    uint32_t ram_offset;
+    uint32_t ram_size;
+    uint32_t frame_offset;
+    uint32_t frame_size;
+} ObsHeader;
+
+typedef struct ObsRegs{
+    uint64_t cycles;
+    uint16_t PC;
+    uint8_t A, X, Y, P, SP;
+    uint8_t input[2];
+} ObsRegs;
+
+typedef struct Observation{
+    char* name;
+    uint8_t* base; /* OBS_SIZE bytes mapped */
+} Observation;
+
+Observation* open_observation(const char*);
+void close_observation(Observation*, bool);
+void publish_observation(Observation*, const CPU*, const uint8_t*, const uint8_t*, uint64_t, const uint8_t*);
+
+/* reader side, for C consumers mapping an existing segment. NULL when
+   there's none or it isn't one, unmap it when done */
+const uint8_t* map_observation(const char*);
+void unmap_observation(const uint8_t*);
+uint64_t obs_read_begin(const ObsHeader*);
+bool obs_read_retry(const ObsHeader*, uint64_t);
+
+#endif
@@ -0,0 +1,211 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "stream.h"
+#include "util.h"
+
+#define WAV_HEADER_LEN 44
+#define Y4M_FRAME_TAG "FRAME\n"
+
+/* NTSC: 1789773 Hz / 29780.5 cycles per frame */
+#define Y4M_HEADER "YUV4MPEG2 W%u H%u F3579546:59561 Ip A1:1 C444\n"
+#define Y4M_BLACK 16 /* limited range Y */
+
+static void convert_frame(const Stream*, const uint8_t*, uint8_t*);
+static void write_all(int, struct iovec*, int);
+static void flush_video(Stream*);
+static void flush_audio(Stream*);
+static void wav_header(uint8_t*, unsigned, uint32_t);
+static void put32(uint8_t*, uint32_t);
+
+Stream* open_stream(int video_fd, int audio_fd, VideoFormat format, unsigned scale, ScaleFilter filter, unsigned sample_rate){
+    if (video_fd >= 0 && video_fd == audio_fd)
+        err_exit("Stream: audio and video need separate descriptors");
+    if (scale < 1 || scale > SCALE_MAX)
+        err_exit("Stream: scale %u out of 1..%d", scale, SCALE_MAX);
+
+    Stream* s = xalloc(1, sizeof(Stream), calloc);
+    s->video_fd = video_fd;
+    s->audio_fd = audio_fd;
+    s->format = format;
+    s->scale = scale;
+    s->filter = filter;
+    s->sample_rate = sample_rate;
+    s->frame_bytes = FRAME_SIZE * scale * scale * 3;
+    s->frames = xalloc(STREAM_BATCH, s->frame_bytes, twoarg_malloc);
+
+    /* BT.601 limited range, computed once per palette entry */
+    for (int i = 0; i < 64; ++i){
+        double r = PALETTE_RGB[i][0], g = PALETTE_RGB[i][1], b = PALETTE_RGB[i][2];
+        if (format == VIDEO_Y4M){
+            s->lookup[i][0] = 16 + (65.481 * r + 128.553 * g + 24.966 * b) / 255 + 0.5;
+            s->lookup[i][1] = 128 + (-37.797 * r - 74.203 * g + 112.0 * b) / 255 + 0.5;
+            s->lookup[i][2] = 128 + (112.0 * r - 93.786 * g - 18.214 * b) / 255 + 0.5;
+        }
+        else
+            memcpy(s->lookup[i], PALETTE_RGB[i], 3);
+    }
+
+    struct iovec iov[1];
+    if (video_fd >= 0 && format == VIDEO_Y4M){
+        char header[64];
+        iov[0].iov_base = header;
+        iov[0].iov_len = snprintf(header, sizeof(header), Y4M_HEADER, FRAME_WIDTH * scale, FRAME_HEIGHT * scale);
+        write_all(video_fd, iov, 1);
+    }
+    if (audio_fd >= 0){
+        /* sizes are unknown while streaming. 0xFFFFFFFF is what most readers
+           take for "until EOF", we patch real sizes on close if we can seek */
+        uint8_t header[WAV_HEADER_LEN];
+        wav_header(header, sample_rate, 0xFFFFFFFF - WAV_HEADER_LEN + 8);
+        iov[0].iov_base = header;
+        iov[0].iov_len = WAV_HEADER_LEN;
+        write_all(audio_fd, iov, 1);
+    }
+    return s;
+}
+
+void stream_frame(Stream* s, const uint8_t* frame, const int16_t* samples, size_t nsamples){
+    if (s->video_fd >= 0){
+        convert_frame(s, frame, s->frames + s->nframes * s->frame_bytes);
+        if (++s->nframes == STREAM_BATCH)
+            flush_video(s);
+    }
+    if (s->audio_fd >= 0){
+        while (nsamples > 0){
+            size_t n = STREAM_AUDIO_CAP - s->nsamples;
+            n = n < nsamples ? n : nsamples;
+            memcpy(s->audio + s->nsamples, samples, n * sizeof(int16_t));
+            s->nsamples += n;
+            samples += n;
+            nsamples -= n;
+            if (s->nsamples == STREAM_AUDIO_CAP)
+                flush_audio(s);
+        }
+    }
+}
+
+void close_stream(Stream* s){
+    if (s->video_fd >= 0)
+        flush_video(s);
+    if (s->audio_fd >= 0){
+        flush_audio(s);
+        /* pipes can't seek, leave the streaming sizes in place there */
+        if (lseek(s->audio_fd, 0, SEEK_SET) == 0){
+            uint8_t header[WAV_HEADER_LEN];
+            uint32_t data = s->audio_bytes > 0xFFFFFFFF - WAV_HEADER_LEN ? 0xFFFFFFFF - WAV_HEADER_LEN : s->audio_bytes;
+            wav_header(header, s->sample_rate, data);
+            if (write(s->audio_fd, header, WAV_HEADER_LEN) != WAV_HEADER_LEN)
+                err_exit("Stream: Couldn't rewrite WAV header: %s", strerror(errno));
+        }
+    }
+    free(s->frames);
+    free(s);
+}
+
+static void convert_frame(const Stream* s, const uint8_t* frame, uint8_t* out){
+    /* each source row is converted once, widened, then repeated down */
+    unsigned f = s->scale;
+    size_t width = FRAME_WIDTH * f;
+    if (s->format == VIDEO_Y4M){
+        /* planar: all Y, then all Cb, then all Cr. Scanlines only darken Y */
+        size_t plane = FRAME_SIZE * f * f;
+        uint8_t row[3][FRAME_WIDTH];
+        for (int y = 0; y < FRAME_HEIGHT; ++y, frame += FRAME_WIDTH){
+            for (int x = 0; x < FRAME_WIDTH; ++x){
+                const uint8_t* yuv = s->lookup[frame[x] & 0x3F];
+                row[0][x] = yuv[0];
+                row[1][x] = yuv[1];
+                row[2][x] = yuv[2];
+            }
+            for (int c = 0; c < 3; ++c){
+                uint8_t* o = out + c * plane + y * f * width;
+                scale_row(row[c], o, FRAME_WIDTH, f);
+                repeat_row(o, width, f, c == 0 ? s->filter : FILTER_NONE, Y4M_BLACK);
+            }
+        }
+    }
+    else {
+        /* 3 byte pixels don't suit the byte scaler, widen the indices */
+        uint8_t row[FRAME_WIDTH * SCALE_MAX];
+        for (int y = 0; y < FRAME_HEIGHT; ++y, frame += FRAME_WIDTH){
+            uint8_t* o = out + y * f * width * 3;
+            scale_row(frame, row, FRAME_WIDTH, f);
+            for (size_t x = 0; x < width; ++x)
+                memcpy(o + 3 * x, s->lookup[row[x] & 0x3F], 3);
+            repeat_row(o, width * 3, f, s->filter, 0);
+        }
+    }
+}
+
+static void flush_video(Stream* s){
+    /* one writev for the whole batch: a tag and a frame per entry pair */
+    struct iovec iov[STREAM_BATCH * 2];
+    int n = 0;
+    for (int i = 0; i < s->nframes; ++i){
+        if (s->format == VIDEO_Y4M){
+            iov[n].iov_base = Y4M_FRAME_TAG;
+            iov[n++].iov_len = strlen(Y4M_FRAME_TAG);
+        }
+        iov[n].iov_base = s->frames + i * s->frame_bytes;
+        iov[n++].iov_len = s->frame_bytes;
+    }
+    if (n > 0)
+        write_all(s->video_fd, iov, n);
+    s->nframes = 0;
+}
+
+static void flush_audio(Stream* s){
+    if (s->nsamples == 0)
+        return;
+    struct iovec iov[1] = { { s->audio, s->nsamples * sizeof(int16_t) } };
+    write_all(s->audio_fd, iov, 1);
+    s->audio_bytes += s->nsamples * sizeof(int16_t);
+    s->nsamples = 0;
+}
+
+static void write_all(int fd, struct iovec* iov, int n){
+    /* writev may stop short on pipes, pick up where it left off */
+    while (n > 0){
+        ssize_t w = writev(fd, iov, n);
+        if (w < 0){
+            if (errno == EINTR) continue;
+            err_exit("Stream: write failed: %s", strerror(errno));
+        }
+        while (n > 0 && (size_t) w >= iov->iov_len){
+            w -= iov->iov_len;
+            iov++;
+            n--;
+        }
+        if (n > 0){
+            iov->iov_base = (uint8_t*) iov->iov_base + w;
+            iov->iov_len -= w;
+        }
+    }
+}
+
+static void put32(uint8_t* p, uint32_t v){
+    p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+}
+
+static void wav_header(uint8_t* h, unsigned rate, uint32_t data_bytes){
+    /* PCM, mono, 16 bit */
+    memcpy(h, "RIFF", 4);
+    put32(h + 4, data_bytes + WAV_HEADER_LEN - 8);
+    memcpy(h + 8, "WAVEfmt ", 8);
+    put32(h + 16, 16);
+    h[20] = 1; h[21] = 0; /* PCM */
+    h[22] = 1; h[23] = 0; /* channels */
+    put32(h + 24, rate);
+    put32(h + 28, rate * 2); /* byte rate */
+    h[32] = 2; h[33] = 0; /* block align */
+    h[34] = 16; h[35] = 0; /* bits per sample */
+    memcpy(h + 36, "data", 4);
+    put32(h + 40, data_bytes);
+}
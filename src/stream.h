@@ -0,0 +1,43 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+#include "mem.h"
+#include "ppu.h"
+#include "scale.h"
+
+/* frames and samples queued before one writev flushes them */
+#define STREAM_BATCH 16
+#define STREAM_AUDIO_CAP (STREAM_BATCH * 1024)
+
+typedef enum VideoFormat{ VIDEO_Y4M, VIDEO_RGB } VideoFormat;
+
+/* Raw A/V out to file descriptors (files or pipes into an encoder):
+   video as YUV4MPEG2 (4:4:4, so conversion is one table lookup per pixel)
+   or packed RGB24, audio as 16-bit mono WAV. Frames are converted and
+   upscaled a row at a time straight into a batch buffer and written
+   STREAM_BATCH at a time */
+typedef struct Stream{
+    int video_fd; /* -1 for none */
+    int audio_fd;
+    VideoFormat format;
+    unsigned scale; /* 1..SCALE_MAX */
+    ScaleFilter filter;
+    size_t frame_bytes; /* converted size of one frame */
+    uint8_t* frames; /* STREAM_BATCH converted frames */
+    int nframes;
+    uint8_t lookup[64][3]; /* palette index to Y,Cb,Cr or R,G,B */
+    int16_t audio[STREAM_AUDIO_CAP];
+    size_t nsamples;
+    uint64_t audio_bytes; /* written so far, patched into the WAV header on close */
+    unsigned sample_rate;
+} Stream;
+
+Stream* open_stream(int, int, VideoFormat, unsigned, ScaleFilter, unsigned);
+void stream_frame(Stream*, const uint8_t*, const int16_t*, size_t);
+void close_stream(Stream*);
+
+#endif
@@ -5,10 +5,13 @@
 
 #include "util.h"
 
+_Thread_local jmp_buf* err_trap;
+_Thread_local char err_message[256];
+
 void* xalloc(size_t num, size_t size, void* (*allocator)(size_t,size_t)){
 	void* r = (*allocator)(num,size);
     if (r == NULL)
-        err_exit("fatal: Failed to allocate %lu bytes\n", size);
+        err_exit("Failed to allocate %lu bytes", num * size);
     return r;
 }
 
@@ -17,8 +20,14 @@ void* twoarg_malloc(size_t num, size_t size){
 }
 
 void err_exit(const char* format, ...){
-    fprintf(stderr, "fatal: ");
     va_list ap;
+    if (err_trap != NULL){
+        va_start(ap, format);
+        vsnprintf(err_message, sizeof(err_message), format, ap);
+        va_end(ap);
+        longjmp(*err_trap, 1);
+    }
+    fprintf(stderr, "fatal: ");
     va_start(ap, format);
     vfprintf(stderr, format, ap);
     va_end(ap);
@@ -1,10 +1,19 @@
 #ifndef UTIL_H
 #define UTIL_H
 
+#include <setjmp.h>
 #include <sys/types.h>
 
+#define CACHE_LINE 64 /* alignment that keeps per-thread data off shared lines */
+
 void* xalloc(size_t, size_t, void* (*)(size_t, size_t));
 void* twoarg_malloc(size_t, size_t);
 void err_exit(const char* format, ...);
 
+/* while set, err_exit longjmps here with its message in err_message
+   instead of exiting, so library calls can fail back to their caller.
+   What was allocated before the failure isn't freed */
+extern _Thread_local jmp_buf* err_trap;
+extern _Thread_local char err_message[256];
+
 #endif